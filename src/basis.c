@@ -22,14 +22,9 @@
 
 #include "config.h"
 
-#ifdef CALIBRATE
 #include <glib.h>
 #include <math.h>
 #include <stdio.h>
-#else
-#include <libgimp/gimp.h>
-#include <math.h>
-#endif
 
 #include "main.h"
 
@@ -37,34 +32,55 @@
 #include "cell.h"
 #include "lnoise.h"
 #include "poisson.h"
+#include "simplex.h"
 #include "snoise.h"
 
 #include "random.h"
 
 #include "render.h"
 
-static int octaves = 0;
-static double lacunarity = NAN;
-static double oct_frac = NAN;
-static double* weight = NULL;
-static double exponent = NAN;
+struct BasisContextStr
+{
+  int octaves;
+  double lacunarity;
+  double oct_frac;
+  double* weight;
+  double* octave_scale; /* lacunarity^i, how much octave 'i' is scaled */
+  double* octave_shift; /* and how much it's moved, to decorrelate them */
+  double exponent;
+  int data_type; /* index in basis[] */
+  guint16* shuffle_table;
+  RandomState rnd;
+  const LNoiseKernels* lnoise; /* lattice noise kernels for this CPU */
+
+  /* MAP_PERIODIC: the periods of x and y at the first octave (0 when not
+   * periodic), and for every octave the periods and how much x and y are
+   * scaled, see SetBasisPeriod() */
+  int period_x, period_y;
+  int* period[2];
+  double* period_scale[2];
+
+  guint id; /* unique to this context, see GetBasisId() */
+
+  /* what it was made from, see InitBasis() */
+  guint32 seed;
+  int basis, dim, multi;
+  float p_octaves, p_lacunarity, p_hurst;
+  double footprint;
+};
 
 typedef void* init_fn_type();
-typedef void deinit_fn_type(void*);
 
 typedef struct
 {
   init_fn_type* init_fn;
-  deinit_fn_type* deinit_fn;
   basis_fn_type* sample_fn;
+  basis_span_fn_type* span_fn;
 #ifdef CALIBRATE
   const char* name;
 #endif
 } basis_struct;
 
-static int data_type = 0;
-static void* data = NULL;
-
 #ifdef CALIBRATE
 FILE* cal_file;
 double st_sum, st_min, st_max;
@@ -72,7 +88,14 @@ double st_sum, st_min, st_max;
 
 /**********************/
 
-#include "calibration.h"
+/* the scaling of each basis depends on the hash (see random.h), and
+ * calibrate writes the file of the hash it's built with */
+#ifdef HASH_MIX
+#define CALIBRATION_FILE "calibration_mix.h"
+#else
+#define CALIBRATION_FILE "calibration.h"
+#endif
+#include CALIBRATION_FILE
 
 #ifndef CALIBRATE
 #define NO_CAL(A) A
@@ -86,67 +109,243 @@ double st_sum, st_min, st_max;
 
 /* Basis functions are supposed to return values in the range [-0.5 .. 0.5] */
 
-#define BASE3D(NAME, XTRA_VARS, VALUE_CALC, RETURN) \
-  static double NAME(double x, double y, double z)  \
-  {                                                 \
-    int i = 0;                                      \
-    double value = NAN;                             \
-    double shift = NAN;                             \
-    XTRA_VARS                                       \
-                                                    \
-    shift = 0;                                      \
-    for (i = 0; i < octaves; i++)                   \
-    {                                               \
-      VALUE_CALC;                                   \
-      x *= lacunarity;                              \
-      y *= lacunarity;                              \
-      z *= lacunarity;                              \
-      shift += 37.687322;                           \
-    }                                               \
-    return RETURN;                                  \
-  }
-
-#define BASE4D(NAME, XTRA_VARS, VALUE_CALC, RETURN)          \
-  static double NAME(double x, double y, double z, double t) \
-  {                                                          \
-    int i = 0;                                               \
-    double value = NAN;                                      \
-    double shift = NAN;                                      \
-    XTRA_VARS                                                \
-                                                             \
-    shift = 0;                                               \
-    for (i = 0; i < octaves; i++)                            \
-    {                                                        \
-      VALUE_CALC;                                            \
-      x *= lacunarity;                                       \
-      y *= lacunarity;                                       \
-      z *= lacunarity;                                       \
-      t *= lacunarity;                                       \
-      shift += 37.687322;                                    \
-    }                                                        \
-    return RETURN;                                           \
-  }
-
-#define BASE5D(NAME, XTRA_VARS, VALUE_CALC, RETURN)                    \
-  static double NAME(double x, double y, double z, double s, double t) \
-  {                                                                    \
-    int i = 0;                                                         \
-    double value = NAN;                                                \
-    double shift = NAN;                                                \
-    XTRA_VARS                                                          \
-                                                                       \
-    shift = 0;                                                         \
-    for (i = 0; i < octaves; i++)                                      \
-    {                                                                  \
-      VALUE_CALC;                                                      \
-      x *= lacunarity;                                                 \
-      y *= lacunarity;                                                 \
-      z *= lacunarity;                                                 \
-      s *= lacunarity;                                                 \
-      t *= lacunarity;                                                 \
-      shift += 37.687322;                                              \
-    }                                                                  \
-    return RETURN;                                                     \
+/* The octave loops are specialized for the common octave counts: the body of a
+ * basis is inlined once for each count from 1 to 8, and with the count a
+ * constant the loop is unrolled completely. Larger counts take NAME##_Loop(),
+ * which loops as they come */
+#if defined(__clang__)
+#define UNROLL_OCTAVES _Pragma("unroll 8")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define UNROLL_OCTAVES _Pragma("GCC unroll 8")
+#else
+#define UNROLL_OCTAVES
+#endif
+
+#define OCTAVE_DISPATCH(FN, ...) \
+  switch (ctx->octaves)          \
+  {                              \
+    case 1:                      \
+      return FN(__VA_ARGS__, 1); \
+    case 2:                      \
+      return FN(__VA_ARGS__, 2); \
+    case 3:                      \
+      return FN(__VA_ARGS__, 3); \
+    case 4:                      \
+      return FN(__VA_ARGS__, 4); \
+    case 5:                      \
+      return FN(__VA_ARGS__, 5); \
+    case 6:                      \
+      return FN(__VA_ARGS__, 6); \
+    case 7:                      \
+      return FN(__VA_ARGS__, 7); \
+    case 8:                      \
+      return FN(__VA_ARGS__, 8); \
+  }
+
+#define BASE3D(NAME, XTRA_VARS, VALUE_CALC, RETURN)                                                                                                 \
+  static inline G_GNUC_ALWAYS_INLINE double NAME##_Octaves(const BasisContext* ctx, void* data, double x0, double y0, double z0, const int octaves) \
+  {                                                                                                                                                 \
+    int i = 0;                                                                                                                                      \
+    double value = NAN;                                                                                                                             \
+    double shift = NAN;                                                                                                                             \
+    double x = NAN, y = NAN, z = NAN;                                                                                                               \
+    const double* octave_scale = ctx->octave_scale;                                                                                                 \
+    const double* octave_shift = ctx->octave_shift;                                                                                                 \
+    const double* weight = ctx->weight;                                                                                                             \
+    guint16* shuffle_table = ctx->shuffle_table;                                                                                                    \
+    XTRA_VARS                                                                                                                                       \
+                                                                                                                                                    \
+    UNROLL_OCTAVES                                                                                                                                  \
+    for (i = 0; i < octaves; i++)                                                                                                                   \
+    {                                                                                                                                               \
+      x = x0 * octave_scale[i];                                                                                                                     \
+      y = y0 * octave_scale[i];                                                                                                                     \
+      z = z0 * octave_scale[i];                                                                                                                     \
+      shift = octave_shift[i];                                                                                                                      \
+      VALUE_CALC;                                                                                                                                   \
+    }                                                                                                                                               \
+    return RETURN;                                                                                                                                  \
+  }                                                                                                                                                 \
+                                                                                                                                                    \
+  static double NAME##_Loop(const BasisContext* ctx, void* data, double x0, double y0, double z0)                                                   \
+  {                                                                                                                                                 \
+    int i = 0;                                                                                                                                      \
+    double value = NAN;                                                                                                                             \
+    double shift = NAN;                                                                                                                             \
+    double x = NAN, y = NAN, z = NAN;                                                                                                               \
+    const int octaves = ctx->octaves;                                                                                                               \
+    const double* octave_scale = ctx->octave_scale;                                                                                                 \
+    const double* octave_shift = ctx->octave_shift;                                                                                                 \
+    const double* weight = ctx->weight;                                                                                                             \
+    guint16* shuffle_table = ctx->shuffle_table;                                                                                                    \
+    XTRA_VARS                                                                                                                                       \
+                                                                                                                                                    \
+    for (i = 0; i < octaves; i++)                                                                                                                   \
+    {                                                                                                                                               \
+      x = x0 * octave_scale[i];                                                                                                                     \
+      y = y0 * octave_scale[i];                                                                                                                     \
+      z = z0 * octave_scale[i];                                                                                                                     \
+      shift = octave_shift[i];                                                                                                                      \
+      VALUE_CALC;                                                                                                                                   \
+    }                                                                                                                                               \
+    return RETURN;                                                                                                                                  \
+  }                                                                                                                                                 \
+                                                                                                                                                    \
+  static double NAME(const BasisContext* ctx, void* data, double x0, double y0, double z0)                                                          \
+  {                                                                                                                                                 \
+    OCTAVE_DISPATCH(NAME##_Octaves, ctx, data, x0, y0, z0);                                                                                         \
+    return NAME##_Loop(ctx, data, x0, y0, z0);                                                                                                      \
+  }
+
+#define BASE4D(NAME, XTRA_VARS, VALUE_CALC, RETURN)                                                                                                            \
+  static inline G_GNUC_ALWAYS_INLINE double NAME##_Octaves(const BasisContext* ctx, void* data, double x0, double y0, double z0, double t0, const int octaves) \
+  {                                                                                                                                                            \
+    int i = 0;                                                                                                                                                 \
+    double value = NAN;                                                                                                                                        \
+    double shift = NAN;                                                                                                                                        \
+    double x = NAN, y = NAN, z = NAN, t = NAN;                                                                                                                 \
+    const double* octave_scale = ctx->octave_scale;                                                                                                            \
+    const double* octave_shift = ctx->octave_shift;                                                                                                            \
+    const double* weight = ctx->weight;                                                                                                                        \
+    guint16* shuffle_table = ctx->shuffle_table;                                                                                                               \
+    XTRA_VARS                                                                                                                                                  \
+                                                                                                                                                               \
+    UNROLL_OCTAVES                                                                                                                                             \
+    for (i = 0; i < octaves; i++)                                                                                                                              \
+    {                                                                                                                                                          \
+      x = x0 * octave_scale[i];                                                                                                                                \
+      y = y0 * octave_scale[i];                                                                                                                                \
+      z = z0 * octave_scale[i];                                                                                                                                \
+      t = t0 * octave_scale[i];                                                                                                                                \
+      shift = octave_shift[i];                                                                                                                                 \
+      VALUE_CALC;                                                                                                                                              \
+    }                                                                                                                                                          \
+    return RETURN;                                                                                                                                             \
+  }                                                                                                                                                            \
+                                                                                                                                                               \
+  static double NAME##_Loop(const BasisContext* ctx, void* data, double x0, double y0, double z0, double t0)                                                   \
+  {                                                                                                                                                            \
+    int i = 0;                                                                                                                                                 \
+    double value = NAN;                                                                                                                                        \
+    double shift = NAN;                                                                                                                                        \
+    double x = NAN, y = NAN, z = NAN, t = NAN;                                                                                                                 \
+    const int octaves = ctx->octaves;                                                                                                                          \
+    const double* octave_scale = ctx->octave_scale;                                                                                                            \
+    const double* octave_shift = ctx->octave_shift;                                                                                                            \
+    const double* weight = ctx->weight;                                                                                                                        \
+    guint16* shuffle_table = ctx->shuffle_table;                                                                                                               \
+    XTRA_VARS                                                                                                                                                  \
+                                                                                                                                                               \
+    for (i = 0; i < octaves; i++)                                                                                                                              \
+    {                                                                                                                                                          \
+      x = x0 * octave_scale[i];                                                                                                                                \
+      y = y0 * octave_scale[i];                                                                                                                                \
+      z = z0 * octave_scale[i];                                                                                                                                \
+      t = t0 * octave_scale[i];                                                                                                                                \
+      shift = octave_shift[i];                                                                                                                                 \
+      VALUE_CALC;                                                                                                                                              \
+    }                                                                                                                                                          \
+    return RETURN;                                                                                                                                             \
+  }                                                                                                                                                            \
+                                                                                                                                                               \
+  static double NAME(const BasisContext* ctx, void* data, double x0, double y0, double z0, double t0)                                                          \
+  {                                                                                                                                                            \
+    OCTAVE_DISPATCH(NAME##_Octaves, ctx, data, x0, y0, z0, t0);                                                                                                \
+    return NAME##_Loop(ctx, data, x0, y0, z0, t0);                                                                                                             \
+  }
+
+#define BASE5D(NAME, XTRA_VARS, VALUE_CALC, RETURN)                                                                                                                       \
+  static inline G_GNUC_ALWAYS_INLINE double NAME##_Octaves(const BasisContext* ctx, void* data, double x0, double y0, double z0, double s0, double t0, const int octaves) \
+  {                                                                                                                                                                       \
+    int i = 0;                                                                                                                                                            \
+    double value = NAN;                                                                                                                                                   \
+    double shift = NAN;                                                                                                                                                   \
+    double x = NAN, y = NAN, z = NAN, s = NAN, t = NAN;                                                                                                                   \
+    const double* octave_scale = ctx->octave_scale;                                                                                                                       \
+    const double* octave_shift = ctx->octave_shift;                                                                                                                       \
+    const double* weight = ctx->weight;                                                                                                                                   \
+    guint16* shuffle_table = ctx->shuffle_table;                                                                                                                          \
+    XTRA_VARS                                                                                                                                                             \
+                                                                                                                                                                          \
+    UNROLL_OCTAVES                                                                                                                                                        \
+    for (i = 0; i < octaves; i++)                                                                                                                                         \
+    {                                                                                                                                                                     \
+      x = x0 * octave_scale[i];                                                                                                                                           \
+      y = y0 * octave_scale[i];                                                                                                                                           \
+      z = z0 * octave_scale[i];                                                                                                                                           \
+      s = s0 * octave_scale[i];                                                                                                                                           \
+      t = t0 * octave_scale[i];                                                                                                                                           \
+      shift = octave_shift[i];                                                                                                                                            \
+      VALUE_CALC;                                                                                                                                                         \
+    }                                                                                                                                                                     \
+    return RETURN;                                                                                                                                                        \
+  }                                                                                                                                                                       \
+                                                                                                                                                                          \
+  static double NAME##_Loop(const BasisContext* ctx, void* data, double x0, double y0, double z0, double s0, double t0)                                                   \
+  {                                                                                                                                                                       \
+    int i = 0;                                                                                                                                                            \
+    double value = NAN;                                                                                                                                                   \
+    double shift = NAN;                                                                                                                                                   \
+    double x = NAN, y = NAN, z = NAN, s = NAN, t = NAN;                                                                                                                   \
+    const int octaves = ctx->octaves;                                                                                                                                     \
+    const double* octave_scale = ctx->octave_scale;                                                                                                                       \
+    const double* octave_shift = ctx->octave_shift;                                                                                                                       \
+    const double* weight = ctx->weight;                                                                                                                                   \
+    guint16* shuffle_table = ctx->shuffle_table;                                                                                                                          \
+    XTRA_VARS                                                                                                                                                             \
+                                                                                                                                                                          \
+    for (i = 0; i < octaves; i++)                                                                                                                                         \
+    {                                                                                                                                                                     \
+      x = x0 * octave_scale[i];                                                                                                                                           \
+      y = y0 * octave_scale[i];                                                                                                                                           \
+      z = z0 * octave_scale[i];                                                                                                                                           \
+      s = s0 * octave_scale[i];                                                                                                                                           \
+      t = t0 * octave_scale[i];                                                                                                                                           \
+      shift = octave_shift[i];                                                                                                                                            \
+      VALUE_CALC;                                                                                                                                                         \
+    }                                                                                                                                                                     \
+    return RETURN;                                                                                                                                                        \
+  }                                                                                                                                                                       \
+                                                                                                                                                                          \
+  static double NAME(const BasisContext* ctx, void* data, double x0, double y0, double z0, double s0, double t0)                                                          \
+  {                                                                                                                                                                       \
+    OCTAVE_DISPATCH(NAME##_Octaves, ctx, data, x0, y0, z0, s0, t0);                                                                                                       \
+    return NAME##_Loop(ctx, data, x0, y0, z0, s0, t0);                                                                                                                    \
+  }
+
+/* Span versions that loop over the scalar function */
+
+#define SPAN3D(NAME)                                                                                                                    \
+  static void NAME##_Span(const BasisContext* ctx, void* data, int n, const double* x, const double* y, const double* z, double* value) \
+  {                                                                                                                                     \
+    int j = 0;                                                                                                                          \
+                                                                                                                                        \
+    for (j = 0; j < n; j++)                                                                                                             \
+    {                                                                                                                                   \
+      value[j] = NAME(ctx, data, x[j], y[j], z[j]);                                                                                     \
+    }                                                                                                                                   \
+  }
+
+#define SPAN4D(NAME)                                                                                                                                     \
+  static void NAME##_Span(const BasisContext* ctx, void* data, int n, const double* x, const double* y, const double* z, const double* t, double* value) \
+  {                                                                                                                                                      \
+    int j = 0;                                                                                                                                           \
+                                                                                                                                                         \
+    for (j = 0; j < n; j++)                                                                                                                              \
+    {                                                                                                                                                    \
+      value[j] = NAME(ctx, data, x[j], y[j], z[j], t[j]);                                                                                                \
+    }                                                                                                                                                    \
+  }
+
+#define SPAN5D(NAME)                                                                                                                                                      \
+  static void NAME##_Span(const BasisContext* ctx, void* data, int n, const double* x, const double* y, const double* z, const double* s, const double* t, double* value) \
+  {                                                                                                                                                                       \
+    int j = 0;                                                                                                                                                            \
+                                                                                                                                                                          \
+    for (j = 0; j < n; j++)                                                                                                                                               \
+    {                                                                                                                                                                     \
+      value[j] = NAME(ctx, data, x[j], y[j], z[j], s[j], t[j]);                                                                                                           \
+    }                                                                                                                                                                     \
   }
 
 #ifdef CALIBRATE
@@ -157,10 +356,13 @@ double st_sum, st_min, st_max;
 
 /****************/
 
-#define FUNC3D(NAME, XTRA_VARS, VALUE_CALC, CALC_FBM, CALC_MF1, CALC_MF2, MID_VALUE, SCALING)         \
-  BASE3D(NAME##_FBM, XTRA_VARS; value = 0;, VALUE_CALC; CALC_FBM;, OUTPUT(value, MID_VALUE, SCALING)) \
-  BASE3D(NAME##_MF1, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF1;, pow(value, exponent) - 0.5)        \
-  BASE3D(NAME##_MF2, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF2;, -(pow(value, exponent) - 0.5))
+#define FUNC3D(NAME, XTRA_VARS, VALUE_CALC, CALC_FBM, CALC_MF1, CALC_MF2, MID_VALUE, SCALING)          \
+  BASE3D(NAME##_FBM, XTRA_VARS; value = 0;, VALUE_CALC; CALC_FBM;, OUTPUT(value, MID_VALUE, SCALING))  \
+  SPAN3D(NAME##_FBM)                                                                                   \
+  BASE3D(NAME##_MF1, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF1;, pow(value, ctx->exponent) - 0.5)    \
+  SPAN3D(NAME##_MF1)                                                                                   \
+  BASE3D(NAME##_MF2, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF2;, -(pow(value, ctx->exponent) - 0.5)) \
+  SPAN3D(NAME##_MF2)
 
 #define TURB3D(NAME, XTRA_VARS, VALUE_CALC, CALC_FBM, CALC_MF1, CALC_MF2, MID_VALUE, SCALING) \
   BASE3D(NAME##_FBM,       /* name */                                                         \
@@ -175,6 +377,7 @@ double st_sum, st_min, st_max;
          ,                                                                                    \
          value * (SCALING * 2.0) - 0.5 /* final scaling */                                    \
   )                                                                                           \
+  SPAN3D(NAME##_FBM)                                                                          \
   BASE3D(NAME##_MF1,                                                                          \
          double tmp = NAN;                                                                    \
          XTRA_VARS;                                                                           \
@@ -185,7 +388,8 @@ double st_sum, st_min, st_max;
          if (tmp < 0) tmp = -tmp;                                                             \
          CALC_MF1;                                                                            \
          ,                                                                                    \
-         pow(value, exponent) - 0.5)                                                          \
+         pow(value, ctx->exponent) - 0.5)                                                     \
+  SPAN3D(NAME##_MF1)                                                                          \
   BASE3D(NAME##_MF2,                                                                          \
          double tmp = NAN;                                                                    \
          XTRA_VARS;                                                                           \
@@ -196,12 +400,16 @@ double st_sum, st_min, st_max;
          if (tmp < 0) tmp = -tmp;                                                             \
          CALC_MF2;                                                                            \
          ,                                                                                    \
-         -(pow(value, exponent) - 0.5))
+         -(pow(value, ctx->exponent) - 0.5))                                                  \
+  SPAN3D(NAME##_MF2)
 
-#define FUNC4D(NAME, XTRA_VARS, VALUE_CALC, CALC_FBM, CALC_MF1, CALC_MF2, MID_VALUE, SCALING)         \
-  BASE4D(NAME##_FBM, XTRA_VARS; value = 0;, VALUE_CALC; CALC_FBM;, OUTPUT(value, MID_VALUE, SCALING)) \
-  BASE4D(NAME##_MF1, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF1;, pow(value, exponent) - 0.5)        \
-  BASE4D(NAME##_MF2, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF2;, -(pow(value, exponent) - 0.5))
+#define FUNC4D(NAME, XTRA_VARS, VALUE_CALC, CALC_FBM, CALC_MF1, CALC_MF2, MID_VALUE, SCALING)          \
+  BASE4D(NAME##_FBM, XTRA_VARS; value = 0;, VALUE_CALC; CALC_FBM;, OUTPUT(value, MID_VALUE, SCALING))  \
+  SPAN4D(NAME##_FBM)                                                                                   \
+  BASE4D(NAME##_MF1, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF1;, pow(value, ctx->exponent) - 0.5)    \
+  SPAN4D(NAME##_MF1)                                                                                   \
+  BASE4D(NAME##_MF2, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF2;, -(pow(value, ctx->exponent) - 0.5)) \
+  SPAN4D(NAME##_MF2)
 
 #define TURB4D(NAME, XTRA_VARS, VALUE_CALC, CALC_FBM, CALC_MF1, CALC_MF2, MID_VALUE, SCALING) \
   BASE4D(NAME##_FBM,       /* name */                                                         \
@@ -216,6 +424,7 @@ double st_sum, st_min, st_max;
          ,                                                                                    \
          value * (SCALING * 2.0) - 0.5 /* final scaling */                                    \
   )                                                                                           \
+  SPAN4D(NAME##_FBM)                                                                          \
   BASE4D(NAME##_MF1,                                                                          \
          double tmp = NAN;                                                                    \
          XTRA_VARS;                                                                           \
@@ -226,7 +435,8 @@ double st_sum, st_min, st_max;
          if (tmp < 0) tmp = -tmp;                                                             \
          CALC_MF1;                                                                            \
          ,                                                                                    \
-         pow(value, exponent) - 0.5)                                                          \
+         pow(value, ctx->exponent) - 0.5)                                                     \
+  SPAN4D(NAME##_MF1)                                                                          \
   BASE4D(NAME##_MF2,                                                                          \
          double tmp = NAN;                                                                    \
          XTRA_VARS;                                                                           \
@@ -237,12 +447,16 @@ double st_sum, st_min, st_max;
          if (tmp < 0) tmp = -tmp;                                                             \
          CALC_MF2;                                                                            \
          ,                                                                                    \
-         -(pow(value, exponent) - 0.5))
+         -(pow(value, ctx->exponent) - 0.5))                                                  \
+  SPAN4D(NAME##_MF2)
 
-#define FUNC5D(NAME, XTRA_VARS, VALUE_CALC, CALC_FBM, CALC_MF1, CALC_MF2, MID_VALUE, SCALING)         \
-  BASE5D(NAME##_FBM, XTRA_VARS; value = 0;, VALUE_CALC; CALC_FBM;, OUTPUT(value, MID_VALUE, SCALING)) \
-  BASE5D(NAME##_MF1, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF1;, pow(value, exponent) - 0.5)        \
-  BASE5D(NAME##_MF2, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF2;, -(pow(value, exponent) - 0.5))
+#define FUNC5D(NAME, XTRA_VARS, VALUE_CALC, CALC_FBM, CALC_MF1, CALC_MF2, MID_VALUE, SCALING)          \
+  BASE5D(NAME##_FBM, XTRA_VARS; value = 0;, VALUE_CALC; CALC_FBM;, OUTPUT(value, MID_VALUE, SCALING))  \
+  SPAN5D(NAME##_FBM)                                                                                   \
+  BASE5D(NAME##_MF1, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF1;, pow(value, ctx->exponent) - 0.5)    \
+  SPAN5D(NAME##_MF1)                                                                                   \
+  BASE5D(NAME##_MF2, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF2;, -(pow(value, ctx->exponent) - 0.5)) \
+  SPAN5D(NAME##_MF2)
 
 #define TURB5D(NAME, XTRA_VARS, VALUE_CALC, CALC_FBM, CALC_MF1, CALC_MF2, MID_VALUE, SCALING) \
   BASE5D(NAME##_FBM,       /* name */                                                         \
@@ -257,6 +471,7 @@ double st_sum, st_min, st_max;
          ,                                                                                    \
          value * (SCALING * 2.0) - 0.5 /* final scaling */                                    \
   )                                                                                           \
+  SPAN5D(NAME##_FBM)                                                                          \
   BASE5D(NAME##_MF1,                                                                          \
          double tmp = NAN;                                                                    \
          XTRA_VARS;                                                                           \
@@ -267,7 +482,8 @@ double st_sum, st_min, st_max;
          if (tmp < 0) tmp = -tmp;                                                             \
          CALC_MF1;                                                                            \
          ,                                                                                    \
-         pow(value, exponent) - 0.5)                                                          \
+         pow(value, ctx->exponent) - 0.5)                                                     \
+  SPAN5D(NAME##_MF1)                                                                          \
   BASE5D(NAME##_MF2,                                                                          \
          double tmp = NAN;                                                                    \
          XTRA_VARS;                                                                           \
@@ -278,7 +494,8 @@ double st_sum, st_min, st_max;
          if (tmp < 0) tmp = -tmp;                                                             \
          CALC_MF2;                                                                            \
          ,                                                                                    \
-         -(pow(value, exponent) - 0.5))
+         -(pow(value, ctx->exponent) - 0.5))                                                  \
+  SPAN5D(NAME##_MF2)
 
 /* debug-only functions */
 /*
@@ -306,13 +523,13 @@ double st_sum, st_min, st_max;
 
 /****** Sparse noise *******/
 
-FUNC3D(SparseNoise3D, /* no extra vars */, /* No common calculations */, value += SNoise3D(PARAM_3D, (SNoiseBasisCache3D*)data) * weight[i], /* Fractal brownian motion */
-       value *= MULTI_MIX_1(SNoise3D(PARAM_3D, (SNoiseBasisCache3D*)data), weight[i], SN_3D_MID, SN_3D_FAC),
-       value *= MULTI_MIX_2(SNoise3D(PARAM_3D, (SNoiseBasisCache3D*)data), weight[i], SN_3D_MID, SN_3D_FAC),
+FUNC3D(SparseNoise3D, /* no extra vars */, /* No common calculations */, value += SNoise3D(PARAM_3D, (const SNoiseFeatures3D*)data, shuffle_table) * weight[i], /* Fractal brownian motion */
+       value *= MULTI_MIX_1(SNoise3D(PARAM_3D, (const SNoiseFeatures3D*)data, shuffle_table), weight[i], SN_3D_MID, SN_3D_FAC),
+       value *= MULTI_MIX_2(SNoise3D(PARAM_3D, (const SNoiseFeatures3D*)data, shuffle_table), weight[i], SN_3D_MID, SN_3D_FAC),
        SN_3D_MID,
        SN_3D_FAC)
 
-TURB3D(SparseTurb3D_1, /* no extra vars */, tmp = SNoise3D(PARAM_3D, (SNoiseBasisCache3D*)data), value += tmp * weight[i];,
+TURB3D(SparseTurb3D_1, /* no extra vars */, tmp = SNoise3D(PARAM_3D, (const SNoiseFeatures3D*)data, shuffle_table), value += tmp * weight[i];,
                                                                                                                           value *= TURB_MIX_1(tmp, weight[i], SN_3D_MID, SN_3D_FAC),
                                                                                                                           value *= TURB_MIX_2(tmp, weight[i], SN_3D_MID, SN_3D_FAC),
                                                                                                                           SN_3D_MID,
@@ -320,9 +537,9 @@ TURB3D(SparseTurb3D_1, /* no extra vars */, tmp = SNoise3D(PARAM_3D, (SNoiseBasi
 
 /**/
 
-FUNC4D(SparseNoise4D, /* no extra vars */, /* No common calculations */, value += SNoise4D(PARAM_4D, (SNoiseBasisCache4D*)data) * weight[i], value *= MULTI_MIX_1(SNoise4D(PARAM_4D, (SNoiseBasisCache4D*)data), weight[i], SN_4D_MID, SN_4D_FAC), value *= MULTI_MIX_2(SNoise4D(PARAM_4D, (SNoiseBasisCache4D*)data), weight[i], SN_4D_MID, SN_4D_FAC), SN_4D_MID, SN_4D_FAC)
+FUNC4D(SparseNoise4D, /* no extra vars */, /* No common calculations */, value += SNoise4D(PARAM_4D, (const SNoiseFeatures4D*)data, shuffle_table) * weight[i], value *= MULTI_MIX_1(SNoise4D(PARAM_4D, (const SNoiseFeatures4D*)data, shuffle_table), weight[i], SN_4D_MID, SN_4D_FAC), value *= MULTI_MIX_2(SNoise4D(PARAM_4D, (const SNoiseFeatures4D*)data, shuffle_table), weight[i], SN_4D_MID, SN_4D_FAC), SN_4D_MID, SN_4D_FAC)
 
-TURB4D(SparseTurb4D_1, /* no extra vars */, tmp = SNoise4D(PARAM_4D, (SNoiseBasisCache4D*)data), value += tmp * weight[i];,
+TURB4D(SparseTurb4D_1, /* no extra vars */, tmp = SNoise4D(PARAM_4D, (const SNoiseFeatures4D*)data, shuffle_table), value += tmp * weight[i];,
                                                                                                                           value *= TURB_MIX_1(tmp, weight[i], SN_4D_MID, SN_4D_FAC),
                                                                                                                           value *= TURB_MIX_2(tmp, weight[i], SN_4D_MID, SN_4D_FAC),
                                                                                                                           SN_4D_MID,
@@ -330,9 +547,9 @@ TURB4D(SparseTurb4D_1, /* no extra vars */, tmp = SNoise4D(PARAM_4D, (SNoiseBasi
 
 /**/
 
-FUNC5D(SparseNoise5D, /* no extra vars */, /* No common calculations */, value += SNoise5D(PARAM_5D, (SNoiseBasisCache5D*)data) * weight[i], value *= MULTI_MIX_1(SNoise5D(PARAM_5D, (SNoiseBasisCache5D*)data), weight[i], SN_5D_MID, SN_5D_FAC), value *= MULTI_MIX_2(SNoise5D(PARAM_5D, (SNoiseBasisCache5D*)data), weight[i], SN_5D_MID, SN_5D_FAC), SN_5D_MID, SN_5D_FAC)
+FUNC5D(SparseNoise5D, /* no extra vars */, /* No common calculations */, value += SNoise5D(PARAM_5D, (const SNoiseFeatures5D*)data, shuffle_table) * weight[i], value *= MULTI_MIX_1(SNoise5D(PARAM_5D, (const SNoiseFeatures5D*)data, shuffle_table), weight[i], SN_5D_MID, SN_5D_FAC), value *= MULTI_MIX_2(SNoise5D(PARAM_5D, (const SNoiseFeatures5D*)data, shuffle_table), weight[i], SN_5D_MID, SN_5D_FAC), SN_5D_MID, SN_5D_FAC)
 
-TURB5D(SparseTurb5D_1, /* no extra vars */, tmp = SNoise5D(PARAM_5D, (SNoiseBasisCache5D*)data), value += tmp * weight[i];,
+TURB5D(SparseTurb5D_1, /* no extra vars */, tmp = SNoise5D(PARAM_5D, (const SNoiseFeatures5D*)data, shuffle_table), value += tmp * weight[i];,
                                                                                                                           value *= TURB_MIX_1(tmp, weight[i], SN_5D_MID, SN_5D_FAC),
                                                                                                                           value *= TURB_MIX_2(tmp, weight[i], SN_5D_MID, SN_5D_FAC),
                                                                                                                           SN_5D_MID,
@@ -340,42 +557,286 @@ TURB5D(SparseTurb5D_1, /* no extra vars */, tmp = SNoise5D(PARAM_5D, (SNoiseBasi
 
 /****** Lattice noise *******/
 
-FUNC3D(LatticeNoise3D, /* no extra vars */, /* No common calculations */, value += LNoise3D(PARAM_3D, (guint16*)data) * weight[i], value *= MULTI_MIX_1(LNoise3D(PARAM_3D, (guint16*)data), weight[i], LN_3D_MID, LN_3D_FAC), value *= MULTI_MIX_2(LNoise3D(PARAM_3D, (guint16*)data), weight[i], LN_3D_MID, LN_3D_FAC), LN_3D_MID, LN_3D_FAC)
+/* Lattice noise spans evaluate each octave for LN_CHUNK samples at a time,
+ * with the kernels chosen for this CPU (see GetLNoiseKernels()). The noise
+ * value is in 'tmp' for the calculations */
+#define LN_CHUNK 64
+
+#define LSPAN3D(NAME, INIT_VALUE, VALUE_CALC, RETURN)                                                                                 \
+  static void NAME##_Span(const BasisContext* ctx, void* data, int n, const double* x, const double* y, const double* z, double* out) \
+  {                                                                                                                                   \
+    int i = 0, j = 0, k = 0, m = 0;                                                                                                   \
+    double value = NAN;                                                                                                               \
+    double tmp = NAN;                                                                                                                 \
+    double sx[LN_CHUNK] = {NAN}, sy[LN_CHUNK] = {NAN}, sz[LN_CHUNK] = {NAN};                                                          \
+    double noise[LN_CHUNK] = {NAN}, acc[LN_CHUNK] = {NAN};                                                                            \
+    const int octaves = ctx->octaves;                                                                                                 \
+    const double* octave_scale = ctx->octave_scale;                                                                                   \
+    const double* octave_shift = ctx->octave_shift;                                                                                   \
+    const double* weight = ctx->weight;                                                                                               \
+    guint16* shuffle_table = ctx->shuffle_table;                                                                                      \
+                                                                                                                                      \
+    for (j = 0; j < n; j += LN_CHUNK)                                                                                                 \
+    {                                                                                                                                 \
+      m = MIN(LN_CHUNK, n - j);                                                                                                       \
+      for (k = 0; k < m; k++)                                                                                                         \
+      {                                                                                                                               \
+        acc[k] = INIT_VALUE;                                                                                                          \
+      }                                                                                                                               \
+                                                                                                                                      \
+      for (i = 0; i < octaves; i++)                                                                                                   \
+      {                                                                                                                               \
+        for (k = 0; k < m; k++)                                                                                                       \
+        {                                                                                                                             \
+          sx[k] = x[j + k] * octave_scale[i] + octave_shift[i];                                                                       \
+          sy[k] = y[j + k] * octave_scale[i] + octave_shift[i];                                                                       \
+          sz[k] = z[j + k] * octave_scale[i] + octave_shift[i];                                                                       \
+        }                                                                                                                             \
+        ctx->lnoise->span_3d(m, sx, sy, sz, noise, shuffle_table);                                                                    \
+        for (k = 0; k < m; k++)                                                                                                       \
+        {                                                                                                                             \
+          value = acc[k];                                                                                                             \
+          tmp = noise[k];                                                                                                             \
+          VALUE_CALC;                                                                                                                 \
+          acc[k] = value;                                                                                                             \
+        }                                                                                                                             \
+      }                                                                                                                               \
+                                                                                                                                      \
+      for (k = 0; k < m; k++)                                                                                                         \
+      {                                                                                                                               \
+        value = acc[k];                                                                                                               \
+        out[j + k] = RETURN;                                                                                                          \
+      }                                                                                                                               \
+    }                                                                                                                                 \
+  }
+
+#define LSPAN4D(NAME, INIT_VALUE, VALUE_CALC, RETURN)                                                                                                  \
+  static void NAME##_Span(const BasisContext* ctx, void* data, int n, const double* x, const double* y, const double* z, const double* t, double* out) \
+  {                                                                                                                                                    \
+    int i = 0, j = 0, k = 0, m = 0;                                                                                                                    \
+    double value = NAN;                                                                                                                                \
+    double tmp = NAN;                                                                                                                                  \
+    double sx[LN_CHUNK] = {NAN}, sy[LN_CHUNK] = {NAN}, sz[LN_CHUNK] = {NAN}, st[LN_CHUNK] = {NAN};                                                     \
+    double noise[LN_CHUNK] = {NAN}, acc[LN_CHUNK] = {NAN};                                                                                             \
+    const int octaves = ctx->octaves;                                                                                                                  \
+    const double* octave_scale = ctx->octave_scale;                                                                                                    \
+    const double* octave_shift = ctx->octave_shift;                                                                                                    \
+    const double* weight = ctx->weight;                                                                                                                \
+    guint16* shuffle_table = ctx->shuffle_table;                                                                                                       \
+                                                                                                                                                       \
+    for (j = 0; j < n; j += LN_CHUNK)                                                                                                                  \
+    {                                                                                                                                                  \
+      m = MIN(LN_CHUNK, n - j);                                                                                                                        \
+      for (k = 0; k < m; k++)                                                                                                                          \
+      {                                                                                                                                                \
+        acc[k] = INIT_VALUE;                                                                                                                           \
+      }                                                                                                                                                \
+                                                                                                                                                       \
+      for (i = 0; i < octaves; i++)                                                                                                                    \
+      {                                                                                                                                                \
+        for (k = 0; k < m; k++)                                                                                                                        \
+        {                                                                                                                                              \
+          sx[k] = x[j + k] * octave_scale[i] + octave_shift[i];                                                                                        \
+          sy[k] = y[j + k] * octave_scale[i] + octave_shift[i];                                                                                        \
+          sz[k] = z[j + k] * octave_scale[i] + octave_shift[i];                                                                                        \
+          st[k] = t[j + k] * octave_scale[i] + octave_shift[i];                                                                                        \
+        }                                                                                                                                              \
+        ctx->lnoise->span_4d(m, sx, sy, sz, st, noise, shuffle_table);                                                                                 \
+        for (k = 0; k < m; k++)                                                                                                                        \
+        {                                                                                                                                              \
+          value = acc[k];                                                                                                                              \
+          tmp = noise[k];                                                                                                                              \
+          VALUE_CALC;                                                                                                                                  \
+          acc[k] = value;                                                                                                                              \
+        }                                                                                                                                              \
+      }                                                                                                                                                \
+                                                                                                                                                       \
+      for (k = 0; k < m; k++)                                                                                                                          \
+      {                                                                                                                                                \
+        value = acc[k];                                                                                                                                \
+        out[j + k] = RETURN;                                                                                                                           \
+      }                                                                                                                                                \
+    }                                                                                                                                                  \
+  }
+
+#define LSPAN5D(NAME, INIT_VALUE, VALUE_CALC, RETURN)                                                                                                                   \
+  static void NAME##_Span(const BasisContext* ctx, void* data, int n, const double* x, const double* y, const double* z, const double* s, const double* t, double* out) \
+  {                                                                                                                                                                     \
+    int i = 0, j = 0, k = 0, m = 0;                                                                                                                                     \
+    double value = NAN;                                                                                                                                                 \
+    double tmp = NAN;                                                                                                                                                   \
+    double sx[LN_CHUNK] = {NAN}, sy[LN_CHUNK] = {NAN}, sz[LN_CHUNK] = {NAN}, ss[LN_CHUNK] = {NAN}, st[LN_CHUNK] = {NAN};                                                \
+    double noise[LN_CHUNK] = {NAN}, acc[LN_CHUNK] = {NAN};                                                                                                              \
+    const int octaves = ctx->octaves;                                                                                                                                   \
+    const double* octave_scale = ctx->octave_scale;                                                                                                                     \
+    const double* octave_shift = ctx->octave_shift;                                                                                                                     \
+    const double* weight = ctx->weight;                                                                                                                                 \
+    guint16* shuffle_table = ctx->shuffle_table;                                                                                                                        \
+                                                                                                                                                                        \
+    for (j = 0; j < n; j += LN_CHUNK)                                                                                                                                   \
+    {                                                                                                                                                                   \
+      m = MIN(LN_CHUNK, n - j);                                                                                                                                         \
+      for (k = 0; k < m; k++)                                                                                                                                           \
+      {                                                                                                                                                                 \
+        acc[k] = INIT_VALUE;                                                                                                                                            \
+      }                                                                                                                                                                 \
+                                                                                                                                                                        \
+      for (i = 0; i < octaves; i++)                                                                                                                                     \
+      {                                                                                                                                                                 \
+        for (k = 0; k < m; k++)                                                                                                                                         \
+        {                                                                                                                                                               \
+          sx[k] = x[j + k] * octave_scale[i] + octave_shift[i];                                                                                                         \
+          sy[k] = y[j + k] * octave_scale[i] + octave_shift[i];                                                                                                         \
+          sz[k] = z[j + k] * octave_scale[i] + octave_shift[i];                                                                                                         \
+          ss[k] = s[j + k] * octave_scale[i] + octave_shift[i];                                                                                                         \
+          st[k] = t[j + k] * octave_scale[i] + octave_shift[i];                                                                                                         \
+        }                                                                                                                                                               \
+        ctx->lnoise->span_5d(m, sx, sy, sz, ss, st, noise, shuffle_table);                                                                                              \
+        for (k = 0; k < m; k++)                                                                                                                                         \
+        {                                                                                                                                                               \
+          value = acc[k];                                                                                                                                               \
+          tmp = noise[k];                                                                                                                                               \
+          VALUE_CALC;                                                                                                                                                   \
+          acc[k] = value;                                                                                                                                               \
+        }                                                                                                                                                               \
+      }                                                                                                                                                                 \
+                                                                                                                                                                        \
+      for (k = 0; k < m; k++)                                                                                                                                           \
+      {                                                                                                                                                                 \
+        value = acc[k];                                                                                                                                                 \
+        out[j + k] = RETURN;                                                                                                                                            \
+      }                                                                                                                                                                 \
+    }                                                                                                                                                                   \
+  }
+
+#define LATTICE3D(NAME, POST_CALC, CALC_FBM, CALC_MF1, CALC_MF2, RETURN_FBM)                                                                         \
+  BASE3D(NAME##_FBM, double tmp = NAN; value = 0;, tmp = LNoise3D(PARAM_3D, shuffle_table); POST_CALC CALC_FBM;, RETURN_FBM)                         \
+  LSPAN3D(NAME##_FBM, 0, POST_CALC CALC_FBM, RETURN_FBM)                                                                                             \
+  BASE3D(NAME##_MF1, double tmp = NAN; value = 1;, tmp = LNoise3D(PARAM_3D, shuffle_table); POST_CALC CALC_MF1;, pow(value, ctx->exponent) - 0.5)    \
+  LSPAN3D(NAME##_MF1, 1, POST_CALC CALC_MF1, pow(value, ctx->exponent) - 0.5)                                                                        \
+  BASE3D(NAME##_MF2, double tmp = NAN; value = 1;, tmp = LNoise3D(PARAM_3D, shuffle_table); POST_CALC CALC_MF2;, -(pow(value, ctx->exponent) - 0.5)) \
+  LSPAN3D(NAME##_MF2, 1, POST_CALC CALC_MF2, -(pow(value, ctx->exponent) - 0.5))
+
+#define LATTICE4D(NAME, POST_CALC, CALC_FBM, CALC_MF1, CALC_MF2, RETURN_FBM)                                                                         \
+  BASE4D(NAME##_FBM, double tmp = NAN; value = 0;, tmp = LNoise4D(PARAM_4D, shuffle_table); POST_CALC CALC_FBM;, RETURN_FBM)                         \
+  LSPAN4D(NAME##_FBM, 0, POST_CALC CALC_FBM, RETURN_FBM)                                                                                             \
+  BASE4D(NAME##_MF1, double tmp = NAN; value = 1;, tmp = LNoise4D(PARAM_4D, shuffle_table); POST_CALC CALC_MF1;, pow(value, ctx->exponent) - 0.5)    \
+  LSPAN4D(NAME##_MF1, 1, POST_CALC CALC_MF1, pow(value, ctx->exponent) - 0.5)                                                                        \
+  BASE4D(NAME##_MF2, double tmp = NAN; value = 1;, tmp = LNoise4D(PARAM_4D, shuffle_table); POST_CALC CALC_MF2;, -(pow(value, ctx->exponent) - 0.5)) \
+  LSPAN4D(NAME##_MF2, 1, POST_CALC CALC_MF2, -(pow(value, ctx->exponent) - 0.5))
+
+#define LATTICE5D(NAME, POST_CALC, CALC_FBM, CALC_MF1, CALC_MF2, RETURN_FBM)                                                                         \
+  BASE5D(NAME##_FBM, double tmp = NAN; value = 0;, tmp = LNoise5D(PARAM_5D, shuffle_table); POST_CALC CALC_FBM;, RETURN_FBM)                         \
+  LSPAN5D(NAME##_FBM, 0, POST_CALC CALC_FBM, RETURN_FBM)                                                                                             \
+  BASE5D(NAME##_MF1, double tmp = NAN; value = 1;, tmp = LNoise5D(PARAM_5D, shuffle_table); POST_CALC CALC_MF1;, pow(value, ctx->exponent) - 0.5)    \
+  LSPAN5D(NAME##_MF1, 1, POST_CALC CALC_MF1, pow(value, ctx->exponent) - 0.5)                                                                        \
+  BASE5D(NAME##_MF2, double tmp = NAN; value = 1;, tmp = LNoise5D(PARAM_5D, shuffle_table); POST_CALC CALC_MF2;, -(pow(value, ctx->exponent) - 0.5)) \
+  LSPAN5D(NAME##_MF2, 1, POST_CALC CALC_MF2, -(pow(value, ctx->exponent) - 0.5))
+
+
+LATTICE3D(LatticeNoise3D, /* no post-processing */, value += tmp * weight[i],
+          value *= MULTI_MIX_1(tmp, weight[i], LN_3D_MID, LN_3D_FAC),
+          value *= MULTI_MIX_2(tmp, weight[i], LN_3D_MID, LN_3D_FAC),
+          OUTPUT(value, LN_3D_MID, LN_3D_FAC))
+
+LATTICE3D(LatticeTurb3D_1, tmp -= LN_3D_MID; if (tmp < 0) tmp = -tmp;, value += tmp * weight[i],
+          value *= TURB_MIX_1(tmp, weight[i], LN_3D_MID, LN_3D_FAC),
+          value *= TURB_MIX_2(tmp, weight[i], LN_3D_MID, LN_3D_FAC),
+          value * (LN_3D_FAC * 2.0) - 0.5)
+
+/**/
+
+LATTICE4D(LatticeNoise4D, /* no post-processing */, value += tmp * weight[i],
+          value *= MULTI_MIX_1(tmp, weight[i], LN_4D_MID, LN_4D_FAC),
+          value *= MULTI_MIX_2(tmp, weight[i], LN_4D_MID, LN_4D_FAC),
+          OUTPUT(value, LN_4D_MID, LN_4D_FAC))
+
+LATTICE4D(LatticeTurb4D_1, tmp -= LN_4D_MID; if (tmp < 0) tmp = -tmp;, value += tmp * weight[i],
+          value *= TURB_MIX_1(tmp, weight[i], LN_4D_MID, LN_4D_FAC),
+          value *= TURB_MIX_2(tmp, weight[i], LN_4D_MID, LN_4D_FAC),
+          value * (LN_4D_FAC * 2.0) - 0.5)
 
-TURB3D(LatticeTurb3D_1, /* no extra vars */, tmp = LNoise3D(PARAM_3D, (guint16*)data), value += tmp * weight[i];,
-                                                                                                                value *= TURB_MIX_1(tmp, weight[i], LN_3D_MID, LN_3D_FAC),
-                                                                                                                value *= TURB_MIX_2(tmp, weight[i], LN_3D_MID, LN_3D_FAC),
-                                                                                                                LN_3D_MID,
-                                                                                                                LN_3D_FAC)
+/**/
+
+LATTICE5D(LatticeNoise5D, /* no post-processing */, value += tmp * weight[i],
+          value *= MULTI_MIX_1(tmp, weight[i], LN_5D_MID, LN_5D_FAC),
+          value *= MULTI_MIX_2(tmp, weight[i], LN_5D_MID, LN_5D_FAC),
+          OUTPUT(value, LN_5D_MID, LN_5D_FAC))
+
+LATTICE5D(LatticeTurb5D_1, tmp -= LN_5D_MID; if (tmp < 0) tmp = -tmp;, value += tmp * weight[i],
+          value *= MULTI_MIX_1(tmp, weight[i], LN_5D_MID, LN_5D_FAC),
+          value *= MULTI_MIX_2(tmp, weight[i], LN_5D_MID, LN_5D_FAC),
+          value * (LN_5D_FAC * 2.0) - 0.5)
+
+/****** Simplex noise *******/
+
+/* The noise value is in 'tmp' for the calculations. The spans loop over the
+ * scalar function */
+
+#define SIMPLEX3D(NAME, POST_CALC, CALC_FBM, CALC_MF1, CALC_MF2, RETURN_FBM)                                                                          \
+  BASE3D(NAME##_FBM, double tmp = NAN; value = 0;, tmp = Simplex3D(PARAM_3D, shuffle_table); POST_CALC CALC_FBM;, RETURN_FBM)                         \
+  SPAN3D(NAME##_FBM)                                                                                                                                  \
+  BASE3D(NAME##_MF1, double tmp = NAN; value = 1;, tmp = Simplex3D(PARAM_3D, shuffle_table); POST_CALC CALC_MF1;, pow(value, ctx->exponent) - 0.5)    \
+  SPAN3D(NAME##_MF1)                                                                                                                                  \
+  BASE3D(NAME##_MF2, double tmp = NAN; value = 1;, tmp = Simplex3D(PARAM_3D, shuffle_table); POST_CALC CALC_MF2;, -(pow(value, ctx->exponent) - 0.5)) \
+  SPAN3D(NAME##_MF2)
+
+#define SIMPLEX4D(NAME, POST_CALC, CALC_FBM, CALC_MF1, CALC_MF2, RETURN_FBM)                                                                          \
+  BASE4D(NAME##_FBM, double tmp = NAN; value = 0;, tmp = Simplex4D(PARAM_4D, shuffle_table); POST_CALC CALC_FBM;, RETURN_FBM)                         \
+  SPAN4D(NAME##_FBM)                                                                                                                                  \
+  BASE4D(NAME##_MF1, double tmp = NAN; value = 1;, tmp = Simplex4D(PARAM_4D, shuffle_table); POST_CALC CALC_MF1;, pow(value, ctx->exponent) - 0.5)    \
+  SPAN4D(NAME##_MF1)                                                                                                                                  \
+  BASE4D(NAME##_MF2, double tmp = NAN; value = 1;, tmp = Simplex4D(PARAM_4D, shuffle_table); POST_CALC CALC_MF2;, -(pow(value, ctx->exponent) - 0.5)) \
+  SPAN4D(NAME##_MF2)
+
+#define SIMPLEX5D(NAME, POST_CALC, CALC_FBM, CALC_MF1, CALC_MF2, RETURN_FBM)                                                                          \
+  BASE5D(NAME##_FBM, double tmp = NAN; value = 0;, tmp = Simplex5D(PARAM_5D, shuffle_table); POST_CALC CALC_FBM;, RETURN_FBM)                         \
+  SPAN5D(NAME##_FBM)                                                                                                                                  \
+  BASE5D(NAME##_MF1, double tmp = NAN; value = 1;, tmp = Simplex5D(PARAM_5D, shuffle_table); POST_CALC CALC_MF1;, pow(value, ctx->exponent) - 0.5)    \
+  SPAN5D(NAME##_MF1)                                                                                                                                  \
+  BASE5D(NAME##_MF2, double tmp = NAN; value = 1;, tmp = Simplex5D(PARAM_5D, shuffle_table); POST_CALC CALC_MF2;, -(pow(value, ctx->exponent) - 0.5)) \
+  SPAN5D(NAME##_MF2)
+
+SIMPLEX3D(SimplexNoise3D, /* no post-processing */, value += tmp * weight[i],
+          value *= MULTI_MIX_1(tmp, weight[i], SX_3D_MID, SX_3D_FAC),
+          value *= MULTI_MIX_2(tmp, weight[i], SX_3D_MID, SX_3D_FAC),
+          OUTPUT(value, SX_3D_MID, SX_3D_FAC))
+
+SIMPLEX3D(SimplexTurb3D_1, tmp -= SX_3D_MID; if (tmp < 0) tmp = -tmp;, value += tmp * weight[i],
+          value *= TURB_MIX_1(tmp, weight[i], SX_3D_MID, SX_3D_FAC),
+          value *= TURB_MIX_2(tmp, weight[i], SX_3D_MID, SX_3D_FAC),
+          value * (SX_3D_FAC * 2.0) - 0.5)
 
 /**/
 
-FUNC4D(LatticeNoise4D, /* no extra vars */, /* No common calculations */, value += LNoise4D(PARAM_4D, (guint16*)data) * weight[i], value *= MULTI_MIX_1(LNoise4D(PARAM_4D, (guint16*)data), weight[i], LN_4D_MID, LN_4D_FAC), value *= MULTI_MIX_2(LNoise4D(PARAM_4D, (guint16*)data), weight[i], LN_4D_MID, LN_4D_FAC), LN_4D_MID, LN_4D_FAC)
+SIMPLEX4D(SimplexNoise4D, /* no post-processing */, value += tmp * weight[i],
+          value *= MULTI_MIX_1(tmp, weight[i], SX_4D_MID, SX_4D_FAC),
+          value *= MULTI_MIX_2(tmp, weight[i], SX_4D_MID, SX_4D_FAC),
+          OUTPUT(value, SX_4D_MID, SX_4D_FAC))
 
-TURB4D(LatticeTurb4D_1, /* no extra vars */, tmp = LNoise4D(PARAM_4D, (guint16*)data), value += tmp * weight[i];,
-                                                                                                                value *= TURB_MIX_1(tmp, weight[i], LN_4D_MID, LN_4D_FAC),
-                                                                                                                value *= TURB_MIX_2(tmp, weight[i], LN_4D_MID, LN_4D_FAC),
-                                                                                                                LN_4D_MID,
-                                                                                                                LN_4D_FAC)
+SIMPLEX4D(SimplexTurb4D_1, tmp -= SX_4D_MID; if (tmp < 0) tmp = -tmp;, value += tmp * weight[i],
+          value *= TURB_MIX_1(tmp, weight[i], SX_4D_MID, SX_4D_FAC),
+          value *= TURB_MIX_2(tmp, weight[i], SX_4D_MID, SX_4D_FAC),
+          value * (SX_4D_FAC * 2.0) - 0.5)
 
 /**/
 
-FUNC5D(LatticeNoise5D, /* no extra vars */, /* No common calculations */, value += LNoise5D(PARAM_5D, (guint16*)data) * weight[i], value *= MULTI_MIX_1(LNoise5D(PARAM_5D, (guint16*)data), weight[i], LN_5D_MID, LN_5D_FAC), value *= MULTI_MIX_2(LNoise5D(PARAM_5D, (guint16*)data), weight[i], LN_5D_MID, LN_5D_FAC), LN_5D_MID, LN_5D_FAC)
+SIMPLEX5D(SimplexNoise5D, /* no post-processing */, value += tmp * weight[i],
+          value *= MULTI_MIX_1(tmp, weight[i], SX_5D_MID, SX_5D_FAC),
+          value *= MULTI_MIX_2(tmp, weight[i], SX_5D_MID, SX_5D_FAC),
+          OUTPUT(value, SX_5D_MID, SX_5D_FAC))
 
-TURB5D(LatticeTurb5D_1, /* no extra vars */, tmp = LNoise5D(PARAM_5D, (guint16*)data), value += tmp * weight[i];,
-                                                                                                                value *= MULTI_MIX_1(tmp, weight[i], LN_5D_MID, LN_5D_FAC),
-                                                                                                                value *= MULTI_MIX_2(tmp, weight[i], LN_5D_MID, LN_5D_FAC),
-                                                                                                                LN_5D_MID,
-                                                                                                                LN_5D_FAC)
+SIMPLEX5D(SimplexTurb5D_1, tmp -= SX_5D_MID; if (tmp < 0) tmp = -tmp;, value += tmp * weight[i],
+          value *= TURB_MIX_1(tmp, weight[i], SX_5D_MID, SX_5D_FAC),
+          value *= TURB_MIX_2(tmp, weight[i], SX_5D_MID, SX_5D_FAC),
+          value * (SX_5D_FAC * 2.0) - 0.5)
 
 /****** CELL 1 (Skin) *******/
 
 FUNC3D(Cell3D_1,
-       double f[3] = {NAN};
-       double delta[3][3] = {NAN};
-       int id[3] = {0};
+       double f[2] = {NAN};
        ,                                                            /* extra vars */
-       Cells3D(PARAM_3D, 2, f, delta, id, (CellBasisCache3D*)data), /* common calculation */
+       Cells3D_F2(PARAM_3D, f, (const CellFeatures3D*)data, shuffle_table), /* common calculation */
        value += (f[1] - f[0]) * weight[i],
        value *= MULTI_MIX_1(f[1] - f[0], weight[i], CELL1_3D_MID, CELL1_3D_FAC),
        value *= MULTI_MIX_2(f[1] - f[0], weight[i], CELL1_3D_MID, CELL1_3D_FAC),
@@ -384,11 +845,9 @@ FUNC3D(Cell3D_1,
 
 /**/
 FUNC4D(Cell4D_1,
-       double f[3] = {NAN};
-       double delta[3][4] = {NAN};
-       int id[3] = {0};
+       double f[2] = {NAN};
        ,                                                            /* extra vars */
-       Cells4D(PARAM_4D, 2, f, delta, id, (CellBasisCache4D*)data), /* common calculation */
+       Cells4D_F2(PARAM_4D, f, (const CellFeatures4D*)data, shuffle_table), /* common calculation */
        value += (f[1] - f[0]) * weight[i],
        value *= MULTI_MIX_1(f[1] - f[0], weight[i], CELL1_4D_MID, CELL1_4D_FAC),
        value *= MULTI_MIX_2(f[1] - f[0], weight[i], CELL1_4D_MID, CELL1_4D_FAC),
@@ -397,11 +856,9 @@ FUNC4D(Cell4D_1,
 
 /**/
 FUNC5D(Cell5D_1,
-       double f[3] = {NAN};
-       double delta[3][5] = {NAN};
-       int id[3] = {0};
+       double f[2] = {NAN};
        ,                                                            /* extra vars */
-       Cells5D(PARAM_5D, 2, f, delta, id, (CellBasisCache5D*)data), /* common calculation */
+       Cells5D_F2(PARAM_5D, f, (const CellFeatures5D*)data, shuffle_table), /* common calculation */
        value += (f[1] - f[0]) * weight[i],
        value *= MULTI_MIX_1(f[1] - f[0], weight[i], CELL1_5D_MID, CELL1_5D_FAC),
        value *= MULTI_MIX_2(f[1] - f[0], weight[i], CELL1_5D_MID, CELL1_5D_FAC),
@@ -412,40 +869,34 @@ FUNC5D(Cell5D_1,
 
 /**/
 FUNC3D(Cell3D_2,
-       double f[3] = {NAN};
-       double delta[3][3] = {NAN};
-       int id[3] = {0};
+       double f1 = NAN;
        ,                                                            /* extra vars */
-       Cells3D(PARAM_3D, 2, f, delta, id, (CellBasisCache3D*)data), /* common calculation */
-       value += f[0] * weight[i],
-       value *= MULTI_MIX_1(f[0], weight[i], CELL2_3D_MID, CELL2_3D_FAC),
-       value *= MULTI_MIX_2(f[0], weight[i], CELL2_3D_MID, CELL2_3D_FAC),
+       f1 = Cells3D_F1(PARAM_3D, (const CellFeatures3D*)data, shuffle_table), /* common calculation */
+       value += f1 * weight[i],
+       value *= MULTI_MIX_1(f1, weight[i], CELL2_3D_MID, CELL2_3D_FAC),
+       value *= MULTI_MIX_2(f1, weight[i], CELL2_3D_MID, CELL2_3D_FAC),
        CELL2_3D_MID,
        CELL2_3D_FAC)
 
 /**/
 FUNC4D(Cell4D_2,
-       double f[3] = {NAN};
-       double delta[3][4] = {NAN};
-       int id[3] = {0};
+       double f1 = NAN;
        ,                                                            /* extra vars */
-       Cells4D(PARAM_4D, 2, f, delta, id, (CellBasisCache4D*)data), /* common calculation */
-       value += f[0] * weight[i],
-       value *= MULTI_MIX_1(f[0], weight[i], CELL2_4D_MID, CELL2_4D_FAC),
-       value *= MULTI_MIX_2(f[0], weight[i], CELL2_4D_MID, CELL2_4D_FAC),
+       f1 = Cells4D_F1(PARAM_4D, (const CellFeatures4D*)data, shuffle_table), /* common calculation */
+       value += f1 * weight[i],
+       value *= MULTI_MIX_1(f1, weight[i], CELL2_4D_MID, CELL2_4D_FAC),
+       value *= MULTI_MIX_2(f1, weight[i], CELL2_4D_MID, CELL2_4D_FAC),
        CELL2_4D_MID,
        CELL2_4D_FAC)
 
 /**/
 FUNC5D(Cell5D_2,
-       double f[3] = {NAN};
-       double delta[3][5] = {NAN};
-       int id[3] = {0};
+       double f1 = NAN;
        ,                                                            /* extra vars */
-       Cells5D(PARAM_5D, 2, f, delta, id, (CellBasisCache5D*)data), /* common calculation */
-       value += f[0] * weight[i],
-       value *= MULTI_MIX_1(f[0], weight[i], CELL2_5D_MID, CELL2_5D_FAC),
-       value *= MULTI_MIX_2(f[0], weight[i], CELL2_5D_MID, CELL2_5D_FAC),
+       f1 = Cells5D_F1(PARAM_5D, (const CellFeatures5D*)data, shuffle_table), /* common calculation */
+       value += f1 * weight[i],
+       value *= MULTI_MIX_1(f1, weight[i], CELL2_5D_MID, CELL2_5D_FAC),
+       value *= MULTI_MIX_2(f1, weight[i], CELL2_5D_MID, CELL2_5D_FAC),
        CELL2_5D_MID,
        CELL2_5D_FAC)
 
@@ -453,11 +904,9 @@ FUNC5D(Cell5D_2,
 
 /**/
 FUNC3D(Cell3D_3,
-       double f[3] = {NAN};
-       double delta[3][3] = {NAN};
-       int id[3] = {0};
+       double f[2] = {NAN};
        ,                                                            /* extra vars */
-       Cells3D(PARAM_3D, 2, f, delta, id, (CellBasisCache3D*)data), /* common calculation */
+       Cells3D_F2(PARAM_3D, f, (const CellFeatures3D*)data, shuffle_table), /* common calculation */
        value += f[1] * weight[i],
        value *= MULTI_MIX_1(f[1], weight[i], CELL3_3D_MID, CELL3_3D_FAC),
        value *= MULTI_MIX_2(f[1], weight[i], CELL3_3D_MID, CELL3_3D_FAC),
@@ -466,11 +915,9 @@ FUNC3D(Cell3D_3,
 
 /**/
 FUNC4D(Cell4D_3,
-       double f[3] = {NAN};
-       double delta[3][4] = {NAN};
-       int id[3] = {0};
+       double f[2] = {NAN};
        ,                                                            /* extra vars */
-       Cells4D(PARAM_4D, 2, f, delta, id, (CellBasisCache4D*)data), /* common calculation */
+       Cells4D_F2(PARAM_4D, f, (const CellFeatures4D*)data, shuffle_table), /* common calculation */
        value += f[1] * weight[i],
        value *= MULTI_MIX_1(f[1], weight[i], CELL3_4D_MID, CELL3_4D_FAC),
        value *= MULTI_MIX_2(f[1], weight[i], CELL3_4D_MID, CELL3_4D_FAC),
@@ -479,11 +926,9 @@ FUNC4D(Cell4D_3,
 
 /**/
 FUNC5D(Cell5D_3,
-       double f[3] = {NAN};
-       double delta[3][5] = {NAN};
-       int id[3] = {0};
+       double f[2] = {NAN};
        ,                                                            /* extra vars */
-       Cells5D(PARAM_5D, 2, f, delta, id, (CellBasisCache5D*)data), /* common calculation */
+       Cells5D_F2(PARAM_5D, f, (const CellFeatures5D*)data, shuffle_table), /* common calculation */
        value += f[1] * weight[i],
        value *= MULTI_MIX_1(f[1], weight[i], CELL3_5D_MID, CELL3_5D_FAC),
        value *= MULTI_MIX_2(f[1], weight[i], CELL3_5D_MID, CELL3_5D_FAC),
@@ -494,40 +939,34 @@ FUNC5D(Cell5D_3,
 
 /**/
 FUNC3D(Cell3D_4,
-       double f[3] = {NAN};
-       double delta[3][3] = {NAN};
-       int id[3] = {0};
+       guint32 id = 0;
        ,                                                            /* extra vars */
-       Cells3D(PARAM_3D, 2, f, delta, id, (CellBasisCache3D*)data), /* common calculation */
-       value += (Hash1(id[0]) * (1.0 / (TABLE_SIZE - 1))) * weight[i],
-       value *= MULTI_MIX_1(Hash1(id[0]) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_3D_MID, CELL4_3D_FAC),
-       value *= MULTI_MIX_2(Hash1(id[0]) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_3D_MID, CELL4_3D_FAC),
+       id = Cells3D_Id(PARAM_3D, (const CellFeatures3D*)data, shuffle_table), /* common calculation */
+       value += (Hash1(id) * (1.0 / (TABLE_SIZE - 1))) * weight[i],
+       value *= MULTI_MIX_1(Hash1(id) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_3D_MID, CELL4_3D_FAC),
+       value *= MULTI_MIX_2(Hash1(id) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_3D_MID, CELL4_3D_FAC),
        CELL4_3D_MID,
        CELL4_3D_FAC)
 
 /**/
 FUNC4D(Cell4D_4,
-       double f[3] = {NAN};
-       double delta[3][4] = {NAN};
-       int id[3] = {0};
+       guint32 id = 0;
        ,                                                            /* extra vars */
-       Cells4D(PARAM_4D, 2, f, delta, id, (CellBasisCache4D*)data), /* common calculation */
-       value += (Hash1(id[0]) * (1.0 / (TABLE_SIZE - 1))) * weight[i],
-       value *= MULTI_MIX_1(Hash1(id[0]) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_4D_MID, CELL4_4D_FAC),
-       value *= MULTI_MIX_2(Hash1(id[0]) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_4D_MID, CELL4_4D_FAC),
+       id = Cells4D_Id(PARAM_4D, (const CellFeatures4D*)data, shuffle_table), /* common calculation */
+       value += (Hash1(id) * (1.0 / (TABLE_SIZE - 1))) * weight[i],
+       value *= MULTI_MIX_1(Hash1(id) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_4D_MID, CELL4_4D_FAC),
+       value *= MULTI_MIX_2(Hash1(id) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_4D_MID, CELL4_4D_FAC),
        CELL4_4D_MID,
        CELL4_4D_FAC)
 
 /**/
 FUNC5D(Cell5D_4,
-       double f[3] = {NAN};
-       double delta[3][5] = {NAN};
-       int id[3] = {0};
+       guint32 id = 0;
        ,                                                            /* extra vars */
-       Cells5D(PARAM_5D, 2, f, delta, id, (CellBasisCache5D*)data), /* common calculation */
-       value += (Hash1(id[0]) * (1.0 / (TABLE_SIZE - 1))) * weight[i],
-       value *= MULTI_MIX_1(Hash1(id[0]) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_5D_MID, CELL4_5D_FAC),
-       value *= MULTI_MIX_2(Hash1(id[0]) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_5D_MID, CELL4_5D_FAC),
+       id = Cells5D_Id(PARAM_5D, (const CellFeatures5D*)data, shuffle_table), /* common calculation */
+       value += (Hash1(id) * (1.0 / (TABLE_SIZE - 1))) * weight[i],
+       value *= MULTI_MIX_1(Hash1(id) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_5D_MID, CELL4_5D_FAC),
+       value *= MULTI_MIX_2(Hash1(id) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_5D_MID, CELL4_5D_FAC),
        CELL4_5D_MID,
        CELL4_5D_FAC)
 
@@ -535,20 +974,19 @@ FUNC5D(Cell5D_4,
 
 /**/
 FUNC3D(Cell3D_5,
-       double f[3] = {NAN};
-       double delta[3][3] = {NAN};
-       int id[3] = {0};
+       double delta[3] = {NAN};
+       guint32 id = 0;
        double v[3] = {NAN};
        double n = NAN;
        , /* extra vars */
-       Cells3D(PARAM_3D, 1, f, delta, id, (CellBasisCache3D*)data);
-       v[0] = (Hash1(id[0]) - ((TABLE_SIZE - 1) * 0.5));
-       v[1] = (Hash1(id[0] + 1) - ((TABLE_SIZE - 1) * 0.5));
-       v[2] = (Hash1(id[0] + 2) - ((TABLE_SIZE - 1) * 0.5));
+       id = Cells3D_Delta(PARAM_3D, delta, (const CellFeatures3D*)data, shuffle_table);
+       v[0] = (Hash1(id) - ((TABLE_SIZE - 1) * 0.5));
+       v[1] = (Hash1(id + 1) - ((TABLE_SIZE - 1) * 0.5));
+       v[2] = (Hash1(id + 2) - ((TABLE_SIZE - 1) * 0.5));
        n = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
        /* we'll incorporate the factor here, and avoid a multiply later on */
        if (n < -0.001 || n > 0.001) n = CELL5_3D_FAC / n;
-       v[0] = ((delta[0][0] * v[0] + delta[0][1] * v[1] + delta[0][2] * v[2]) * n);
+       v[0] = ((delta[0] * v[0] + delta[1] * v[1] + delta[2] * v[2]) * n);
        NO_CAL(if (v[0] < -0.5) v[0] = -0.5; if (v[0] > 0.5) v[0] = 0.5;), /* common calculation */
        value += v[0] * weight[i],
        value *= MULTI_MIX_1(v[0], weight[i], 0.0, 1.0),
@@ -558,21 +996,20 @@ FUNC3D(Cell3D_5,
 
 /**/
 FUNC4D(Cell4D_5,
-       double f[3] = {NAN};
-       double delta[3][4] = {NAN};
-       int id[3] = {0};
+       double delta[4] = {NAN};
+       guint32 id = 0;
        double v[4] = {NAN};
        double n = NAN;
        , /* extra vars */
-       Cells4D(PARAM_4D, 1, f, delta, id, (CellBasisCache4D*)data);
-       v[0] = (Hash1(id[0]) - ((TABLE_SIZE - 1) * 0.5));
-       v[1] = (Hash1(id[0] + 1) - ((TABLE_SIZE - 1) * 0.5));
-       v[2] = (Hash1(id[0] + 2) - ((TABLE_SIZE - 1) * 0.5));
-       v[3] = (Hash1(id[0] + 3) - ((TABLE_SIZE - 1) * 0.5));
+       id = Cells4D_Delta(PARAM_4D, delta, (const CellFeatures4D*)data, shuffle_table);
+       v[0] = (Hash1(id) - ((TABLE_SIZE - 1) * 0.5));
+       v[1] = (Hash1(id + 1) - ((TABLE_SIZE - 1) * 0.5));
+       v[2] = (Hash1(id + 2) - ((TABLE_SIZE - 1) * 0.5));
+       v[3] = (Hash1(id + 3) - ((TABLE_SIZE - 1) * 0.5));
        n = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2] + v[3] * v[3]);
        /* we'll incorporate the factor here, and avoid a multiply later on */
        if (n < -0.001 || n > 0.001) n = CELL5_4D_FAC / n;
-       v[0] = ((delta[0][0] * v[0] + delta[0][1] * v[1] + delta[0][2] * v[2] + delta[0][3] * v[3]) * n);
+       v[0] = ((delta[0] * v[0] + delta[1] * v[1] + delta[2] * v[2] + delta[3] * v[3]) * n);
        NO_CAL(if (v[0] < -0.5) v[0] = -0.5; if (v[0] > 0.5) v[0] = 0.5;), /* common calculation */
        value += v[0] * weight[i],
        value *= MULTI_MIX_1(v[0], weight[i], 0.0, 1.0),
@@ -582,22 +1019,236 @@ FUNC4D(Cell4D_5,
 
 /**/
 FUNC5D(Cell5D_5,
-       double f[3] = {NAN};
-       double delta[3][5] = {NAN};
-       int id[3] = {0};
+       double delta[5] = {NAN};
+       guint32 id = 0;
        double v[5] = {NAN};
        double n = NAN;
        , /* extra vars */
-       Cells5D(PARAM_5D, 1, f, delta, id, (CellBasisCache5D*)data);
-       v[0] = (Hash1(id[0]) - ((TABLE_SIZE - 1) * 0.5));
-       v[1] = (Hash1(id[0] + 1) - ((TABLE_SIZE - 1) * 0.5));
-       v[2] = (Hash1(id[0] + 2) - ((TABLE_SIZE - 1) * 0.5));
-       v[3] = (Hash1(id[0] + 3) - ((TABLE_SIZE - 1) * 0.5));
-       v[4] = (Hash1(id[0] + 4) - ((TABLE_SIZE - 1) * 0.5));
+       id = Cells5D_Delta(PARAM_5D, delta, (const CellFeatures5D*)data, shuffle_table);
+       v[0] = (Hash1(id) - ((TABLE_SIZE - 1) * 0.5));
+       v[1] = (Hash1(id + 1) - ((TABLE_SIZE - 1) * 0.5));
+       v[2] = (Hash1(id + 2) - ((TABLE_SIZE - 1) * 0.5));
+       v[3] = (Hash1(id + 3) - ((TABLE_SIZE - 1) * 0.5));
+       v[4] = (Hash1(id + 4) - ((TABLE_SIZE - 1) * 0.5));
        n = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2] + v[3] * v[3] + v[4] * v[4]);
        /* we'll incorporate the factor here, and avoid a multiply later on */
        if (n < -0.001 || n > 0.001) n = CELL5_5D_FAC / n;
-       v[0] = ((delta[0][0] * v[0] + delta[0][1] * v[1] + delta[0][2] * v[2] + delta[0][3] * v[3] + delta[0][4] * v[4]) * n);
+       v[0] = ((delta[0] * v[0] + delta[1] * v[1] + delta[2] * v[2] + delta[3] * v[3] + delta[4] * v[4]) * n);
+       NO_CAL(if (v[0] < -0.5) v[0] = -0.5; if (v[0] > 0.5) v[0] = 0.5;), /* common calculation */
+       value += v[0] * weight[i],
+       value *= MULTI_MIX_1(v[0], weight[i], 0.0, 1.0),
+       value *= MULTI_MIX_2(v[0], weight[i], 0.0, 1.0),
+       0.0,
+       1.0)
+
+/****** Periodic 3D (MAP_PERIODIC) *******/
+
+/* The 3D bases again, with the lattice wrapped along x and y so that they
+ * repeat every ctx->period[][i] at octave 'i'. The periods must be whole
+ * numbers, so x and y are scaled by their own factor at every octave instead
+ * of by the lacunarity (see SetBasisPeriod()). The spans loop over the scalar
+ * function, the vector lattice kernels don't wrap */
+
+#define BASE3P(NAME, XTRA_VARS, VALUE_CALC, RETURN)                                                                                               \
+  static inline G_GNUC_ALWAYS_INLINE double NAME##_Octaves(const BasisContext* ctx, void* data, double x, double y, double z0, const int octaves) \
+  {                                                                                                                                               \
+    int i = 0;                                                                                                                                    \
+    double value = NAN;                                                                                                                           \
+    double shift = NAN;                                                                                                                           \
+    double z = NAN;                                                                                                                               \
+    double px = NAN, py = NAN;                                                                                                                    \
+    int period_x = 0, period_y = 0;                                                                                                               \
+    const double* octave_scale = ctx->octave_scale;                                                                                               \
+    const double* octave_shift = ctx->octave_shift;                                                                                               \
+    const double* weight = ctx->weight;                                                                                                           \
+    guint16* shuffle_table = ctx->shuffle_table;                                                                                                  \
+    XTRA_VARS                                                                                                                                     \
+                                                                                                                                                  \
+    UNROLL_OCTAVES                                                                                                                                \
+    for (i = 0; i < octaves; i++)                                                                                                                 \
+    {                                                                                                                                             \
+      px = x * ctx->period_scale[0][i];                                                                                                           \
+      py = y * ctx->period_scale[1][i];                                                                                                           \
+      period_x = ctx->period[0][i];                                                                                                               \
+      period_y = ctx->period[1][i];                                                                                                               \
+      z = z0 * octave_scale[i];                                                                                                                   \
+      shift = octave_shift[i];                                                                                                                    \
+      VALUE_CALC;                                                                                                                                 \
+    }                                                                                                                                             \
+    return RETURN;                                                                                                                                \
+  }                                                                                                                                               \
+                                                                                                                                                  \
+  static double NAME##_Loop(const BasisContext* ctx, void* data, double x, double y, double z0)                                                   \
+  {                                                                                                                                               \
+    int i = 0;                                                                                                                                    \
+    double value = NAN;                                                                                                                           \
+    double shift = NAN;                                                                                                                           \
+    double z = NAN;                                                                                                                               \
+    double px = NAN, py = NAN;                                                                                                                    \
+    int period_x = 0, period_y = 0;                                                                                                               \
+    const int octaves = ctx->octaves;                                                                                                             \
+    const double* octave_scale = ctx->octave_scale;                                                                                               \
+    const double* octave_shift = ctx->octave_shift;                                                                                               \
+    const double* weight = ctx->weight;                                                                                                           \
+    guint16* shuffle_table = ctx->shuffle_table;                                                                                                  \
+    XTRA_VARS                                                                                                                                     \
+                                                                                                                                                  \
+    for (i = 0; i < octaves; i++)                                                                                                                 \
+    {                                                                                                                                             \
+      px = x * ctx->period_scale[0][i];                                                                                                           \
+      py = y * ctx->period_scale[1][i];                                                                                                           \
+      period_x = ctx->period[0][i];                                                                                                               \
+      period_y = ctx->period[1][i];                                                                                                               \
+      z = z0 * octave_scale[i];                                                                                                                   \
+      shift = octave_shift[i];                                                                                                                    \
+      VALUE_CALC;                                                                                                                                 \
+    }                                                                                                                                             \
+    return RETURN;                                                                                                                                \
+  }                                                                                                                                               \
+                                                                                                                                                  \
+  static double NAME(const BasisContext* ctx, void* data, double x, double y, double z0)                                                          \
+  {                                                                                                                                               \
+    OCTAVE_DISPATCH(NAME##_Octaves, ctx, data, x, y, z0);                                                                                         \
+    return NAME##_Loop(ctx, data, x, y, z0);                                                                                                      \
+  }
+
+#define FUNC3P(NAME, XTRA_VARS, VALUE_CALC, CALC_FBM, CALC_MF1, CALC_MF2, MID_VALUE, SCALING)          \
+  BASE3P(NAME##_FBM, XTRA_VARS; value = 0;, VALUE_CALC; CALC_FBM;, OUTPUT(value, MID_VALUE, SCALING))  \
+  SPAN3D(NAME##_FBM)                                                                                   \
+  BASE3P(NAME##_MF1, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF1;, pow(value, ctx->exponent) - 0.5)    \
+  SPAN3D(NAME##_MF1)                                                                                   \
+  BASE3P(NAME##_MF2, XTRA_VARS; value = 1;, VALUE_CALC; CALC_MF2;, -(pow(value, ctx->exponent) - 0.5)) \
+  SPAN3D(NAME##_MF2)
+
+#define TURB3P(NAME, XTRA_VARS, VALUE_CALC, CALC_FBM, CALC_MF1, CALC_MF2, MID_VALUE, SCALING) \
+  BASE3P(NAME##_FBM,                                                                          \
+         double tmp = NAN;                                                                    \
+         XTRA_VARS;                                                                           \
+         value = 0;                                                                           \
+         ,                                                                                    \
+         VALUE_CALC;                                                                          \
+         tmp -= MID_VALUE;                                                                    \
+         if (tmp < 0) tmp = -tmp;                                                             \
+         CALC_FBM;                                                                            \
+         ,                                                                                    \
+         value * (SCALING * 2.0) - 0.5)                                                       \
+  SPAN3D(NAME##_FBM)                                                                          \
+  BASE3P(NAME##_MF1,                                                                          \
+         double tmp = NAN;                                                                    \
+         XTRA_VARS;                                                                           \
+         value = 1;                                                                           \
+         ,                                                                                    \
+         VALUE_CALC;                                                                          \
+         tmp -= MID_VALUE;                                                                    \
+         if (tmp < 0) tmp = -tmp;                                                             \
+         CALC_MF1;                                                                            \
+         ,                                                                                    \
+         pow(value, ctx->exponent) - 0.5)                                                     \
+  SPAN3D(NAME##_MF1)                                                                          \
+  BASE3P(NAME##_MF2,                                                                          \
+         double tmp = NAN;                                                                    \
+         XTRA_VARS;                                                                           \
+         value = 1;                                                                           \
+         ,                                                                                    \
+         VALUE_CALC;                                                                          \
+         tmp -= MID_VALUE;                                                                    \
+         if (tmp < 0) tmp = -tmp;                                                             \
+         CALC_MF2;                                                                            \
+         ,                                                                                    \
+         -(pow(value, ctx->exponent) - 0.5))                                                  \
+  SPAN3D(NAME##_MF2)
+
+#define LATTICE3P(NAME, POST_CALC, CALC_FBM, CALC_MF1, CALC_MF2, RETURN_FBM)                                                                                 \
+  BASE3P(NAME##_FBM, double tmp = NAN; value = 0;, tmp = LNoise3DPeriodic(PARAM_3P, shuffle_table); POST_CALC CALC_FBM;, RETURN_FBM)                         \
+  SPAN3D(NAME##_FBM)                                                                                                                                         \
+  BASE3P(NAME##_MF1, double tmp = NAN; value = 1;, tmp = LNoise3DPeriodic(PARAM_3P, shuffle_table); POST_CALC CALC_MF1;, pow(value, ctx->exponent) - 0.5)    \
+  SPAN3D(NAME##_MF1)                                                                                                                                         \
+  BASE3P(NAME##_MF2, double tmp = NAN; value = 1;, tmp = LNoise3DPeriodic(PARAM_3P, shuffle_table); POST_CALC CALC_MF2;, -(pow(value, ctx->exponent) - 0.5)) \
+  SPAN3D(NAME##_MF2)
+
+#define PARAM_3P px + shift, py + shift, z + shift, period_x, period_y
+
+FUNC3P(SparseNoise3P, /* no extra vars */, /* No common calculations */, value += SNoise3DPeriodic(PARAM_3P, (const SNoiseFeatures3D*)data, shuffle_table) * weight[i],
+       value *= MULTI_MIX_1(SNoise3DPeriodic(PARAM_3P, (const SNoiseFeatures3D*)data, shuffle_table), weight[i], SN_3D_MID, SN_3D_FAC),
+       value *= MULTI_MIX_2(SNoise3DPeriodic(PARAM_3P, (const SNoiseFeatures3D*)data, shuffle_table), weight[i], SN_3D_MID, SN_3D_FAC),
+       SN_3D_MID,
+       SN_3D_FAC)
+
+TURB3P(SparseTurb3P_1, /* no extra vars */, tmp = SNoise3DPeriodic(PARAM_3P, (const SNoiseFeatures3D*)data, shuffle_table), value += tmp * weight[i];,
+       value *= TURB_MIX_1(tmp, weight[i], SN_3D_MID, SN_3D_FAC),
+       value *= TURB_MIX_2(tmp, weight[i], SN_3D_MID, SN_3D_FAC),
+       SN_3D_MID,
+       SN_3D_FAC)
+
+LATTICE3P(LatticeNoise3P, /* no post-processing */, value += tmp * weight[i],
+          value *= MULTI_MIX_1(tmp, weight[i], LN_3D_MID, LN_3D_FAC),
+          value *= MULTI_MIX_2(tmp, weight[i], LN_3D_MID, LN_3D_FAC),
+          OUTPUT(value, LN_3D_MID, LN_3D_FAC))
+
+LATTICE3P(LatticeTurb3P_1, tmp -= LN_3D_MID; if (tmp < 0) tmp = -tmp;, value += tmp * weight[i],
+          value *= TURB_MIX_1(tmp, weight[i], LN_3D_MID, LN_3D_FAC),
+          value *= TURB_MIX_2(tmp, weight[i], LN_3D_MID, LN_3D_FAC),
+          value * (LN_3D_FAC * 2.0) - 0.5)
+
+/* cell 1 (Skin) */
+FUNC3P(Cell3P_1,
+       double f[2] = {NAN};
+       ,                                                            /* extra vars */
+       Cells3DPeriodic_F2(PARAM_3P, f, (const CellFeatures3D*)data, shuffle_table), /* common calculation */
+       value += (f[1] - f[0]) * weight[i],
+       value *= MULTI_MIX_1(f[1] - f[0], weight[i], CELL1_3D_MID, CELL1_3D_FAC),
+       value *= MULTI_MIX_2(f[1] - f[0], weight[i], CELL1_3D_MID, CELL1_3D_FAC),
+       CELL1_3D_MID,
+       CELL1_3D_FAC)
+
+/* cell 2 (Puffy) */
+FUNC3P(Cell3P_2,
+       double f1 = NAN;
+       ,                                                            /* extra vars */
+       f1 = Cells3DPeriodic_F1(PARAM_3P, (const CellFeatures3D*)data, shuffle_table), /* common calculation */
+       value += f1 * weight[i],
+       value *= MULTI_MIX_1(f1, weight[i], CELL2_3D_MID, CELL2_3D_FAC),
+       value *= MULTI_MIX_2(f1, weight[i], CELL2_3D_MID, CELL2_3D_FAC),
+       CELL2_3D_MID,
+       CELL2_3D_FAC)
+
+/* cell 3 (Fractured) */
+FUNC3P(Cell3P_3,
+       double f[2] = {NAN};
+       ,                                                            /* extra vars */
+       Cells3DPeriodic_F2(PARAM_3P, f, (const CellFeatures3D*)data, shuffle_table), /* common calculation */
+       value += f[1] * weight[i],
+       value *= MULTI_MIX_1(f[1], weight[i], CELL3_3D_MID, CELL3_3D_FAC),
+       value *= MULTI_MIX_2(f[1], weight[i], CELL3_3D_MID, CELL3_3D_FAC),
+       CELL3_3D_MID,
+       CELL3_3D_FAC)
+
+/* cell 4 (Crystals) */
+FUNC3P(Cell3P_4,
+       guint32 id = 0;
+       ,                                                            /* extra vars */
+       id = Cells3DPeriodic_Id(PARAM_3P, (const CellFeatures3D*)data, shuffle_table), /* common calculation */
+       value += (Hash1(id) * (1.0 / (TABLE_SIZE - 1))) * weight[i],
+       value *= MULTI_MIX_1(Hash1(id) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_3D_MID, CELL4_3D_FAC),
+       value *= MULTI_MIX_2(Hash1(id) * (1.0 / (TABLE_SIZE - 1)), weight[i], CELL4_3D_MID, CELL4_3D_FAC),
+       CELL4_3D_MID,
+       CELL4_3D_FAC)
+
+/* cell 5 (Galvanized) */
+FUNC3P(Cell3P_5,
+       double delta[3] = {NAN};
+       guint32 id = 0;
+       double v[3] = {NAN};
+       double n = NAN;
+       , /* extra vars */
+       id = Cells3DPeriodic_Delta(PARAM_3P, delta, (const CellFeatures3D*)data, shuffle_table);
+       v[0] = (Hash1(id) - ((TABLE_SIZE - 1) * 0.5));
+       v[1] = (Hash1(id + 1) - ((TABLE_SIZE - 1) * 0.5));
+       v[2] = (Hash1(id + 2) - ((TABLE_SIZE - 1) * 0.5));
+       n = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+       /* we'll incorporate the factor here, and avoid a multiply later on */
+       if (n < -0.001 || n > 0.001) n = CELL5_3D_FAC / n;
+       v[0] = ((delta[0] * v[0] + delta[1] * v[1] + delta[2] * v[2]) * n);
        NO_CAL(if (v[0] < -0.5) v[0] = -0.5; if (v[0] > 0.5) v[0] = 0.5;), /* common calculation */
        value += v[0] * weight[i],
        value *= MULTI_MIX_1(v[0], weight[i], 0.0, 1.0),
@@ -607,218 +1258,427 @@ FUNC5D(Cell5D_5,
 
 /**********************/
 #ifdef CALIBRATE
-#define ITEM(INIT, DEINIT, BASIS, NAME)                                       \
-  {                                                                           \
-    (init_fn_type*)INIT, (deinit_fn_type*)DEINIT, (basis_fn_type*)BASIS, NAME \
+#define ITEM(INIT, BASIS, NAME)                                                         \
+  {                                                                                     \
+    (init_fn_type*)INIT, (basis_fn_type*)BASIS, (basis_span_fn_type*)BASIS##_Span, NAME \
   }
 #else
-#define ITEM(INIT, DEINIT, BASIS, NAME)                                 \
-  {                                                                     \
-    (init_fn_type*)INIT, (deinit_fn_type*)DEINIT, (basis_fn_type*)BASIS \
+#define ITEM(INIT, BASIS, NAME)                                                   \
+  {                                                                               \
+    (init_fn_type*)INIT, (basis_fn_type*)BASIS, (basis_span_fn_type*)BASIS##_Span \
   }
 #endif
 
 static basis_struct basis[] =
   {
-    ITEM(NULL, NULL, LatticeNoise3D_FBM, "LN_3D"),
-    ITEM(NULL, NULL, LatticeNoise4D_FBM, "LN_4D"),
-    ITEM(NULL, NULL, LatticeNoise5D_FBM, "LN_5D"),
+    ITEM(NULL, LatticeNoise3D_FBM, "LN_3D"),
+    ITEM(NULL, LatticeNoise4D_FBM, "LN_4D"),
+    ITEM(NULL, LatticeNoise5D_FBM, "LN_5D"),
+
+    ITEM(NULL, LatticeNoise3D_MF1, NULL),
+    ITEM(NULL, LatticeNoise4D_MF1, NULL),
+    ITEM(NULL, LatticeNoise5D_MF1, NULL),
+
+    ITEM(NULL, LatticeNoise3D_MF2, NULL),
+    ITEM(NULL, LatticeNoise4D_MF2, NULL),
+    ITEM(NULL, LatticeNoise5D_MF2, NULL),
+
+    ITEM(NULL, LatticeTurb3D_1_FBM, NULL),
+    ITEM(NULL, LatticeTurb4D_1_FBM, NULL),
+    ITEM(NULL, LatticeTurb5D_1_FBM, NULL),
+
+    ITEM(NULL, LatticeTurb3D_1_MF1, NULL),
+    ITEM(NULL, LatticeTurb4D_1_MF1, NULL),
+    ITEM(NULL, LatticeTurb5D_1_MF1, NULL),
+
+    ITEM(NULL, LatticeTurb3D_1_MF2, NULL),
+    ITEM(NULL, LatticeTurb4D_1_MF2, NULL),
+    ITEM(NULL, LatticeTurb5D_1_MF2, NULL),
+
+    ITEM(InitSNoiseBasis3D, SparseNoise3D_FBM, "SN_3D"),
+    ITEM(InitSNoiseBasis4D, SparseNoise4D_FBM, "SN_4D"),
+    ITEM(InitSNoiseBasis5D, SparseNoise5D_FBM, "SN_5D"),
 
-    ITEM(NULL, NULL, LatticeNoise3D_MF1, NULL),
-    ITEM(NULL, NULL, LatticeNoise4D_MF1, NULL),
-    ITEM(NULL, NULL, LatticeNoise5D_MF1, NULL),
+    ITEM(InitSNoiseBasis3D, SparseNoise3D_MF1, NULL),
+    ITEM(InitSNoiseBasis4D, SparseNoise4D_MF1, NULL),
+    ITEM(InitSNoiseBasis5D, SparseNoise5D_MF1, NULL),
 
-    ITEM(NULL, NULL, LatticeNoise3D_MF2, NULL),
-    ITEM(NULL, NULL, LatticeNoise4D_MF2, NULL),
-    ITEM(NULL, NULL, LatticeNoise5D_MF2, NULL),
+    ITEM(InitSNoiseBasis3D, SparseNoise3D_MF2, NULL),
+    ITEM(InitSNoiseBasis4D, SparseNoise4D_MF2, NULL),
+    ITEM(InitSNoiseBasis5D, SparseNoise5D_MF2, NULL),
 
-    ITEM(NULL, NULL, LatticeTurb3D_1_FBM, NULL),
-    ITEM(NULL, NULL, LatticeTurb4D_1_FBM, NULL),
-    ITEM(NULL, NULL, LatticeTurb5D_1_FBM, NULL),
+    ITEM(InitSNoiseBasis3D, SparseTurb3D_1_FBM, NULL),
+    ITEM(InitSNoiseBasis4D, SparseTurb4D_1_FBM, NULL),
+    ITEM(InitSNoiseBasis5D, SparseTurb5D_1_FBM, NULL),
 
-    ITEM(NULL, NULL, LatticeTurb3D_1_MF1, NULL),
-    ITEM(NULL, NULL, LatticeTurb4D_1_MF1, NULL),
-    ITEM(NULL, NULL, LatticeTurb5D_1_MF1, NULL),
+    ITEM(InitSNoiseBasis3D, SparseTurb3D_1_MF1, NULL),
+    ITEM(InitSNoiseBasis4D, SparseTurb4D_1_MF1, NULL),
+    ITEM(InitSNoiseBasis5D, SparseTurb5D_1_MF1, NULL),
 
-    ITEM(NULL, NULL, LatticeTurb3D_1_MF2, NULL),
-    ITEM(NULL, NULL, LatticeTurb4D_1_MF2, NULL),
-    ITEM(NULL, NULL, LatticeTurb5D_1_MF2, NULL),
+    ITEM(InitSNoiseBasis3D, SparseTurb3D_1_MF2, NULL),
+    ITEM(InitSNoiseBasis4D, SparseTurb4D_1_MF2, NULL),
+    ITEM(InitSNoiseBasis5D, SparseTurb5D_1_MF2, NULL),
 
-    ITEM(InitSNoiseBasis3D, FinishSNoiseBasis3D, SparseNoise3D_FBM, "SN_3D"),
-    ITEM(InitSNoiseBasis4D, FinishSNoiseBasis4D, SparseNoise4D_FBM, "SN_4D"),
-    ITEM(InitSNoiseBasis5D, FinishSNoiseBasis5D, SparseNoise5D_FBM, "SN_5D"),
+    ITEM(InitCellBasis3D, Cell3D_1_FBM, "CELL1_3D"),
+    ITEM(InitCellBasis4D, Cell4D_1_FBM, "CELL1_4D"),
+    ITEM(InitCellBasis5D, Cell5D_1_FBM, "CELL1_5D"),
 
-    ITEM(InitSNoiseBasis3D, FinishSNoiseBasis3D, SparseNoise3D_MF1, NULL),
-    ITEM(InitSNoiseBasis4D, FinishSNoiseBasis4D, SparseNoise4D_MF1, NULL),
-    ITEM(InitSNoiseBasis5D, FinishSNoiseBasis5D, SparseNoise5D_MF1, NULL),
+    ITEM(InitCellBasis3D, Cell3D_1_MF1, NULL),
+    ITEM(InitCellBasis4D, Cell4D_1_MF1, NULL),
+    ITEM(InitCellBasis5D, Cell5D_1_MF1, NULL),
 
-    ITEM(InitSNoiseBasis3D, FinishSNoiseBasis3D, SparseNoise3D_MF2, NULL),
-    ITEM(InitSNoiseBasis4D, FinishSNoiseBasis4D, SparseNoise4D_MF2, NULL),
-    ITEM(InitSNoiseBasis5D, FinishSNoiseBasis5D, SparseNoise5D_MF2, NULL),
+    ITEM(InitCellBasis3D, Cell3D_1_MF2, NULL),
+    ITEM(InitCellBasis4D, Cell4D_1_MF2, NULL),
+    ITEM(InitCellBasis5D, Cell5D_1_MF2, NULL),
 
-    ITEM(InitSNoiseBasis3D, FinishSNoiseBasis3D, SparseTurb3D_1_FBM, NULL),
-    ITEM(InitSNoiseBasis4D, FinishSNoiseBasis4D, SparseTurb4D_1_FBM, NULL),
-    ITEM(InitSNoiseBasis5D, FinishSNoiseBasis5D, SparseTurb5D_1_FBM, NULL),
+    ITEM(InitCellBasis3D, Cell3D_2_FBM, "CELL2_3D"),
+    ITEM(InitCellBasis4D, Cell4D_2_FBM, "CELL2_4D"),
+    ITEM(InitCellBasis5D, Cell5D_2_FBM, "CELL2_5D"),
 
-    ITEM(InitSNoiseBasis3D, FinishSNoiseBasis3D, SparseTurb3D_1_MF1, NULL),
-    ITEM(InitSNoiseBasis4D, FinishSNoiseBasis4D, SparseTurb4D_1_MF1, NULL),
-    ITEM(InitSNoiseBasis5D, FinishSNoiseBasis5D, SparseTurb5D_1_MF1, NULL),
+    ITEM(InitCellBasis3D, Cell3D_2_MF1, NULL),
+    ITEM(InitCellBasis4D, Cell4D_2_MF1, NULL),
+    ITEM(InitCellBasis5D, Cell5D_2_MF1, NULL),
 
-    ITEM(InitSNoiseBasis3D, FinishSNoiseBasis3D, SparseTurb3D_1_MF2, NULL),
-    ITEM(InitSNoiseBasis4D, FinishSNoiseBasis4D, SparseTurb4D_1_MF2, NULL),
-    ITEM(InitSNoiseBasis5D, FinishSNoiseBasis5D, SparseTurb5D_1_MF2, NULL),
+    ITEM(InitCellBasis3D, Cell3D_2_MF2, NULL),
+    ITEM(InitCellBasis4D, Cell4D_2_MF2, NULL),
+    ITEM(InitCellBasis5D, Cell5D_2_MF2, NULL),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_1_FBM, "CELL1_3D"),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_1_FBM, "CELL1_4D"),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_1_FBM, "CELL1_5D"),
+    ITEM(InitCellBasis3D, Cell3D_3_FBM, "CELL3_3D"),
+    ITEM(InitCellBasis4D, Cell4D_3_FBM, "CELL3_4D"),
+    ITEM(InitCellBasis5D, Cell5D_3_FBM, "CELL3_5D"),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_1_MF1, NULL),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_1_MF1, NULL),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_1_MF1, NULL),
+    ITEM(InitCellBasis3D, Cell3D_3_MF1, NULL),
+    ITEM(InitCellBasis4D, Cell4D_3_MF1, NULL),
+    ITEM(InitCellBasis5D, Cell5D_3_MF1, NULL),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_1_MF2, NULL),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_1_MF2, NULL),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_1_MF2, NULL),
+    ITEM(InitCellBasis3D, Cell3D_3_MF2, NULL),
+    ITEM(InitCellBasis4D, Cell4D_3_MF2, NULL),
+    ITEM(InitCellBasis5D, Cell5D_3_MF2, NULL),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_2_FBM, "CELL2_3D"),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_2_FBM, "CELL2_4D"),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_2_FBM, "CELL2_5D"),
+    ITEM(InitCellBasis3D, Cell3D_4_FBM, "CELL4_3D"),
+    ITEM(InitCellBasis4D, Cell4D_4_FBM, "CELL4_4D"),
+    ITEM(InitCellBasis5D, Cell5D_4_FBM, "CELL4_5D"),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_2_MF1, NULL),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_2_MF1, NULL),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_2_MF1, NULL),
+    ITEM(InitCellBasis3D, Cell3D_4_MF1, NULL),
+    ITEM(InitCellBasis4D, Cell4D_4_MF1, NULL),
+    ITEM(InitCellBasis5D, Cell5D_4_MF1, NULL),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_2_MF2, NULL),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_2_MF2, NULL),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_2_MF2, NULL),
+    ITEM(InitCellBasis3D, Cell3D_4_MF2, NULL),
+    ITEM(InitCellBasis4D, Cell4D_4_MF2, NULL),
+    ITEM(InitCellBasis5D, Cell5D_4_MF2, NULL),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_3_FBM, "CELL3_3D"),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_3_FBM, "CELL3_4D"),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_3_FBM, "CELL3_5D"),
+    ITEM(InitCellBasis3D, Cell3D_5_FBM, "CELL5_3D"),
+    ITEM(InitCellBasis4D, Cell4D_5_FBM, "CELL5_4D"),
+    ITEM(InitCellBasis5D, Cell5D_5_FBM, "CELL5_5D"),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_3_MF1, NULL),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_3_MF1, NULL),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_3_MF1, NULL),
+    ITEM(InitCellBasis3D, Cell3D_5_MF1, NULL),
+    ITEM(InitCellBasis4D, Cell4D_5_MF1, NULL),
+    ITEM(InitCellBasis5D, Cell5D_5_MF1, NULL),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_3_MF2, NULL),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_3_MF2, NULL),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_3_MF2, NULL),
+    ITEM(InitCellBasis3D, Cell3D_5_MF2, NULL),
+    ITEM(InitCellBasis4D, Cell4D_5_MF2, NULL),
+    ITEM(InitCellBasis5D, Cell5D_5_MF2, NULL),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_4_FBM, "CELL4_3D"),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_4_FBM, "CELL4_4D"),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_4_FBM, "CELL4_5D"),
+    ITEM(NULL, SimplexNoise3D_FBM, "SX_3D"),
+    ITEM(NULL, SimplexNoise4D_FBM, "SX_4D"),
+    ITEM(NULL, SimplexNoise5D_FBM, "SX_5D"),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_4_MF1, NULL),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_4_MF1, NULL),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_4_MF1, NULL),
+    ITEM(NULL, SimplexNoise3D_MF1, NULL),
+    ITEM(NULL, SimplexNoise4D_MF1, NULL),
+    ITEM(NULL, SimplexNoise5D_MF1, NULL),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_4_MF2, NULL),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_4_MF2, NULL),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_4_MF2, NULL),
+    ITEM(NULL, SimplexNoise3D_MF2, NULL),
+    ITEM(NULL, SimplexNoise4D_MF2, NULL),
+    ITEM(NULL, SimplexNoise5D_MF2, NULL),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_5_FBM, "CELL5_3D"),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_5_FBM, "CELL5_4D"),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_5_FBM, "CELL5_5D"),
+    ITEM(NULL, SimplexTurb3D_1_FBM, NULL),
+    ITEM(NULL, SimplexTurb4D_1_FBM, NULL),
+    ITEM(NULL, SimplexTurb5D_1_FBM, NULL),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_5_MF1, NULL),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_5_MF1, NULL),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_5_MF1, NULL),
+    ITEM(NULL, SimplexTurb3D_1_MF1, NULL),
+    ITEM(NULL, SimplexTurb4D_1_MF1, NULL),
+    ITEM(NULL, SimplexTurb5D_1_MF1, NULL),
 
-    ITEM(InitCellBasis3D, FinishCellBasis3D, Cell3D_5_MF2, NULL),
-    ITEM(InitCellBasis4D, FinishCellBasis4D, Cell4D_5_MF2, NULL),
-    ITEM(InitCellBasis5D, FinishCellBasis5D, Cell5D_5_MF2, NULL),
+    ITEM(NULL, SimplexTurb3D_1_MF2, NULL),
+    ITEM(NULL, SimplexTurb4D_1_MF2, NULL),
+    ITEM(NULL, SimplexTurb5D_1_MF2, NULL),
 
-    ITEM(NULL, NULL, NULL, NULL)
+    {NULL}
 
 };
 
+/* The periodic bases, indexed by basis * 3 + multi. Their data is that of
+ * the 3D basis in basis[] */
+static basis_struct periodic_basis[] =
+  {
+    ITEM(NULL, LatticeNoise3P_FBM, NULL),
+    ITEM(NULL, LatticeNoise3P_MF1, NULL),
+    ITEM(NULL, LatticeNoise3P_MF2, NULL),
+
+    ITEM(NULL, LatticeTurb3P_1_FBM, NULL),
+    ITEM(NULL, LatticeTurb3P_1_MF1, NULL),
+    ITEM(NULL, LatticeTurb3P_1_MF2, NULL),
+
+    ITEM(NULL, SparseNoise3P_FBM, NULL),
+    ITEM(NULL, SparseNoise3P_MF1, NULL),
+    ITEM(NULL, SparseNoise3P_MF2, NULL),
+
+    ITEM(NULL, SparseTurb3P_1_FBM, NULL),
+    ITEM(NULL, SparseTurb3P_1_MF1, NULL),
+    ITEM(NULL, SparseTurb3P_1_MF2, NULL),
+
+    ITEM(NULL, Cell3P_1_FBM, NULL),
+    ITEM(NULL, Cell3P_1_MF1, NULL),
+    ITEM(NULL, Cell3P_1_MF2, NULL),
+
+    ITEM(NULL, Cell3P_2_FBM, NULL),
+    ITEM(NULL, Cell3P_2_MF1, NULL),
+    ITEM(NULL, Cell3P_2_MF2, NULL),
+
+    ITEM(NULL, Cell3P_3_FBM, NULL),
+    ITEM(NULL, Cell3P_3_MF1, NULL),
+    ITEM(NULL, Cell3P_3_MF2, NULL),
+
+    ITEM(NULL, Cell3P_4_FBM, NULL),
+    ITEM(NULL, Cell3P_4_MF1, NULL),
+    ITEM(NULL, Cell3P_4_MF2, NULL),
+
+    ITEM(NULL, Cell3P_5_FBM, NULL),
+    ITEM(NULL, Cell3P_5_MF1, NULL),
+    ITEM(NULL, Cell3P_5_MF2, NULL),
+
+    /* the simplex grid isn't aligned with the axes, so it can't be wrapped
+     * like the others. Lattice noise takes its place */
+    ITEM(NULL, LatticeNoise3P_FBM, NULL),
+    ITEM(NULL, LatticeNoise3P_MF1, NULL),
+    ITEM(NULL, LatticeNoise3P_MF2, NULL),
+
+    ITEM(NULL, LatticeTurb3P_1_FBM, NULL),
+    ITEM(NULL, LatticeTurb3P_1_MF1, NULL),
+    ITEM(NULL, LatticeTurb3P_1_MF2, NULL),
+
+    {NULL}
+
+};
+
+/* How much is kept of an octave with 'cells' lattice cells per pixel: all
+ * of it up to half a cell per pixel, fading out to nothing at one cell per
+ * pixel, where its detail would only alias */
+static double
+OctaveFade(double cells)
+{
+  double t = NAN;
+
+  if (cells <= 0.5)
+  {
+    return 1;
+  }
+  if (cells >= 1)
+  {
+    return 0;
+  }
+  t = log(cells) / log(0.5);
+  return t * t * (3.0 - 2.0 * t);
+}
+
+/* 'footprint' is how many lattice cells of the first octave a pixel spans,
+ * the higher octaves are faded out as they get near it (see OctaveFade()),
+ * and dropped once they are gone. 0 keeps all of them */
 static void
-SwitchBasis(int basis_fn, int dim, int multi, float p_octaves, float p_lacunarity, float p_hurst)
+SwitchBasis(BasisContext* ctx, int basis_fn, int dim, int multi, float p_octaves, float p_lacunarity, float p_hurst, double footprint)
 {
-  int new_data_type = 0;
   double freq = NAN;
   double alpha = NAN;
   int i = 0;
-  static double scaling = NAN;
-
-  new_data_type = basis_fn * 9 + (dim - 3) + multi * 3;
+  double scaling = NAN;
 
-  /* (de)initialize data specific to the basis function */
-  if (!data || new_data_type != data_type)
-  {
-    if (data && basis[data_type].deinit_fn)
-    {
-      basis[data_type].deinit_fn(data);
-    }
-    data = NULL;
-    if (basis[new_data_type].init_fn)
-    {
-      data = basis[new_data_type].init_fn();
-    }
-  }
+  ctx->basis = basis_fn;
+  ctx->dim = dim;
+  ctx->multi = multi;
+  ctx->p_octaves = p_octaves;
+  ctx->p_lacunarity = p_lacunarity;
+  ctx->p_hurst = p_hurst;
+  ctx->footprint = footprint;
 
   /* octaves, lacunarity, weighting coefficients.. */
-  octaves = (int)floor(p_octaves);
-  oct_frac = p_octaves - octaves;
-  lacunarity = p_lacunarity;
-  if (weight)
+  ctx->octaves = (int)floor(p_octaves);
+  ctx->oct_frac = p_octaves - ctx->octaves;
+  ctx->lacunarity = p_lacunarity;
+  if (ctx->weight)
   {
-    g_free(weight);
+    g_free(ctx->weight);
   }
-  weight = g_malloc(sizeof(double) * (octaves + 1));
+  ctx->weight = g_malloc(sizeof(double) * (ctx->octaves + 1));
+  g_free(ctx->octave_scale);
+  ctx->octave_scale = g_new(double, ctx->octaves + 1);
+  g_free(ctx->octave_shift);
+  ctx->octave_shift = g_new(double, ctx->octaves + 1);
 
   freq = 1;
   scaling = (multi != 0 ? 1 : 0);
   alpha = 4.0 * p_hurst;
-  for (i = 0; i <= octaves; i++)
+  for (i = 0; i <= ctx->octaves; i++)
   {
-    weight[i] = pow(freq, -alpha);
-    if (i == octaves)
+    ctx->octave_scale[i] = freq;
+    ctx->octave_shift[i] = (i > 0) ? ctx->octave_shift[i - 1] + 37.687322 : 0;
+    ctx->weight[i] = pow(freq, -alpha);
+    if (i > 0 && footprint > 0)
     {
-      weight[i] *= oct_frac;
+      ctx->weight[i] *= OctaveFade(freq * footprint);
     }
-    freq *= lacunarity;
+    if (i == ctx->octaves)
+    {
+      ctx->weight[i] *= ctx->oct_frac;
+    }
+    freq *= ctx->lacunarity;
     if (multi)
     {
-      scaling *= 1 - 0.5 * weight[i];
+      scaling *= 1 - 0.5 * ctx->weight[i];
     }
     else
     {
-      scaling += weight[i];
+      scaling += ctx->weight[i];
     }
   }
 
   /* fbm coefficients must add to 1, multifractal coefficients must each be in the range 0..1 */
   if (multi)
   {
-    exponent = log(0.5) / log(scaling);
+    ctx->exponent = log(0.5) / log(scaling);
   }
   else
   {
-    for (i = 0; i <= octaves; i++)
+    for (i = 0; i <= ctx->octaves; i++)
     {
-      weight[i] /= scaling;
+      ctx->weight[i] /= scaling;
     }
   }
 
-  if (oct_frac > 0.0001)
+  if (ctx->oct_frac > 0.0001)
+  {
+    ctx->octaves++;
+  }
+  while (ctx->octaves > 1 && ctx->weight[ctx->octaves - 1] == 0)
+  {
+    ctx->octaves--;
+  }
+
+  ctx->data_type = basis_fn * 9 + (dim - 3) + multi * 3;
+}
+
+/* no period is let grow past this, so they stay well within an int */
+#define MAX_PERIOD (1 << 24)
+
+int
+GetBasisPeriod(double units)
+{
+  if (units > MAX_PERIOD)
+  {
+    return MAX_PERIOD;
+  }
+  return MAX(1, (int)floor(units + 0.5));
+}
+
+void
+GetBasisPixelSize(const RenderData* rdat, double* dx, double* dy, int* period_x, int* period_y)
+{
+  const PluginState* state = NULL;
+
+  state = rdat->p_state;
+
+  *dx = 0.5 / state->size_x;
+  *dy = 0.5 / state->size_y;
+  *period_x = 0;
+  *period_y = 0;
+  if (state->mapping == MAP_PERIODIC)
+  {
+    *period_x = GetBasisPeriod(rdat->buffer_width * *dx);
+    *period_y = GetBasisPeriod(rdat->buffer_height * *dy);
+    *dx = (double)*period_x / rdat->buffer_width;
+    *dy = (double)*period_y / rdat->buffer_height;
+  }
+}
+
+/* Octave 'i' has about period * lacunarity^i cells across, rounded to a whole
+ * number. Must be called after SwitchBasis() */
+static void
+SetBasisPeriod(BasisContext* ctx, int period_x, int period_y)
+{
+  int period[2] = {period_x, period_y};
+  double freq = NAN;
+  int i = 0, k = 0;
+
+  ctx->period_x = period_x;
+  ctx->period_y = period_y;
+  if (!period_x || !period_y)
   {
-    octaves++;
+    return;
   }
 
-  data_type = new_data_type;
+  for (k = 0; k < 2; k++)
+  {
+    ctx->period[k] = g_new(int, ctx->octaves + 1);
+    ctx->period_scale[k] = g_new(double, ctx->octaves + 1);
+
+    freq = 1;
+    for (i = 0; i <= ctx->octaves; i++)
+    {
+      ctx->period[k][i] = GetBasisPeriod(period[k] * freq);
+      ctx->period_scale[k][i] = (double)ctx->period[k][i] / period[k];
+      freq *= ctx->lacunarity;
+    }
+  }
+}
+
+static BasisContext*
+NewBasisContext(guint32 seed)
+{
+  static gint last_id = 0;
+  BasisContext* ctx = NULL;
+
+  ctx = g_new0(BasisContext, 1);
+  ctx->id = g_atomic_int_add(&last_id, 1) + 1;
+  ctx->seed = seed;
+  SetRandomSeed(&ctx->rnd, seed);
+  ctx->shuffle_table = InitShuffleTable(&ctx->rnd);
+  ctx->lnoise = GetLNoiseKernels();
+
+  return ctx;
+}
+
+static void
+FreeBasisContext(BasisContext* ctx)
+{
+  FinishShuffleTable(ctx->shuffle_table);
+  if (ctx->weight)
+  {
+    g_free(ctx->weight);
+  }
+  g_free(ctx->octave_scale);
+  g_free(ctx->octave_shift);
+  g_free(ctx->period[0]);
+  g_free(ctx->period[1]);
+  g_free(ctx->period_scale[0]);
+  g_free(ctx->period_scale[1]);
+  g_free(ctx);
 }
 
+/* Each RenderData owns its own context, so independent renders (with
+ * different seeds or presets) can run at the same time. Clones made with
+ * CloneRenderData() share the context of the RenderData they were made from.
+ * The context is kept if the state still asks for the same basis */
 void
 InitBasis(RenderData* rdat)
 {
   PluginState* state = NULL;
+  BasisContext* ctx = NULL;
   int dim = 0;
+  int period_x = 0, period_y = 0;
+  double dx = 0, dy = 0;
+  double footprint = 0;
 
   state = rdat->p_state;
 
-  InitShuffleTable(state->seed);
-
   /* get the index of the basis function to use */
   switch (state->mapping)
   {
@@ -831,6 +1691,19 @@ InitBasis(RenderData* rdat)
     case MAP_TILED:
       dim = 5;
       break;
+    case MAP_PERIODIC:
+      dim = 3; /* the phase is the third axis */
+      break;
+  }
+
+  /* the same pixel size PrecalcRenderStuff() renders with, and as many cells
+   * across the image as there are in the planar mapping, rounded. Without a
+   * feature size nothing fades */
+  GetBasisPixelSize(rdat, &dx, &dy, &period_x, &period_y);
+  footprint = MAX(dx, dy);
+  if (!isfinite(footprint))
+  {
+    footprint = 0;
   }
 
   if (state->ign_phase && dim > 3)
@@ -838,29 +1711,65 @@ InitBasis(RenderData* rdat)
     dim--;
   }
 
-  SwitchBasis(state->basis, dim, state->multifractal, state->octaves, state->lacunarity, state->hurst);
+  ctx = rdat->basis_ctx;
+  if (ctx && ctx->seed == state->seed && ctx->basis == state->basis && ctx->dim == dim && ctx->multi == state->multifractal && ctx->p_octaves == state->octaves && ctx->p_lacunarity == state->lacunarity && ctx->p_hurst == state->hurst && ctx->period_x == period_x && ctx->period_y == period_y && ctx->footprint == footprint)
+  {
+    InitBasisData(rdat);
+    return;
+  }
+
+  DeinitBasis(rdat);
+  rdat->basis_ctx = NewBasisContext(state->seed);
+
+  SwitchBasis(rdat->basis_ctx, state->basis, dim, state->multifractal, state->octaves, state->lacunarity, state->hurst, footprint);
+  SetBasisPeriod(rdat->basis_ctx, period_x, period_y);
+
+  InitBasisData(rdat);
 }
 
 void
-DeinitBasis()
+DeinitBasis(RenderData* rdat)
 {
-  if (data)
+  if (rdat->basis_ctx)
   {
-    basis[data_type].deinit_fn(data);
+    FreeBasisContext(rdat->basis_ctx);
   }
-  FinishShuffleTable();
-  if (weight)
+  rdat->basis_ctx = NULL;
+}
+
+void
+InitBasisData(RenderData* rdat)
+{
+  init_fn_type* init_fn = NULL;
+
+  init_fn = basis[rdat->basis_ctx->data_type].init_fn;
+  rdat->basis_data = init_fn ? init_fn() : NULL;
+}
+
+basis_fn_type*
+GetBasis(const BasisContext* ctx)
+{
+  if (ctx->period_x)
   {
-    g_free(weight);
+    return periodic_basis[ctx->basis * 3 + ctx->multi].sample_fn;
   }
-  weight = NULL;
-  data = NULL;
+  return basis[ctx->data_type].sample_fn;
 }
 
-basis_fn_type*
-GetBasis()
+basis_span_fn_type*
+GetBasisSpan(const BasisContext* ctx)
 {
-  return basis[data_type].sample_fn;
+  if (ctx->period_x)
+  {
+    return periodic_basis[ctx->basis * 3 + ctx->multi].span_fn;
+  }
+  return basis[ctx->data_type].span_fn;
+}
+
+guint
+GetBasisId(const BasisContext* ctx)
+{
+  return ctx->id;
 }
 
 #ifdef CALIBRATE
@@ -874,10 +1783,13 @@ main(int argc, char* argv[])
   basis_fn_type* fn = NULL;
   double f1 = NAN, f2 = NAN, f3 = NAN, f4 = NAN, f5 = NAN;
   double mid = NAN, fac = NAN;
+  RenderData rdat = {0};
+  BasisContext* ctx = NULL;
 
-  InitShuffleTable(23470);
+  ctx = NewBasisContext(23470);
+  rdat.basis_ctx = ctx;
 
-  cal_file = fopen("calibration.h", "wt");
+  cal_file = fopen(CALIBRATION_FILE, "wt");
   if (!cal_file)
   {
     printf("Could not open cal_log for writing\n");
@@ -894,9 +1806,10 @@ main(int argc, char* argv[])
     dim = (i % 3) + 3;
 
     printf("%s\n", basis[i].name);
-    SwitchBasis((i / 9), dim, (i / 3) % 3, 1.0, 1.0, 0.0);
+    SwitchBasis(ctx, (i / 9), dim, (i / 3) % 3, 1.0, 1.0, 0.0, 0);
 
-    fn = GetBasis();
+    InitBasisData(&rdat);
+    fn = GetBasis(ctx);
 
     st_sum = 0;
     st_min = 1000000000;
@@ -907,31 +1820,31 @@ main(int argc, char* argv[])
       case 3:
         for (j = 0; j < SAMPLES; j++)
         {
-          f1 = RandomDbl() * 100;
-          f2 = RandomDbl() * 100;
-          f3 = RandomDbl() * 100;
-          ((basis_3d_fn*)fn)(f1, f2, f3);
+          f1 = RandomDbl(&ctx->rnd) * 100;
+          f2 = RandomDbl(&ctx->rnd) * 100;
+          f3 = RandomDbl(&ctx->rnd) * 100;
+          ((basis_3d_fn*)fn)(ctx, rdat.basis_data, f1, f2, f3);
         }
         break;
       case 4:
         for (j = 0; j < SAMPLES; j++)
         {
-          f1 = RandomDbl() * 100;
-          f2 = RandomDbl() * 100;
-          f3 = RandomDbl() * 100;
-          f4 = RandomDbl() * 100;
-          ((basis_4d_fn*)fn)(f1, f2, f3, f4);
+          f1 = RandomDbl(&ctx->rnd) * 100;
+          f2 = RandomDbl(&ctx->rnd) * 100;
+          f3 = RandomDbl(&ctx->rnd) * 100;
+          f4 = RandomDbl(&ctx->rnd) * 100;
+          ((basis_4d_fn*)fn)(ctx, rdat.basis_data, f1, f2, f3, f4);
         }
         break;
       case 5:
         for (j = 0; j < SAMPLES; j++)
         {
-          f1 = RandomDbl() * 100;
-          f2 = RandomDbl() * 100;
-          f3 = RandomDbl() * 100;
-          f4 = RandomDbl() * 100;
-          f5 = RandomDbl() * 100;
-          ((basis_5d_fn*)fn)(f1, f2, f3, f4, f5);
+          f1 = RandomDbl(&ctx->rnd) * 100;
+          f2 = RandomDbl(&ctx->rnd) * 100;
+          f3 = RandomDbl(&ctx->rnd) * 100;
+          f4 = RandomDbl(&ctx->rnd) * 100;
+          f5 = RandomDbl(&ctx->rnd) * 100;
+          ((basis_5d_fn*)fn)(ctx, rdat.basis_data, f1, f2, f3, f4, f5);
         }
         break;
     }
@@ -944,6 +1857,8 @@ main(int argc, char* argv[])
   }
   fclose(cal_file);
 
+  DeinitBasis(&rdat);
+
   printf("Done\n");
   return 0;
 }
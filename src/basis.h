@@ -23,15 +23,49 @@
 
 struct RenderDataStr;
 
-typedef double basis_3d_fn(double, double, double);
-typedef double basis_4d_fn(double, double, double, double);
-typedef double basis_5d_fn(double, double, double, double, double);
+/* Everything a render needs to sample a basis: the fractal parameters and
+ * the shuffle table for the seed. It is not modified while sampling, so it
+ * can be shared by all the threads rendering with the same settings */
+typedef struct BasisContextStr BasisContext;
 
-typedef double basis_fn_type(double, double, double /*,double, double....*/);
+/* the second parameter is the basis data of the RenderData being rendered */
+typedef double basis_3d_fn(const BasisContext*, void*, double, double, double);
+typedef double basis_4d_fn(const BasisContext*, void*, double, double, double, double);
+typedef double basis_5d_fn(const BasisContext*, void*, double, double, double, double, double);
 
-/* must be called after the Render Data has been associated to a state */
+typedef double basis_fn_type(const BasisContext*, void*, double, double, double /*,double, double....*/);
+
+/* Span versions: evaluate 'n' samples at once. The coordinates are given as
+ * one array per axis, and the values written to the last array */
+typedef void basis_3d_span_fn(const BasisContext*, void*, int, const double*, const double*, const double*, double*);
+typedef void basis_4d_span_fn(const BasisContext*, void*, int, const double*, const double*, const double*, const double*, double*);
+typedef void basis_5d_span_fn(const BasisContext*, void*, int, const double*, const double*, const double*, const double*, const double*, double*);
+
+typedef void basis_span_fn_type(const BasisContext*, void*, int, const double* /*, const double*...., double* */);
+
+/* must be called after the Render Data has been associated to a state and
+ * its buffer set (MAP_PERIODIC fits the basis to the buffer) */
 void InitBasis(struct RenderDataStr* rdat);
 
-void DeinitBasis();
+void DeinitBasis(struct RenderDataStr* rdat);
+
+/* Points 'rdat' to the data of its basis (eg. the feature point tables), or
+ * NULL if the basis needs none. The data is built once and shared read-only by
+ * every render, so it is never freed */
+void InitBasisData(struct RenderDataStr* rdat);
+
+/* The whole number of lattice cells closest to 'units' (at least 1), which
+ * MAP_PERIODIC fits across the image */
+int GetBasisPeriod(double units);
+
+/* The size of a pixel of 'rdat' in the basis ('dx', 'dy'). With MAP_PERIODIC
+ * the features are stretched a little, to fit a whole number of lattice cells
+ * across the image ('period_x', 'period_y', which are 0 otherwise) */
+void GetBasisPixelSize(const struct RenderDataStr* rdat, double* dx, double* dy, int* period_x, int* period_y);
+
+basis_fn_type* GetBasis(const BasisContext* ctx);
+basis_span_fn_type* GetBasisSpan(const BasisContext* ctx);
 
-basis_fn_type* GetBasis();
+/* no two contexts get the same id, so values sampled from a context can be
+ * told apart from those of the one replacing it */
+guint GetBasisId(const BasisContext* ctx);
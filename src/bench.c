@@ -0,0 +1,684 @@
+/*  Felimage Noise Plugin for the GIMP
+ *  Copyright (C) 2005 Guillermo Romero Franco <drirr_gato@users.sourceforge.net>
+ *
+ *  This file is part of the Felimage Noise Plugin for the GIMP
+ *
+ *  Felimage Noise Plugin for the Gimp is free software;
+ *  you can redistribute it and/or modify it under the terms of
+ *  the GNU General Public License as published by the Free Software
+ *  Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Felimage Noise Plugin for the Gimp is distributed in the hope
+ *  that it will be useful, but WITHOUT ANY WARRANTY; without even
+ *  the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ *  PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with fimg-noise; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* felimage-bench: times the noise core, to compare builds.
+ *
+ *   felimage-bench [options] [basis]
+ *   felimage-bench [options] render [PRESET...]
+ *
+ * basis: samples every basis function, in 3D, 4D and 5D, as fbm and both
+ * multifractals, over a sweep of octaves and lacunarities. The samples are
+ * taken one by one and in spans, the way RenderLow() does.
+ *
+ * render: renders presets (the ones in bench/ by default, one per mapping and
+ * color source) whole, through RenderImage() like the plug-in, into images in
+ * memory of a few sizes with a few thread counts. Reports the megapixels per
+ * second, the speedup and efficiency against the first thread count, and the
+ * peak resident memory of the process so far.
+ *
+ * Each case runs untimed a few times first, then is timed 'repeat' times; the
+ * mean, standard deviation and best of those are reported */
+
+#include "config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "loadsaveconf.h"
+#include "main.h"
+
+#include "basis.h"
+#include "random.h"
+#include "render.h"
+
+#define SPAN 64 /* samples per span, a tile row */
+#define TILE_SIZE 64 /* the default tile size of the GIMP */
+
+#ifndef BENCHDIR
+#define BENCHDIR "bench"
+#endif
+
+static const char* bench_presets[] = {
+  "planar_fg_bg.fnp",
+  "tileable_gradient.fnp",
+  "spherical_channels.fnp",
+  "planar_warp.fnp",
+  "tileable_phase_cells.fnp",
+  "periodic_phase_cells.fnp",
+  NULL};
+
+static gint samples = 100000;
+static gint repeat = 5;
+static gint warmup = 1;
+static gchar* octaves_list = "1,3,6";
+static gchar* lacunarity_list = "2,3";
+static gchar* basis_name = NULL;
+static gchar* json_name = NULL;
+static gchar* sizes_list = "256,512";
+static gchar* threads_list = NULL;
+static gint bpp = 4;
+
+static int only_basis = -1; /* the index of basis_name */
+
+static GOptionEntry entries[] = {
+  {"samples", 'n', 0, G_OPTION_ARG_INT, &samples, "Samples per run (100000)", "N"},
+  {"repeat", 'r', 0, G_OPTION_ARG_INT, &repeat, "Timed runs of each case (5)", "N"},
+  {"warmup", 'w', 0, G_OPTION_ARG_INT, &warmup, "Untimed runs before those (1)", "N"},
+  {"octaves", 'o', 0, G_OPTION_ARG_STRING, &octaves_list, "Octaves to sweep (1,3,6)", "LIST"},
+  {"lacunarity", 'l', 0, G_OPTION_ARG_STRING, &lacunarity_list, "Lacunarities to sweep (2,3)", "LIST"},
+  {"basis", 'b', 0, G_OPTION_ARG_STRING, &basis_name, "Only this basis, by its preset name", "NAME"},
+  {"sizes", 's', 0, G_OPTION_ARG_STRING, &sizes_list, "Render: image sizes, square (256,512)", "LIST"},
+  {"threads", 't', 0, G_OPTION_ARG_STRING, &threads_list, "Render: thread counts (1,2,4.. up to one per processor)", "LIST"},
+  {"bpp", 0, 0, G_OPTION_ARG_INT, &bpp, "Render: bytes per pixel, 1 to 4 (4)", "N"},
+  {"json", 'j', 0, G_OPTION_ARG_FILENAME, &json_name, "Also write the results as JSON, - for stdout", "FILE"},
+  {NULL}};
+
+/* the mean, standard deviation and best of the timed runs */
+typedef struct
+{
+  double mean, stddev, best;
+} BenchStats;
+
+static void
+GetStats(const double* times, int n, BenchStats* stats)
+{
+  double sum = 0.0, sq = 0.0;
+  int i = 0;
+
+  stats->best = times[0];
+  for (i = 0; i < n; i++)
+  {
+    sum += times[i];
+    stats->best = MIN(stats->best, times[i]);
+  }
+  stats->mean = sum / n;
+
+  for (i = 0; i < n; i++)
+  {
+    sq += (times[i] - stats->mean) * (times[i] - stats->mean);
+  }
+  stats->stddev = (n > 1) ? sqrt(sq / (n - 1)) : 0.0;
+}
+
+/* "1,2.5,3" into a newly allocated array, NULL if it isn't a list of numbers */
+static double*
+ParseList(const gchar* list, int* count)
+{
+  gchar** items = NULL;
+  gchar* end = NULL;
+  double* values = NULL;
+  int i = 0;
+
+  items = g_strsplit(list, ",", 0);
+  *count = g_strv_length(items);
+  values = g_new(double, MAX(*count, 1));
+
+  for (i = 0; i < *count; i++)
+  {
+    values[i] = g_ascii_strtod(items[i], &end);
+    if (end == items[i] || *end)
+    {
+      g_free(values);
+      values = NULL;
+      break;
+    }
+  }
+
+  g_strfreev(items);
+  return (*count > 0) ? values : NULL;
+}
+
+static volatile double sink; /* so the samples one by one aren't optimized away */
+
+/* One run over the coordinates, in ns per sample */
+static double
+RunBasis(RenderData* rdat, int dim, int span, double** coord, double* values)
+{
+  const BasisContext* ctx = rdat->basis_ctx;
+  void* data = rdat->basis_data;
+  basis_fn_type* fn = NULL;
+  basis_span_fn_type* span_fn = NULL;
+  double sum = 0.0;
+  gint64 start = 0;
+  int i = 0, n = 0;
+
+  fn = GetBasis(ctx);
+  span_fn = GetBasisSpan(ctx);
+
+  start = g_get_monotonic_time();
+
+  if (span)
+  {
+    for (i = 0; i < samples; i += n)
+    {
+      n = MIN(SPAN, samples - i);
+      switch (dim)
+      {
+        case 3:
+          ((basis_3d_span_fn*)span_fn)(ctx, data, n, coord[0] + i, coord[1] + i, coord[2] + i, values);
+          break;
+        case 4:
+          ((basis_4d_span_fn*)span_fn)(ctx, data, n, coord[0] + i, coord[1] + i, coord[2] + i, coord[3] + i, values);
+          break;
+        case 5:
+          ((basis_5d_span_fn*)span_fn)(ctx, data, n, coord[0] + i, coord[1] + i, coord[2] + i, coord[3] + i, coord[4] + i, values);
+          break;
+      }
+      sum += values[0];
+    }
+  }
+  else
+  {
+    for (i = 0; i < samples; i++)
+    {
+      switch (dim)
+      {
+        case 3:
+          sum += ((basis_3d_fn*)fn)(ctx, data, coord[0][i], coord[1][i], coord[2][i]);
+          break;
+        case 4:
+          sum += ((basis_4d_fn*)fn)(ctx, data, coord[0][i], coord[1][i], coord[2][i], coord[3][i]);
+          break;
+        case 5:
+          sum += ((basis_5d_fn*)fn)(ctx, data, coord[0][i], coord[1][i], coord[2][i], coord[3][i], coord[4][i]);
+          break;
+      }
+    }
+  }
+
+  sink = sum;
+  return (g_get_monotonic_time() - start) * 1000.0 / samples;
+}
+
+static void
+TimeBasis(RenderData* rdat, int dim, int span, double** coord, double* values, double* times, BenchStats* stats)
+{
+  int i = 0;
+
+  for (i = 0; i < warmup; i++)
+  {
+    RunBasis(rdat, dim, span, coord, values);
+  }
+  for (i = 0; i < repeat; i++)
+  {
+    times[i] = RunBasis(rdat, dim, span, coord, values);
+  }
+  GetStats(times, repeat, stats);
+}
+
+static void
+PrintJsonStats(FILE* file, const char* name, const BenchStats* stats)
+{
+  fprintf(file, "\"%s\": {\"mean\": %.3f, \"stddev\": %.3f, \"best\": %.3f}", name, stats->mean, stats->stddev, stats->best);
+}
+
+static int
+BenchBasis(FILE* json)
+{
+  PluginState state = {0};
+  RenderData rdat = {0};
+  RandomState rnd = {0};
+  BenchStats point = {0}, span = {0};
+  double* coord[5] = {NULL};
+  double values[SPAN] = {0};
+  double* times = NULL;
+  double* octaves = NULL;
+  double* lacunarity = NULL;
+  int n_octaves = 0, n_lacunarity = 0;
+  int basis = 0, dim = 0, multi = 0, o = 0, l = 0;
+  int i = 0, j = 0;
+  int first = 1;
+
+  octaves = ParseList(octaves_list, &n_octaves);
+  lacunarity = ParseList(lacunarity_list, &n_lacunarity);
+  if (!octaves || !lacunarity)
+  {
+    g_printerr("Octaves and lacunarities must be lists of numbers, like 1,3,6\n");
+    g_free(octaves);
+    g_free(lacunarity);
+    return -1;
+  }
+
+  /* the same coordinates for every case, spread like calibrate's */
+  SetRandomSeed(&rnd, 23470);
+  for (i = 0; i < 5; i++)
+  {
+    coord[i] = g_new(double, samples);
+    for (j = 0; j < samples; j++)
+    {
+      coord[i][j] = RandomDbl(&rnd) * 100;
+    }
+  }
+  times = g_new(double, repeat);
+
+  InitRenderData(&rdat);
+  AssociateRenderToState(&rdat, &state);
+  state.seed = 23470;
+  state.hurst = 0.5;
+
+  if (json)
+  {
+    fprintf(json, "{\n  \"mode\": \"basis\", \"hash\": \"%s\", \"samples\": %d, \"repeat\": %d, \"warmup\": %d, \"span\": %d,\n  \"basis\": [\n",
+            GetHashName(), samples, repeat, warmup, SPAN);
+  }
+
+  for (basis = 0; basis_names[basis]; basis++)
+  {
+    if (only_basis >= 0 && basis != only_basis)
+    {
+      continue;
+    }
+
+    for (dim = 3; dim <= 5; dim++)
+    {
+      for (multi = 0; multi < 3; multi++)
+      {
+        for (o = 0; o < n_octaves; o++)
+        {
+          for (l = 0; l < n_lacunarity; l++)
+          {
+            state.basis = basis;
+            state.multifractal = multi;
+            state.octaves = octaves[o];
+            state.lacunarity = lacunarity[l];
+            /* the mappings which sample the basis in 3, 4 and 5 dimensions */
+            state.mapping = (dim == 3) ? MAP_PLANAR : (dim == 4) ? MAP_SPHERICAL : MAP_TILED;
+            state.ign_phase = 0;
+            InitBasis(&rdat);
+
+            TimeBasis(&rdat, dim, 0, coord, values, times, &point);
+            TimeBasis(&rdat, dim, 1, coord, values, times, &span);
+
+            if (json != stdout)
+            {
+              printf("%-18s %dD %-16s oct %4.1f lac %4.2f  point %8.1f ns (+-%.1f, best %.1f)  span %8.1f ns (+-%.1f, best %.1f)  %7.2f Msamples/s\n",
+                     basis_names[basis], dim, multifractal_names[multi], octaves[o], lacunarity[l],
+                     point.mean, point.stddev, point.best, span.mean, span.stddev, span.best, 1000.0 / span.mean);
+            }
+
+            if (json)
+            {
+              fprintf(json, "%s    {\"basis\": \"%s\", \"dim\": %d, \"multifractal\": \"%s\", \"octaves\": %g, \"lacunarity\": %g, ",
+                      first ? "" : ",\n", basis_names[basis], dim, multifractal_names[multi], octaves[o], lacunarity[l]);
+              PrintJsonStats(json, "point_ns", &point);
+              fprintf(json, ", ");
+              PrintJsonStats(json, "span_ns", &span);
+              fprintf(json, ", \"samples_per_sec\": %.0f}", 1e9 / span.mean);
+              first = 0;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  if (json)
+  {
+    fprintf(json, "\n  ]\n}\n");
+  }
+
+  DeinitRenderData(&rdat);
+  DeinitBasis(&rdat);
+
+  for (i = 0; i < 5; i++)
+  {
+    g_free(coord[i]);
+  }
+  g_free(times);
+  g_free(octaves);
+  g_free(lacunarity);
+  return 0;
+}
+
+/*****************************************************************************/
+
+/* the images a render reads and writes, see RenderIO */
+typedef struct
+{
+  guchar* src;
+  guchar* dst;
+  int width, height;
+} BenchImage;
+
+static void
+ReadBenchBand(void* data, guchar* band, int y, int height)
+{
+  BenchImage* image = data;
+
+  memcpy(band, image->src + (gsize)y * image->width * bpp, (gsize)height * image->width * bpp);
+}
+
+static void
+WriteBenchBand(void* data, const guchar* band, int y, int height)
+{
+  BenchImage* image = data;
+
+  memcpy(image->dst + (gsize)y * image->width * bpp, band, (gsize)height * image->width * bpp);
+}
+
+/* wraps around, like the default edge action */
+static void
+FetchBenchPixel(void* fetcher, int x, int y, guchar* pixel)
+{
+  BenchImage* image = fetcher;
+
+  x %= image->width;
+  y %= image->height;
+  x += (x < 0) ? image->width : 0;
+  y += (y < 0) ? image->height : 0;
+  memcpy(pixel, image->src + ((gsize)y * image->width + x) * bpp, bpp);
+}
+
+/* One render of the whole image, in seconds */
+static double
+RunRender(PluginState* state, BenchImage* image, const double* gradient, int gradient_count)
+{
+  RenderData rdat = {0};
+  RenderIO io = {0};
+  gint64 start = 0;
+
+  io.read_band = ReadBenchBand;
+  io.write_band = WriteBenchBand;
+  io.fetch = FetchBenchPixel;
+  io.fetcher = image;
+  io.data = image;
+
+  start = g_get_monotonic_time();
+
+  InitRenderData(&rdat);
+  AssociateRenderToState(&rdat, state);
+  SetRenderGradient(&rdat, gradient, gradient_count);
+  SetRenderBuffer(&rdat, image->width, image->height, 0, 0, (bpp <= 2) ? MODE_GRAYSCALE : MODE_COLOR, 0);
+
+  RenderImage(&rdat, bpp, TILE_SIZE, TILE_SIZE, &io);
+
+  DeinitRenderData(&rdat);
+  DeinitBasis(&rdat);
+
+  return (g_get_monotonic_time() - start) / 1e6;
+}
+
+/* in KiB, 0 if unknown */
+static long
+GetPeakMemory(void)
+{
+#ifdef G_OS_UNIX
+  struct rusage usage;
+
+  if (!getrusage(RUSAGE_SELF, &usage))
+  {
+    return usage.ru_maxrss;
+  }
+#endif
+  return 0;
+}
+
+static int
+BenchRender(FILE* json, int n_presets, char** presets)
+{
+  PluginState state = {0};
+  BenchImage image = {0};
+  BenchStats stats = {0}, first = {0};
+  RandomState rnd = {0};
+  double gradient[4 * 256] = {0};
+  double* sizes = NULL;
+  double* threads = NULL;
+  double* times = NULL;
+  gchar* default_threads = NULL;
+  gchar* name = NULL;
+  double speedup = NAN, efficiency = NAN;
+  int n_sizes = 0, n_threads = 0;
+  int p = 0, s = 0, t = 0, i = 0;
+  gsize size = 0;
+  long memory = 0;
+  int first_case = 1;
+  int res = 0;
+
+  if (!threads_list)
+  {
+    /* powers of two, and one per processor */
+    default_threads = g_strdup("1");
+    for (i = 2; i < g_get_num_processors(); i *= 2)
+    {
+      name = default_threads;
+      default_threads = g_strdup_printf("%s,%d", name, i);
+      g_free(name);
+    }
+    if (g_get_num_processors() > 1)
+    {
+      name = default_threads;
+      default_threads = g_strdup_printf("%s,%d", name, g_get_num_processors());
+      g_free(name);
+    }
+  }
+
+  sizes = ParseList(sizes_list, &n_sizes);
+  threads = ParseList(threads_list ? threads_list : default_threads, &n_threads);
+  g_free(default_threads);
+  if (!sizes || !threads)
+  {
+    g_printerr("Sizes and thread counts must be lists of numbers, like 256,1024\n");
+    g_free(sizes);
+    g_free(threads);
+    return -1;
+  }
+
+  /* what gradient presets get instead of the GIMP's */
+  for (i = 0; i < 256; i++)
+  {
+    gradient[i * 4 + 0] = i / 255.0;
+    gradient[i * 4 + 1] = 1.0 - i / 255.0;
+    gradient[i * 4 + 2] = (i < 128) ? i / 127.0 : (255 - i) / 127.0;
+    gradient[i * 4 + 3] = 1.0;
+  }
+
+  times = g_new(double, repeat);
+
+  if (json)
+  {
+    fprintf(json, "{\n  \"mode\": \"render\", \"hash\": \"%s\", \"repeat\": %d, \"warmup\": %d, \"bpp\": %d, \"tile\": %d,\n  \"render\": [\n",
+            GetHashName(), repeat, warmup, bpp, TILE_SIZE);
+  }
+
+  for (p = 0; p < n_presets && !res; p++)
+  {
+    if (LoadConfig(presets[p], &state) < 0)
+    {
+      g_printerr("Can't read %s\n", presets[p]);
+      res = -1;
+      break;
+    }
+    name = g_path_get_basename(presets[p]);
+
+    for (s = 0; s < n_sizes; s++)
+    {
+      image.width = image.height = (int)sizes[s];
+      size = (gsize)image.width * image.height * bpp;
+      image.src = g_malloc(size);
+      image.dst = g_malloc(size);
+
+      SetRandomSeed(&rnd, 23470);
+      for (i = 0; i < size; i++)
+      {
+        image.src[i] = Random(&rnd) >> 24;
+      }
+
+      for (t = 0; t < n_threads; t++)
+      {
+        state.threads = (int)threads[t];
+
+        for (i = 0; i < warmup; i++)
+        {
+          RunRender(&state, &image, gradient, 256);
+        }
+        for (i = 0; i < repeat; i++)
+        {
+          times[i] = RunRender(&state, &image, gradient, 256);
+        }
+        GetStats(times, repeat, &stats);
+        memory = GetPeakMemory();
+
+        if (t == 0)
+        {
+          first = stats;
+        }
+        speedup = first.mean / stats.mean;
+        efficiency = speedup * threads[0] / threads[t];
+
+        if (json != stdout)
+        {
+          printf("%-26s %5dx%-5d %2d threads  %8.2f Mpixels/s  %8.3f s (+-%.3f, best %.3f)  speedup %5.2f  efficiency %4.2f  peak %ld KiB\n",
+                 name, image.width, image.height, state.threads, image.width * image.height / stats.mean / 1e6,
+                 stats.mean, stats.stddev, stats.best, speedup, efficiency, memory);
+        }
+
+        if (json)
+        {
+          fprintf(json, "%s    {\"preset\": \"%s\", \"width\": %d, \"height\": %d, \"threads\": %d, ",
+                  first_case ? "" : ",\n", name, image.width, image.height, state.threads);
+          PrintJsonStats(json, "seconds", &stats);
+          fprintf(json, ", \"mpixels_per_sec\": %.3f, \"speedup\": %.3f, \"efficiency\": %.3f, \"peak_rss_kib\": %ld}",
+                  image.width * image.height / stats.mean / 1e6, speedup, efficiency, memory);
+          first_case = 0;
+        }
+      }
+
+      g_free(image.src);
+      g_free(image.dst);
+    }
+    g_free(name);
+  }
+
+  if (json)
+  {
+    fprintf(json, "\n  ]\n}\n");
+  }
+
+  g_free(times);
+  g_free(sizes);
+  g_free(threads);
+  return res;
+}
+
+int
+main(int argc, char* argv[])
+{
+  GOptionContext* context = NULL;
+  GError* error = NULL;
+  FILE* json = NULL;
+  const char* mode = NULL;
+  char** presets = NULL;
+  int n_presets = 0;
+  int i = 0;
+  int res = 0;
+
+  context = g_option_context_new("[basis | render [PRESET...]] - time the noise core");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  mode = (argc > 1) ? argv[1] : "basis";
+  if ((strcmp(mode, "basis") || argc > 2) && strcmp(mode, "render"))
+  {
+    g_printerr("Usage: %s [options] [basis | render [PRESET...]], see --help\n", argv[0]);
+    return 1;
+  }
+
+  if (samples <= 0 || repeat <= 0 || warmup < 0)
+  {
+    g_printerr("Bad number of samples or runs\n");
+    return 1;
+  }
+
+  if (bpp < 1 || bpp > 4)
+  {
+    g_printerr("Bad bytes per pixel %d\n", bpp);
+    return 1;
+  }
+
+  if (basis_name)
+  {
+    for (i = 0; basis_names[i]; i++)
+    {
+      if (!strcmp(basis_name, basis_names[i]))
+      {
+        only_basis = i;
+      }
+    }
+    if (only_basis < 0)
+    {
+      g_printerr("Unknown basis %s\n", basis_name);
+      return 1;
+    }
+  }
+
+  if (json_name)
+  {
+    json = strcmp(json_name, "-") ? fopen(json_name, "w") : stdout;
+    if (!json)
+    {
+      g_printerr("Can't write %s\n", json_name);
+      return 1;
+    }
+  }
+
+  if (!strcmp(mode, "render"))
+  {
+    if (argc > 2)
+    {
+      res = BenchRender(json, argc - 2, argv + 2);
+    }
+    else
+    {
+      n_presets = g_strv_length((gchar**)bench_presets);
+      presets = g_new0(char*, n_presets + 1);
+      for (i = 0; i < n_presets; i++)
+      {
+        presets[i] = g_build_filename(BENCHDIR, bench_presets[i], NULL);
+      }
+      res = BenchRender(json, n_presets, presets);
+      g_strfreev(presets);
+    }
+  }
+  else
+  {
+    res = BenchBasis(json);
+  }
+
+  if (json && json != stdout)
+  {
+    fclose(json);
+  }
+
+  return res ? 1 : 0;
+}
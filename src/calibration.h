@@ -83,3 +83,15 @@
 /* Min -2.710768  Max 2.498051  Range 5.208820  Mid -0.106359  Avg -0.002401 */
 #define CELL5_5D_MID -0.106359
 #define CELL5_5D_FAC 0.191982
+
+/* Min -0.012992  Max 0.012977  Range 0.025970  Mid -0.000008  Avg -0.000007 */
+#define SX_3D_MID -0.000008
+#define SX_3D_FAC 38.506698
+
+/* Min -0.015776  Max 0.015775  Range 0.031551  Mid -0.000001  Avg 0.000000 */
+#define SX_4D_MID -0.000001
+#define SX_4D_FAC 31.694401
+
+/* Min -0.017483  Max 0.017770  Range 0.035254  Mid 0.000143  Avg -0.000012 */
+#define SX_5D_MID 0.000143
+#define SX_5D_FAC 28.365732
@@ -0,0 +1,98 @@
+/* This file is automatically generated by 'calibrate'. Do not hand edit! */
+
+/* Min -0.876701  Max 0.907699  Range 1.784400  Mid 0.015499  Avg -0.001911 */
+#define LN_3D_MID 0.015499
+#define LN_3D_FAC 0.560413
+
+/* Min -1.073089  Max 0.999122  Range 2.072211  Mid -0.036984  Avg -0.000508 */
+#define LN_4D_MID -0.036984
+#define LN_4D_FAC 0.482576
+
+/* Min -1.082525  Max 1.178485  Range 2.261010  Mid 0.047980  Avg -0.000161 */
+#define LN_5D_MID 0.047980
+#define LN_5D_FAC 0.442280
+
+/* Min 0.000000  Max 5.797864  Range 5.797864  Mid 2.898932  Avg 1.220734 */
+#define SN_3D_MID 2.898932
+#define SN_3D_FAC 0.172477
+
+/* Min 0.000015  Max 4.361063  Range 4.361048  Mid 2.180539  Avg 0.866519 */
+#define SN_4D_MID 2.180539
+#define SN_4D_FAC 0.229303
+
+/* Min 0.000001  Max 3.285918  Range 3.285917  Mid 1.642960  Avg 0.589665 */
+#define SN_5D_MID 1.642960
+#define SN_5D_FAC 0.304329
+
+/* Min 0.000001  Max 0.854487  Range 0.854486  Mid 0.427244  Avg 0.135321 */
+#define CELL1_3D_MID 0.427244
+#define CELL1_3D_FAC 1.170294
+
+/* Min 0.000001  Max 0.803140  Range 0.803140  Mid 0.401570  Avg 0.120060 */
+#define CELL1_4D_MID 0.401570
+#define CELL1_4D_FAC 1.245113
+
+/* Min 0.000002  Max 0.702937  Range 0.702935  Mid 0.351470  Avg 0.109393 */
+#define CELL1_5D_MID 0.351470
+#define CELL1_5D_FAC 1.422606
+
+/* Min 0.007386  Max 0.974553  Range 0.967167  Mid 0.490969  Avg 0.395730 */
+#define CELL2_3D_MID 0.490969
+#define CELL2_3D_FAC 1.033948
+
+/* Min 0.019241  Max 0.966645  Range 0.947405  Mid 0.492943  Avg 0.475041 */
+#define CELL2_4D_MID 0.492943
+#define CELL2_4D_FAC 1.055515
+
+/* Min 0.057568  Max 0.997477  Range 0.939909  Mid 0.527522  Avg 0.540506 */
+#define CELL2_5D_MID 0.527522
+#define CELL2_5D_FAC 1.063933
+
+/* Min 0.051273  Max 1.095829  Range 1.044556  Mid 0.573551  Avg 0.530919 */
+#define CELL3_3D_MID 0.573551
+#define CELL3_3D_FAC 0.957345
+
+/* Min 0.145268  Max 1.040094  Range 0.894826  Mid 0.592681  Avg 0.594504 */
+#define CELL3_4D_MID 0.592681
+#define CELL3_4D_FAC 1.117535
+
+/* Min 0.213031  Max 0.990241  Range 0.777210  Mid 0.601636  Avg 0.650449 */
+#define CELL3_5D_MID 0.601636
+#define CELL3_5D_FAC 1.286653
+
+/* Min 0.000000  Max 1.000000  Range 1.000000  Mid 0.500000  Avg 0.510189 */
+#define CELL4_3D_MID 0.500000
+#define CELL4_3D_FAC 1.000000
+
+/* Min 0.000000  Max 1.000000  Range 1.000000  Mid 0.500000  Avg 0.497775 */
+#define CELL4_4D_MID 0.500000
+#define CELL4_4D_FAC 1.000000
+
+/* Min 0.000000  Max 1.000000  Range 1.000000  Mid 0.500000  Avg 0.497227 */
+#define CELL4_5D_MID 0.500000
+#define CELL4_5D_FAC 1.000000
+
+/* Min -1.533180  Max 1.525626  Range 3.058806  Mid -0.003777  Avg -0.005533 */
+#define CELL5_3D_MID -0.003777
+#define CELL5_3D_FAC 0.326925
+
+/* Min -1.292533  Max 1.385653  Range 2.678186  Mid 0.046560  Avg -0.003150 */
+#define CELL5_4D_MID 0.046560
+#define CELL5_4D_FAC 0.373387
+
+/* Min -2.381338  Max 2.827484  Range 5.208822  Mid 0.223073  Avg -0.004261 */
+#define CELL5_5D_MID 0.223073
+#define CELL5_5D_FAC 0.191982
+
+/* Min -0.012993  Max 0.013002  Range 0.025995  Mid 0.000004  Avg 0.000003 */
+#define SX_3D_MID 0.000004
+#define SX_3D_FAC 38.468561
+
+/* Min -0.015776  Max 0.015796  Range 0.031573  Mid 0.000010  Avg -0.000020 */
+#define SX_4D_MID 0.000010
+#define SX_4D_FAC 31.672796
+
+/* Min -0.018002  Max 0.018036  Range 0.036038  Mid 0.000017  Avg -0.000014 */
+#define SX_5D_MID 0.000017
+#define SX_5D_FAC 27.748391
+
@@ -22,42 +22,60 @@
 #pragma once
 
 #include "poisson.h"
+#include "random.h"
 
 /* 3D */
-typedef struct CellBasisCache3DStr
+/* The feature points of every cell seed (SoA), see InitCellBasis3D() */
+typedef struct CellFeatures3DStr
 {
-  double p[3][MAX_FEATURES];
-  guint32 id[MAX_FEATURES];
-  guint32 last_seed;
-} CellBasisCache3D;
+  double p[3][TABLE_SIZE * FEATURE_STRIDE];
+  guint32 id[TABLE_SIZE * FEATURE_STRIDE];
+} CellFeatures3D;
 
-void Cells3D(double a0, double a1, double a2, gint32 max_order, double* f, double (*p_delta)[3], guint32* p_id, CellBasisCache3D* cache);
+/* The distance to the nearest feature point (F1), the two nearest distances
+ * in 'f' (F1 and F2), the id of the nearest point, or its id and its offset
+ * from the sample in 'p_delta'. Each one only tracks what it returns */
+double Cells3D_F1(double a0, double a1, double a2, const CellFeatures3D* features, guint16* shuffle_table);
+void Cells3D_F2(double a0, double a1, double a2, double* f, const CellFeatures3D* features, guint16* shuffle_table);
+guint32 Cells3D_Id(double a0, double a1, double a2, const CellFeatures3D* features, guint16* shuffle_table);
+guint32 Cells3D_Delta(double a0, double a1, double a2, double* p_delta, const CellFeatures3D* features, guint16* shuffle_table);
 
-CellBasisCache3D* InitCellBasis3D();
-void FinishCellBasis3D(CellBasisCache3D* cache);
+/* Repeats every 'period_x' along a0 and 'period_y' along a1 (see MAP_PERIODIC) */
+double Cells3DPeriodic_F1(double a0, double a1, double a2, gint32 period_x, gint32 period_y, const CellFeatures3D* features, guint16* shuffle_table);
+void Cells3DPeriodic_F2(double a0, double a1, double a2, gint32 period_x, gint32 period_y, double* f, const CellFeatures3D* features, guint16* shuffle_table);
+guint32 Cells3DPeriodic_Id(double a0, double a1, double a2, gint32 period_x, gint32 period_y, const CellFeatures3D* features, guint16* shuffle_table);
+guint32 Cells3DPeriodic_Delta(double a0, double a1, double a2, gint32 period_x, gint32 period_y, double* p_delta, const CellFeatures3D* features, guint16* shuffle_table);
+
+const CellFeatures3D* InitCellBasis3D();
 
 /* 4D */
-typedef struct CellBasisCache4DStr
+/* The feature points of every cell seed (SoA), see InitCellBasis4D() */
+typedef struct CellFeatures4DStr
 {
-  double p[4][MAX_FEATURES];
-  guint32 id[MAX_FEATURES];
-  guint32 last_seed;
-} CellBasisCache4D;
+  double p[4][TABLE_SIZE * FEATURE_STRIDE];
+  guint32 id[TABLE_SIZE * FEATURE_STRIDE];
+} CellFeatures4D;
 
-void Cells4D(double a0, double a1, double a2, double a3, gint32 max_order, double* f, double (*p_delta)[4], guint32* p_id, CellBasisCache4D* cache);
+/* See Cells3D_F1() */
+double Cells4D_F1(double a0, double a1, double a2, double a3, const CellFeatures4D* features, guint16* shuffle_table);
+void Cells4D_F2(double a0, double a1, double a2, double a3, double* f, const CellFeatures4D* features, guint16* shuffle_table);
+guint32 Cells4D_Id(double a0, double a1, double a2, double a3, const CellFeatures4D* features, guint16* shuffle_table);
+guint32 Cells4D_Delta(double a0, double a1, double a2, double a3, double* p_delta, const CellFeatures4D* features, guint16* shuffle_table);
 
-CellBasisCache4D* InitCellBasis4D();
-void FinishCellBasis4D(CellBasisCache4D* cache);
+const CellFeatures4D* InitCellBasis4D();
 
 /* 5D */
-typedef struct CellBasisCache5DStr
+/* The feature points of every cell seed (SoA), see InitCellBasis5D() */
+typedef struct CellFeatures5DStr
 {
-  double p[5][MAX_FEATURES];
-  guint32 id[MAX_FEATURES];
-  guint32 last_seed;
-} CellBasisCache5D;
+  double p[5][TABLE_SIZE * FEATURE_STRIDE];
+  guint32 id[TABLE_SIZE * FEATURE_STRIDE];
+} CellFeatures5D;
 
-void Cells5D(double a0, double a1, double a2, double a3, double a4, gint32 max_order, double* f, double (*p_delta)[5], guint32* p_id, CellBasisCache5D* cache);
+/* See Cells3D_F1() */
+double Cells5D_F1(double a0, double a1, double a2, double a3, double a4, const CellFeatures5D* features, guint16* shuffle_table);
+void Cells5D_F2(double a0, double a1, double a2, double a3, double a4, double* f, const CellFeatures5D* features, guint16* shuffle_table);
+guint32 Cells5D_Id(double a0, double a1, double a2, double a3, double a4, const CellFeatures5D* features, guint16* shuffle_table);
+guint32 Cells5D_Delta(double a0, double a1, double a2, double a3, double a4, double* p_delta, const CellFeatures5D* features, guint16* shuffle_table);
 
-CellBasisCache5D* InitCellBasis5D();
-void FinishCellBasis5D(CellBasisCache5D* cache);
+const CellFeatures5D* InitCellBasis5D();
@@ -45,12 +45,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#ifdef CALIBRATE
 #include <glib.h>
 #include <string.h>
-#else
-#include <libgimp/gimp.h>
-#endif
 
 #include "cell.h"
 #include "cell_int.h"
@@ -60,38 +56,199 @@
 #define DENSITY_ADJUSTMENT 1.0
 /*0.398150*/
 
-static void AddSamples_3D(gint32 xi, gint32 yi, gint32 zi, gint32 max_order, double at[3], double* F, double (*delta)[3], guint32* ID, int order[], CellBasisCache3D* cache);
+/* Adds the feature points of one cell to the search in Cells3DBody(), keeping
+ * only what the caller needs. 'F' holds the squared distances */
+typedef void AddSamples3DFn(gint32 xi, gint32 yi, gint32 zi, double at[3], double* F, double* delta, guint32* ID, gint32 period_x, gint32 period_y, const CellFeatures3D* features, guint16* shuffle_table);
 
-CellBasisCache3D*
+static CellFeatures3D* cell_features = NULL;
+
+/* The feature points of a cell only depend on its seed, and there are just
+ * TABLE_SIZE of them (see Hash1()), so they are all generated here once and
+ * the table is shared by everyone */
+const CellFeatures3D*
 InitCellBasis3D()
 {
-  CellBasisCache3D* cache = NULL;
+  static gsize initialized = 0;
+  CellFeatures3D* table = NULL;
+  guint32 seed = 0, s = 0, j = 0, end = 0;
+
+  if (g_once_init_enter(&initialized))
+  {
+    table = AllocFeatureTable(sizeof(CellFeatures3D));
+
+    for (s = 0; s < TABLE_SIZE; s++)
+    {
+      seed = RANDOM(s);
+      end = s * FEATURE_STRIDE + Poisson_count[s & 255];
+      for (j = s * FEATURE_STRIDE; j < end; j++)
+      {
+        table->id[j] = seed;
+
+        seed = RANDOM(seed);
+        table->p[0][j] = (seed + 0.5) * (1.0 / 4294967296.0);
 
-  cache = calloc(1, sizeof(CellBasisCache3D) * (3 * 3 * 3));
+        seed = RANDOM(seed);
+        table->p[1][j] = (seed + 0.5) * (1.0 / 4294967296.0);
 
-  return cache;
+        seed = RANDOM(seed);
+        table->p[2][j] = (seed + 0.5) * (1.0 / 4294967296.0);
+
+        seed = RANDOM(seed);
+      }
+    }
+
+    cell_features = table;
+    g_once_init_leave(&initialized, 1);
+  }
+
+  return cell_features;
 }
 
-void
-FinishCellBasis3D(CellBasisCache3D* cache)
+/* Points 'p' and 'id' at the feature points of cell (xi, yi, zi) and returns how
+ * many there are. Only the seed of the cell is wrapped, its feature points
+ * stay in place */
+static inline G_GNUC_ALWAYS_INLINE gint32
+CellPoints3D(gint32 xi, gint32 yi, gint32 zi, gint32 period_x, gint32 period_y, const CellFeatures3D* features, guint16* shuffle_table, const double** p, const guint32** id)
 {
-  free(cache);
+  guint32 seed = 0;
+
+  seed = Hash3(period_x ? WrapIndex(xi, period_x) : xi, period_y ? WrapIndex(yi, period_y) : yi, zi);
+
+  p[0] = features->p[0] + seed * FEATURE_STRIDE;
+  p[1] = features->p[1] + seed * FEATURE_STRIDE;
+  p[2] = features->p[2] + seed * FEATURE_STRIDE;
+  *id = features->id + seed * FEATURE_STRIDE;
+  return Poisson_count[seed & 255];
 }
 
-void
-Cells3D(double a0, double a1, double a2, gint32 max_order, double* f, double (*p_delta)[3], guint32* p_id, CellBasisCache3D* cache)
+/* The squared distance from 'at' to point 'j' of cell (xi, yi, zi), and its offset 'd' */
+static inline G_GNUC_ALWAYS_INLINE double
+PointDistance3D(gint32 xi, gint32 yi, gint32 zi, double at[3], const double** p, gint32 j, double* d)
+{
+  d[0] = p[0][j] + xi - at[0];
+  d[1] = p[1][j] + yi - at[1];
+  d[2] = p[2][j] + zi - at[2];
+
+  return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+}
+
+/* Keeps F1 */
+static inline G_GNUC_ALWAYS_INLINE void
+AddF1_3D(gint32 xi, gint32 yi, gint32 zi, double at[3], double* F, double* delta, guint32* ID, gint32 period_x, gint32 period_y, const CellFeatures3D* features, guint16* shuffle_table)
+{
+  double d[3] = {NAN};
+  double d2 = NAN;
+  gint32 count = 0, j = 0;
+  const double* p[3] = {NULL};
+  const guint32* id = NULL;
+
+  count = CellPoints3D(xi, yi, zi, period_x, period_y, features, shuffle_table, p, &id);
+
+  for (j = 0; j < count; j++)
+  {
+    d2 = PointDistance3D(xi, yi, zi, at, p, j, d);
+
+    if (d2 < F[0])
+    {
+      F[0] = d2;
+    }
+  }
+}
+
+/* Keeps F1 and F2 */
+static inline G_GNUC_ALWAYS_INLINE void
+AddF2_3D(gint32 xi, gint32 yi, gint32 zi, double at[3], double* F, double* delta, guint32* ID, gint32 period_x, gint32 period_y, const CellFeatures3D* features, guint16* shuffle_table)
+{
+  double d[3] = {NAN};
+  double d2 = NAN;
+  gint32 count = 0, j = 0;
+  const double* p[3] = {NULL};
+  const guint32* id = NULL;
+
+  count = CellPoints3D(xi, yi, zi, period_x, period_y, features, shuffle_table, p, &id);
+
+  for (j = 0; j < count; j++)
+  {
+    d2 = PointDistance3D(xi, yi, zi, at, p, j, d);
+
+    if (d2 < F[1])
+    {
+      if (d2 < F[0])
+      {
+        F[1] = F[0];
+        F[0] = d2;
+      }
+      else
+        F[1] = d2;
+    }
+  }
+}
+
+/* Keeps F1 and the id of its point */
+static inline G_GNUC_ALWAYS_INLINE void
+AddId_3D(gint32 xi, gint32 yi, gint32 zi, double at[3], double* F, double* delta, guint32* ID, gint32 period_x, gint32 period_y, const CellFeatures3D* features, guint16* shuffle_table)
+{
+  double d[3] = {NAN};
+  double d2 = NAN;
+  gint32 count = 0, j = 0;
+  const double* p[3] = {NULL};
+  const guint32* id = NULL;
+
+  count = CellPoints3D(xi, yi, zi, period_x, period_y, features, shuffle_table, p, &id);
+
+  for (j = 0; j < count; j++)
+  {
+    d2 = PointDistance3D(xi, yi, zi, at, p, j, d);
+
+    if (d2 < F[0])
+    {
+      F[0] = d2;
+      *ID = id[j];
+    }
+  }
+}
+
+/* Keeps F1 and the id and offset of its point */
+static inline G_GNUC_ALWAYS_INLINE void
+AddDelta_3D(gint32 xi, gint32 yi, gint32 zi, double at[3], double* F, double* delta, guint32* ID, gint32 period_x, gint32 period_y, const CellFeatures3D* features, guint16* shuffle_table)
+{
+  double d[3] = {NAN};
+  double d2 = NAN;
+  gint32 count = 0, j = 0;
+  const double* p[3] = {NULL};
+  const guint32* id = NULL;
+
+  count = CellPoints3D(xi, yi, zi, period_x, period_y, features, shuffle_table, p, &id);
+
+  for (j = 0; j < count; j++)
+  {
+    d2 = PointDistance3D(xi, yi, zi, at, p, j, d);
+
+    if (d2 < F[0])
+    {
+      F[0] = d2;
+      *ID = id[j];
+      delta[0] = d[0];
+      delta[1] = d[1];
+      delta[2] = d[2];
+    }
+  }
+}
+
+/* Searches the cells around the sample for the 'max_order' nearest feature
+ * points, skipping the cells farther away than the current F[max_order - 1]. A
+ * period of 0 doesn't wrap, see CellPoints3D(). Inlined into each entry point,
+ * and so is its adder */
+static inline G_GNUC_ALWAYS_INLINE void
+Cells3DBody(double a0, double a1, double a2, gint32 max_order, AddSamples3DFn* add, double* f, double* delta, guint32* id, gint32 period_x, gint32 period_y, const CellFeatures3D* features, guint16* shuffle_table)
 {
   double pa0 = NAN, pa1 = NAN, pa2 = NAN, ma0 = NAN, ma1 = NAN, ma2 = NAN;
   double new_at[3] = {NAN};
-  gint32 i = 0, j = 0;
+  gint32 i = 0;
   gint32 int_at[3] = {0};
   gint32 int_at_p[3] = {0};
   gint32 int_at_m[3] = {0};
   double* f_max = NULL;
-  double delta[4][3] = {NAN};
-  guint32 id[4] = {0};
-
-  int order[] = {0, 1, 2, 3, 4};
 
   for (i = 0; i < max_order; i++)
     f[i] = 999999.9;
@@ -126,175 +283,140 @@ Cells3D(double a0, double a1, double a2, gint32 max_order, double* f, double (*p
 
   /* as generated by gen_tests.py */
 
-  AddSamples_3D(int_at[0], int_at[1], int_at[2], max_order, new_at, f, delta, id, order, cache);
+  add(int_at[0], int_at[1], int_at[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
 
   if (pa0 < *f_max)
-    AddSamples_3D(int_at_p[0], int_at[1], int_at[2], max_order, new_at, f, delta, id, order, cache + 1);
+    add(int_at_p[0], int_at[1], int_at[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa1 < *f_max)
-    AddSamples_3D(int_at[0], int_at_p[1], int_at[2], max_order, new_at, f, delta, id, order, cache + 2);
+    add(int_at[0], int_at_p[1], int_at[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa2 < *f_max)
-    AddSamples_3D(int_at[0], int_at[1], int_at_p[2], max_order, new_at, f, delta, id, order, cache + 3);
+    add(int_at[0], int_at[1], int_at_p[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma2 < *f_max)
-    AddSamples_3D(int_at[0], int_at[1], int_at_m[2], max_order, new_at, f, delta, id, order, cache + 4);
+    add(int_at[0], int_at[1], int_at_m[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma1 < *f_max)
-    AddSamples_3D(int_at[0], int_at_m[1], int_at[2], max_order, new_at, f, delta, id, order, cache + 5);
+    add(int_at[0], int_at_m[1], int_at[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma0 < *f_max)
-    AddSamples_3D(int_at_m[0], int_at[1], int_at[2], max_order, new_at, f, delta, id, order, cache + 6);
+    add(int_at_m[0], int_at[1], int_at[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa0 + pa1 < *f_max)
-    AddSamples_3D(int_at_p[0], int_at_p[1], int_at[2], max_order, new_at, f, delta, id, order, cache + 7);
+    add(int_at_p[0], int_at_p[1], int_at[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa0 + pa2 < *f_max)
-    AddSamples_3D(int_at_p[0], int_at[1], int_at_p[2], max_order, new_at, f, delta, id, order, cache + 8);
+    add(int_at_p[0], int_at[1], int_at_p[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa0 + ma2 < *f_max)
-    AddSamples_3D(int_at_p[0], int_at[1], int_at_m[2], max_order, new_at, f, delta, id, order, cache + 9);
+    add(int_at_p[0], int_at[1], int_at_m[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa0 + ma1 < *f_max)
-    AddSamples_3D(int_at_p[0], int_at_m[1], int_at[2], max_order, new_at, f, delta, id, order, cache + 10);
+    add(int_at_p[0], int_at_m[1], int_at[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa1 + pa2 < *f_max)
-    AddSamples_3D(int_at[0], int_at_p[1], int_at_p[2], max_order, new_at, f, delta, id, order, cache + 11);
+    add(int_at[0], int_at_p[1], int_at_p[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa1 + ma2 < *f_max)
-    AddSamples_3D(int_at[0], int_at_p[1], int_at_m[2], max_order, new_at, f, delta, id, order, cache + 12);
+    add(int_at[0], int_at_p[1], int_at_m[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma1 + pa2 < *f_max)
-    AddSamples_3D(int_at[0], int_at_m[1], int_at_p[2], max_order, new_at, f, delta, id, order, cache + 13);
+    add(int_at[0], int_at_m[1], int_at_p[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma1 + ma2 < *f_max)
-    AddSamples_3D(int_at[0], int_at_m[1], int_at_m[2], max_order, new_at, f, delta, id, order, cache + 14);
+    add(int_at[0], int_at_m[1], int_at_m[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma0 + pa1 < *f_max)
-    AddSamples_3D(int_at_m[0], int_at_p[1], int_at[2], max_order, new_at, f, delta, id, order, cache + 15);
+    add(int_at_m[0], int_at_p[1], int_at[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma0 + pa2 < *f_max)
-    AddSamples_3D(int_at_m[0], int_at[1], int_at_p[2], max_order, new_at, f, delta, id, order, cache + 16);
+    add(int_at_m[0], int_at[1], int_at_p[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma0 + ma2 < *f_max)
-    AddSamples_3D(int_at_m[0], int_at[1], int_at_m[2], max_order, new_at, f, delta, id, order, cache + 17);
+    add(int_at_m[0], int_at[1], int_at_m[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma0 + ma1 < *f_max)
-    AddSamples_3D(int_at_m[0], int_at_m[1], int_at[2], max_order, new_at, f, delta, id, order, cache + 18);
+    add(int_at_m[0], int_at_m[1], int_at[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa0 + pa1 + pa2 < *f_max)
-    AddSamples_3D(int_at_p[0], int_at_p[1], int_at_p[2], max_order, new_at, f, delta, id, order, cache + 19);
+    add(int_at_p[0], int_at_p[1], int_at_p[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa0 + pa1 + ma2 < *f_max)
-    AddSamples_3D(int_at_p[0], int_at_p[1], int_at_m[2], max_order, new_at, f, delta, id, order, cache + 20);
+    add(int_at_p[0], int_at_p[1], int_at_m[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa0 + ma1 + pa2 < *f_max)
-    AddSamples_3D(int_at_p[0], int_at_m[1], int_at_p[2], max_order, new_at, f, delta, id, order, cache + 21);
+    add(int_at_p[0], int_at_m[1], int_at_p[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (pa0 + ma1 + ma2 < *f_max)
-    AddSamples_3D(int_at_p[0], int_at_m[1], int_at_m[2], max_order, new_at, f, delta, id, order, cache + 22);
+    add(int_at_p[0], int_at_m[1], int_at_m[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma0 + pa1 + pa2 < *f_max)
-    AddSamples_3D(int_at_m[0], int_at_p[1], int_at_p[2], max_order, new_at, f, delta, id, order, cache + 23);
+    add(int_at_m[0], int_at_p[1], int_at_p[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma0 + pa1 + ma2 < *f_max)
-    AddSamples_3D(int_at_m[0], int_at_p[1], int_at_m[2], max_order, new_at, f, delta, id, order, cache + 24);
+    add(int_at_m[0], int_at_p[1], int_at_m[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma0 + ma1 + pa2 < *f_max)
-    AddSamples_3D(int_at_m[0], int_at_m[1], int_at_p[2], max_order, new_at, f, delta, id, order, cache + 25);
+    add(int_at_m[0], int_at_m[1], int_at_p[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
   if (ma0 + ma1 + ma2 < *f_max)
-    AddSamples_3D(int_at_m[0], int_at_m[1], int_at_m[2], max_order, new_at, f, delta, id, order, cache + 26);
-
-  for (i = 0; i < max_order; i++)
-  {
-    f[i] = sqrt(f[i]) * (1.0 / DENSITY_ADJUSTMENT);
-    j = order[i];
-    p_delta[i][0] = delta[j][0] * (1.0 / DENSITY_ADJUSTMENT);
-    p_delta[i][1] = delta[j][1] * (1.0 / DENSITY_ADJUSTMENT);
-    p_delta[i][2] = delta[j][2] * (1.0 / DENSITY_ADJUSTMENT);
-    p_id[i] = id[j];
-  }
-
-  return;
+    add(int_at_m[0], int_at_m[1], int_at_m[2], new_at, f, delta, id, period_x, period_y, features, shuffle_table);
 }
 
-static void
-AddSamples_3D(gint32 xi, gint32 yi, gint32 zi, gint32 max_order, double at[3], double* F, double (*delta)[3], guint32* ID, int order[], CellBasisCache3D* cache)
+double
+Cells3D_F1(double a0, double a1, double a2, const CellFeatures3D* features, guint16* shuffle_table)
 {
+  double f = NAN;
 
-  double dx = NAN, dy = NAN, dz = NAN, fx = NAN, fy = NAN, fz = NAN, d2 = NAN;
-  gint32 count = 0, i = 0, j = 0, index = 0;
-  int slot = 0;
-  guint32 seed = 0, this_id = 0;
-
-  seed = Hash3(xi, yi, zi);
-  count = Poisson_count[seed & 255];
-
-  if ((seed != cache->last_seed) || (seed == 0))
-  {
-    cache->last_seed = seed;
-
-    seed = RANDOM(seed);
-    for (j = 0; j < count; j++)
-    {
-      cache->id[j] = this_id = seed;
-
-      seed = RANDOM(seed);
-      fx = (seed + 0.5) * (1.0 / 4294967296.0);
-
-      seed = RANDOM(seed);
-      fy = (seed + 0.5) * (1.0 / 4294967296.0);
-
-      seed = RANDOM(seed);
-      fz = (seed + 0.5) * (1.0 / 4294967296.0);
-
-      seed = RANDOM(seed);
-
-      dx = (cache->p[0][j] = fx) + xi - at[0];
-      dy = (cache->p[1][j] = fy) + yi - at[1];
-      dz = (cache->p[2][j] = fz) + zi - at[2];
-
-      d2 = dx * dx + dy * dy + dz * dz;
-
-      i = max_order - 1;
-
-      if (d2 < F[i])
-      {
-
-        index = max_order;
-        while (index > 0 && d2 < F[index - 1])
-          index--;
-
-        slot = order[i];
-
-        while ((i--) > index)
-        {
-          F[i + 1] = F[i];
-          order[i + 1] = order[i];
-        }
+  Cells3DBody(a0, a1, a2, 1, AddF1_3D, &f, NULL, NULL, 0, 0, features, shuffle_table);
+  return sqrt(f) * (1.0 / DENSITY_ADJUSTMENT);
+}
 
-        F[index] = d2;
-        order[index] = slot;
+void
+Cells3D_F2(double a0, double a1, double a2, double* f, const CellFeatures3D* features, guint16* shuffle_table)
+{
+  Cells3DBody(a0, a1, a2, 2, AddF2_3D, f, NULL, NULL, 0, 0, features, shuffle_table);
+  f[0] = sqrt(f[0]) * (1.0 / DENSITY_ADJUSTMENT);
+  f[1] = sqrt(f[1]) * (1.0 / DENSITY_ADJUSTMENT);
+}
 
-        ID[slot] = this_id;
-        delta[slot][0] = dx;
-        delta[slot][1] = dy;
-        delta[slot][2] = dz;
-      }
-    }
-  }
-  else
-  {
-    for (j = 0; j < count; j++)
-    {
-      dx = cache->p[0][j] + xi - at[0];
-      dy = cache->p[1][j] + yi - at[1];
-      dz = cache->p[2][j] + zi - at[2];
+guint32
+Cells3D_Id(double a0, double a1, double a2, const CellFeatures3D* features, guint16* shuffle_table)
+{
+  double f = NAN;
+  guint32 id = 0;
 
-      d2 = dx * dx + dy * dy + dz * dz;
+  Cells3DBody(a0, a1, a2, 1, AddId_3D, &f, NULL, &id, 0, 0, features, shuffle_table);
+  return id;
+}
 
-      i = max_order - 1;
+guint32
+Cells3D_Delta(double a0, double a1, double a2, double* p_delta, const CellFeatures3D* features, guint16* shuffle_table)
+{
+  double f = NAN;
+  double delta[3] = {NAN};
+  guint32 id = 0;
+
+  Cells3DBody(a0, a1, a2, 1, AddDelta_3D, &f, delta, &id, 0, 0, features, shuffle_table);
+  p_delta[0] = delta[0] * (1.0 / DENSITY_ADJUSTMENT);
+  p_delta[1] = delta[1] * (1.0 / DENSITY_ADJUSTMENT);
+  p_delta[2] = delta[2] * (1.0 / DENSITY_ADJUSTMENT);
+  return id;
+}
 
-      if (d2 < F[i])
-      {
-        index = max_order;
-        while (index > 0 && d2 < F[index - 1])
-          index--;
+double
+Cells3DPeriodic_F1(double a0, double a1, double a2, gint32 period_x, gint32 period_y, const CellFeatures3D* features, guint16* shuffle_table)
+{
+  double f = NAN;
 
-        slot = order[i];
+  Cells3DBody(a0, a1, a2, 1, AddF1_3D, &f, NULL, NULL, period_x, period_y, features, shuffle_table);
+  return sqrt(f) * (1.0 / DENSITY_ADJUSTMENT);
+}
 
-        while ((i--) > index)
-        {
-          F[i + 1] = F[i];
-          order[i + 1] = order[i];
-        }
+void
+Cells3DPeriodic_F2(double a0, double a1, double a2, gint32 period_x, gint32 period_y, double* f, const CellFeatures3D* features, guint16* shuffle_table)
+{
+  Cells3DBody(a0, a1, a2, 2, AddF2_3D, f, NULL, NULL, period_x, period_y, features, shuffle_table);
+  f[0] = sqrt(f[0]) * (1.0 / DENSITY_ADJUSTMENT);
+  f[1] = sqrt(f[1]) * (1.0 / DENSITY_ADJUSTMENT);
+}
 
-        F[index] = d2;
-        order[index] = slot;
+guint32
+Cells3DPeriodic_Id(double a0, double a1, double a2, gint32 period_x, gint32 period_y, const CellFeatures3D* features, guint16* shuffle_table)
+{
+  double f = NAN;
+  guint32 id = 0;
 
-        ID[slot] = cache->id[j];
-        delta[slot][0] = dx;
-        delta[slot][1] = dy;
-        delta[slot][2] = dz;
-      }
-    }
-  }
+  Cells3DBody(a0, a1, a2, 1, AddId_3D, &f, NULL, &id, period_x, period_y, features, shuffle_table);
+  return id;
+}
 
-  return;
+guint32
+Cells3DPeriodic_Delta(double a0, double a1, double a2, gint32 period_x, gint32 period_y, double* p_delta, const CellFeatures3D* features, guint16* shuffle_table)
+{
+  double f = NAN;
+  double delta[3] = {NAN};
+  guint32 id = 0;
+
+  Cells3DBody(a0, a1, a2, 1, AddDelta_3D, &f, delta, &id, period_x, period_y, features, shuffle_table);
+  p_delta[0] = delta[0] * (1.0 / DENSITY_ADJUSTMENT);
+  p_delta[1] = delta[1] * (1.0 / DENSITY_ADJUSTMENT);
+  p_delta[2] = delta[2] * (1.0 / DENSITY_ADJUSTMENT);
+  return id;
 }
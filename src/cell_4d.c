@@ -45,12 +45,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#ifdef CALIBRATE
 #include <glib.h>
 #include <string.h>
-#else
-#include <libgimp/gimp.h>
-#endif
 
 #include "cell.h"
 #include "cell_int.h"
@@ -60,38 +56,203 @@
 #define DENSITY_ADJUSTMENT 1.0
 /*0.398150*/
 
-static void AddSamples_4D(gint32 xi, gint32 yi, gint32 zi, gint32 si, gint32 max_order, double at[4], double* F, double (*delta)[4], guint32* ID, int order[], CellBasisCache4D* cache);
+/* Adds the feature points of one cell to the search in Cells4DBody(), keeping
+ * only what the caller needs. 'F' holds the squared distances */
+typedef void AddSamples4DFn(gint32 xi, gint32 yi, gint32 zi, gint32 si, double at[4], double* F, double* delta, guint32* ID, const CellFeatures4D* features, guint16* shuffle_table);
 
-CellBasisCache4D*
+static CellFeatures4D* cell_features = NULL;
+
+/* The feature points of a cell only depend on its seed, and there are just
+ * TABLE_SIZE of them (see Hash1()), so they are all generated here once and
+ * the table is shared by everyone */
+const CellFeatures4D*
 InitCellBasis4D()
 {
-  CellBasisCache4D* cache = NULL;
+  static gsize initialized = 0;
+  CellFeatures4D* table = NULL;
+  guint32 seed = 0, s = 0, j = 0, end = 0;
+
+  if (g_once_init_enter(&initialized))
+  {
+    table = AllocFeatureTable(sizeof(CellFeatures4D));
+
+    for (s = 0; s < TABLE_SIZE; s++)
+    {
+      seed = RANDOM(s);
+      end = s * FEATURE_STRIDE + Poisson_count[s & 255];
+      for (j = s * FEATURE_STRIDE; j < end; j++)
+      {
+        table->id[j] = seed;
+
+        seed = RANDOM(seed);
+        table->p[0][j] = (seed + 0.5) * (1.0 / 4294967296.0);
+
+        seed = RANDOM(seed);
+        table->p[1][j] = (seed + 0.5) * (1.0 / 4294967296.0);
+
+        seed = RANDOM(seed);
+        table->p[2][j] = (seed + 0.5) * (1.0 / 4294967296.0);
+
+        seed = RANDOM(seed);
+        table->p[3][j] = (seed + 0.5) * (1.0 / 4294967296.0);
+
+        seed = RANDOM(seed);
+      }
+    }
+
+    cell_features = table;
+    g_once_init_leave(&initialized, 1);
+  }
+
+  return cell_features;
+}
+
+/* Points 'p' and 'id' at the feature points of cell (xi, yi, zi, si) and returns
+ * how many there are */
+static inline G_GNUC_ALWAYS_INLINE gint32
+CellPoints4D(gint32 xi, gint32 yi, gint32 zi, gint32 si, const CellFeatures4D* features, guint16* shuffle_table, const double** p, const guint32** id)
+{
+  guint32 seed = 0;
 
-  cache = calloc(1, sizeof(CellBasisCache4D) * (3 * 3 * 3 * 3));
+  seed = Hash4(xi, yi, zi, si);
 
-  return cache;
+  p[0] = features->p[0] + seed * FEATURE_STRIDE;
+  p[1] = features->p[1] + seed * FEATURE_STRIDE;
+  p[2] = features->p[2] + seed * FEATURE_STRIDE;
+  p[3] = features->p[3] + seed * FEATURE_STRIDE;
+  *id = features->id + seed * FEATURE_STRIDE;
+  return Poisson_count[seed & 255];
 }
 
-void
-FinishCellBasis4D(CellBasisCache4D* cache)
+/* The squared distance from 'at' to point 'j' of cell (xi, yi, zi, si), and its offset 'd' */
+static inline G_GNUC_ALWAYS_INLINE double
+PointDistance4D(gint32 xi, gint32 yi, gint32 zi, gint32 si, double at[4], const double** p, gint32 j, double* d)
 {
-  free(cache);
+  d[0] = p[0][j] + xi - at[0];
+  d[1] = p[1][j] + yi - at[1];
+  d[2] = p[2][j] + zi - at[2];
+  d[3] = p[3][j] + si - at[3];
+
+  return d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + d[3] * d[3];
 }
 
-void
-Cells4D(double a0, double a1, double a2, double a3, gint32 max_order, double* f, double (*p_delta)[4], guint32* p_id, CellBasisCache4D* cache)
+/* Keeps F1 */
+static inline G_GNUC_ALWAYS_INLINE void
+AddF1_4D(gint32 xi, gint32 yi, gint32 zi, gint32 si, double at[4], double* F, double* delta, guint32* ID, const CellFeatures4D* features, guint16* shuffle_table)
+{
+  double d[4] = {NAN};
+  double d2 = NAN;
+  gint32 count = 0, j = 0;
+  const double* p[4] = {NULL};
+  const guint32* id = NULL;
+
+  count = CellPoints4D(xi, yi, zi, si, features, shuffle_table, p, &id);
+
+  for (j = 0; j < count; j++)
+  {
+    d2 = PointDistance4D(xi, yi, zi, si, at, p, j, d);
+
+    if (d2 < F[0])
+    {
+      F[0] = d2;
+    }
+  }
+}
+
+/* Keeps F1 and F2 */
+static inline G_GNUC_ALWAYS_INLINE void
+AddF2_4D(gint32 xi, gint32 yi, gint32 zi, gint32 si, double at[4], double* F, double* delta, guint32* ID, const CellFeatures4D* features, guint16* shuffle_table)
+{
+  double d[4] = {NAN};
+  double d2 = NAN;
+  gint32 count = 0, j = 0;
+  const double* p[4] = {NULL};
+  const guint32* id = NULL;
+
+  count = CellPoints4D(xi, yi, zi, si, features, shuffle_table, p, &id);
+
+  for (j = 0; j < count; j++)
+  {
+    d2 = PointDistance4D(xi, yi, zi, si, at, p, j, d);
+
+    if (d2 < F[1])
+    {
+      if (d2 < F[0])
+      {
+        F[1] = F[0];
+        F[0] = d2;
+      }
+      else
+        F[1] = d2;
+    }
+  }
+}
+
+/* Keeps F1 and the id of its point */
+static inline G_GNUC_ALWAYS_INLINE void
+AddId_4D(gint32 xi, gint32 yi, gint32 zi, gint32 si, double at[4], double* F, double* delta, guint32* ID, const CellFeatures4D* features, guint16* shuffle_table)
+{
+  double d[4] = {NAN};
+  double d2 = NAN;
+  gint32 count = 0, j = 0;
+  const double* p[4] = {NULL};
+  const guint32* id = NULL;
+
+  count = CellPoints4D(xi, yi, zi, si, features, shuffle_table, p, &id);
+
+  for (j = 0; j < count; j++)
+  {
+    d2 = PointDistance4D(xi, yi, zi, si, at, p, j, d);
+
+    if (d2 < F[0])
+    {
+      F[0] = d2;
+      *ID = id[j];
+    }
+  }
+}
+
+/* Keeps F1 and the id and offset of its point */
+static inline G_GNUC_ALWAYS_INLINE void
+AddDelta_4D(gint32 xi, gint32 yi, gint32 zi, gint32 si, double at[4], double* F, double* delta, guint32* ID, const CellFeatures4D* features, guint16* shuffle_table)
+{
+  double d[4] = {NAN};
+  double d2 = NAN;
+  gint32 count = 0, j = 0;
+  const double* p[4] = {NULL};
+  const guint32* id = NULL;
+
+  count = CellPoints4D(xi, yi, zi, si, features, shuffle_table, p, &id);
+
+  for (j = 0; j < count; j++)
+  {
+    d2 = PointDistance4D(xi, yi, zi, si, at, p, j, d);
+
+    if (d2 < F[0])
+    {
+      F[0] = d2;
+      *ID = id[j];
+      delta[0] = d[0];
+      delta[1] = d[1];
+      delta[2] = d[2];
+      delta[3] = d[3];
+    }
+  }
+}
+
+/* Searches the cells around the sample for the 'max_order' nearest feature
+ * points, skipping the cells farther away than the current F[max_order - 1].
+ * Inlined into each entry point, and so is its adder */
+static inline G_GNUC_ALWAYS_INLINE void
+Cells4DBody(double a0, double a1, double a2, double a3, gint32 max_order, AddSamples4DFn* add, double* f, double* delta, guint32* id, const CellFeatures4D* features, guint16* shuffle_table)
 {
   double pa0 = NAN, pa1 = NAN, pa2 = NAN, pa3 = NAN, ma0 = NAN, ma1 = NAN, ma2 = NAN, ma3 = NAN;
   double new_at[4] = {NAN};
-  gint32 i = 0, j = 0;
+  gint32 i = 0;
   gint32 int_at[4] = {0};
   gint32 int_at_p[4] = {0};
   gint32 int_at_m[4] = {0};
   double* f_max = NULL;
-  double delta[4][4] = {NAN};
-  guint32 id[4] = {0};
-
-  int order[] = {0, 1, 2, 3, 4};
 
   for (i = 0; i < max_order; i++)
     f[i] = 999999.9;
@@ -132,291 +293,209 @@ Cells4D(double a0, double a1, double a2, double a3, gint32 max_order, double* f,
   f_max = f + (max_order - 1);
 
   /* as generated by gen_tests.py */
-  AddSamples_4D(int_at[0], int_at[1], int_at[2], int_at[3], max_order, new_at, f, delta, id, order, cache);
+  add(int_at[0], int_at[1], int_at[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
 
   if (pa0 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at[1], int_at[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 1);
+    add(int_at_p[0], int_at[1], int_at[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa1 < *f_max)
-    AddSamples_4D(int_at[0], int_at_p[1], int_at[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 2);
+    add(int_at[0], int_at_p[1], int_at[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa2 < *f_max)
-    AddSamples_4D(int_at[0], int_at[1], int_at_p[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 3);
+    add(int_at[0], int_at[1], int_at_p[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa3 < *f_max)
-    AddSamples_4D(int_at[0], int_at[1], int_at[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 4);
+    add(int_at[0], int_at[1], int_at[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma3 < *f_max)
-    AddSamples_4D(int_at[0], int_at[1], int_at[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 5);
+    add(int_at[0], int_at[1], int_at[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma2 < *f_max)
-    AddSamples_4D(int_at[0], int_at[1], int_at_m[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 6);
+    add(int_at[0], int_at[1], int_at_m[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (ma1 < *f_max)
-    AddSamples_4D(int_at[0], int_at_m[1], int_at[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 7);
+    add(int_at[0], int_at_m[1], int_at[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at[1], int_at[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 8);
+    add(int_at_m[0], int_at[1], int_at[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa1 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_p[1], int_at[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 9);
+    add(int_at_p[0], int_at_p[1], int_at[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa2 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at[1], int_at_p[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 10);
+    add(int_at_p[0], int_at[1], int_at_p[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at[1], int_at[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 11);
+    add(int_at_p[0], int_at[1], int_at[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at[1], int_at[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 12);
+    add(int_at_p[0], int_at[1], int_at[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma2 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at[1], int_at_m[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 13);
+    add(int_at_p[0], int_at[1], int_at_m[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma1 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_m[1], int_at[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 14);
+    add(int_at_p[0], int_at_m[1], int_at[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa1 + pa2 < *f_max)
-    AddSamples_4D(int_at[0], int_at_p[1], int_at_p[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 15);
+    add(int_at[0], int_at_p[1], int_at_p[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa1 + pa3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_p[1], int_at[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 16);
+    add(int_at[0], int_at_p[1], int_at[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa1 + ma3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_p[1], int_at[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 17);
+    add(int_at[0], int_at_p[1], int_at[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (pa1 + ma2 < *f_max)
-    AddSamples_4D(int_at[0], int_at_p[1], int_at_m[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 18);
+    add(int_at[0], int_at_p[1], int_at_m[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa2 + pa3 < *f_max)
-    AddSamples_4D(int_at[0], int_at[1], int_at_p[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 19);
+    add(int_at[0], int_at[1], int_at_p[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa2 + ma3 < *f_max)
-    AddSamples_4D(int_at[0], int_at[1], int_at_p[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 20);
+    add(int_at[0], int_at[1], int_at_p[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma2 + pa3 < *f_max)
-    AddSamples_4D(int_at[0], int_at[1], int_at_m[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 21);
+    add(int_at[0], int_at[1], int_at_m[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma2 + ma3 < *f_max)
-    AddSamples_4D(int_at[0], int_at[1], int_at_m[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 22);
+    add(int_at[0], int_at[1], int_at_m[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma1 + pa2 < *f_max)
-    AddSamples_4D(int_at[0], int_at_m[1], int_at_p[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 23);
+    add(int_at[0], int_at_m[1], int_at_p[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (ma1 + pa3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_m[1], int_at[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 24);
+    add(int_at[0], int_at_m[1], int_at[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma1 + ma3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_m[1], int_at[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 25);
+    add(int_at[0], int_at_m[1], int_at[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma1 + ma2 < *f_max)
-    AddSamples_4D(int_at[0], int_at_m[1], int_at_m[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 26);
+    add(int_at[0], int_at_m[1], int_at_m[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa1 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_p[1], int_at[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 27);
+    add(int_at_m[0], int_at_p[1], int_at[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa2 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at[1], int_at_p[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 28);
+    add(int_at_m[0], int_at[1], int_at_p[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at[1], int_at[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 29);
+    add(int_at_m[0], int_at[1], int_at[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at[1], int_at[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 30);
+    add(int_at_m[0], int_at[1], int_at[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma2 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at[1], int_at_m[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 31);
+    add(int_at_m[0], int_at[1], int_at_m[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma1 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_m[1], int_at[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 32);
+    add(int_at_m[0], int_at_m[1], int_at[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa1 + pa2 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_p[1], int_at_p[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 33);
+    add(int_at_p[0], int_at_p[1], int_at_p[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa1 + pa3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_p[1], int_at[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 34);
+    add(int_at_p[0], int_at_p[1], int_at[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa1 + ma3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_p[1], int_at[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 35);
+    add(int_at_p[0], int_at_p[1], int_at[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa1 + ma2 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_p[1], int_at_m[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 36);
+    add(int_at_p[0], int_at_p[1], int_at_m[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa2 + pa3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at[1], int_at_p[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 37);
+    add(int_at_p[0], int_at[1], int_at_p[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa2 + ma3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at[1], int_at_p[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 38);
+    add(int_at_p[0], int_at[1], int_at_p[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma2 + pa3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at[1], int_at_m[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 39);
+    add(int_at_p[0], int_at[1], int_at_m[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma2 + ma3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at[1], int_at_m[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 40);
+    add(int_at_p[0], int_at[1], int_at_m[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma1 + pa2 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_m[1], int_at_p[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 41);
+    add(int_at_p[0], int_at_m[1], int_at_p[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma1 + pa3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_m[1], int_at[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 42);
+    add(int_at_p[0], int_at_m[1], int_at[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma1 + ma3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_m[1], int_at[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 43);
+    add(int_at_p[0], int_at_m[1], int_at[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma1 + ma2 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_m[1], int_at_m[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 44);
+    add(int_at_p[0], int_at_m[1], int_at_m[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa1 + pa2 + pa3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_p[1], int_at_p[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 45);
+    add(int_at[0], int_at_p[1], int_at_p[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa1 + pa2 + ma3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_p[1], int_at_p[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 46);
+    add(int_at[0], int_at_p[1], int_at_p[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (pa1 + ma2 + pa3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_p[1], int_at_m[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 47);
+    add(int_at[0], int_at_p[1], int_at_m[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa1 + ma2 + ma3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_p[1], int_at_m[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 48);
+    add(int_at[0], int_at_p[1], int_at_m[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma1 + pa2 + pa3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_m[1], int_at_p[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 49);
+    add(int_at[0], int_at_m[1], int_at_p[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma1 + pa2 + ma3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_m[1], int_at_p[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 50);
+    add(int_at[0], int_at_m[1], int_at_p[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma1 + ma2 + pa3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_m[1], int_at_m[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 51);
+    add(int_at[0], int_at_m[1], int_at_m[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma1 + ma2 + ma3 < *f_max)
-    AddSamples_4D(int_at[0], int_at_m[1], int_at_m[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 52);
+    add(int_at[0], int_at_m[1], int_at_m[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa1 + pa2 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_p[1], int_at_p[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 53);
+    add(int_at_m[0], int_at_p[1], int_at_p[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa1 + pa3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_p[1], int_at[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 54);
+    add(int_at_m[0], int_at_p[1], int_at[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa1 + ma3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_p[1], int_at[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 55);
+    add(int_at_m[0], int_at_p[1], int_at[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa1 + ma2 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_p[1], int_at_m[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 56);
+    add(int_at_m[0], int_at_p[1], int_at_m[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa2 + pa3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at[1], int_at_p[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 57);
+    add(int_at_m[0], int_at[1], int_at_p[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa2 + ma3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at[1], int_at_p[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 58);
+    add(int_at_m[0], int_at[1], int_at_p[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma2 + pa3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at[1], int_at_m[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 59);
+    add(int_at_m[0], int_at[1], int_at_m[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma2 + ma3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at[1], int_at_m[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 60);
+    add(int_at_m[0], int_at[1], int_at_m[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma1 + pa2 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_m[1], int_at_p[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 61);
+    add(int_at_m[0], int_at_m[1], int_at_p[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma1 + pa3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_m[1], int_at[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 62);
+    add(int_at_m[0], int_at_m[1], int_at[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma1 + ma3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_m[1], int_at[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 63);
+    add(int_at_m[0], int_at_m[1], int_at[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma1 + ma2 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_m[1], int_at_m[2], int_at[3], max_order, new_at, f, delta, id, order, cache + 64);
+    add(int_at_m[0], int_at_m[1], int_at_m[2], int_at[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa1 + pa2 + pa3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_p[1], int_at_p[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 65);
+    add(int_at_p[0], int_at_p[1], int_at_p[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa1 + pa2 + ma3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_p[1], int_at_p[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 66);
+    add(int_at_p[0], int_at_p[1], int_at_p[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa1 + ma2 + pa3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_p[1], int_at_m[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 67);
+    add(int_at_p[0], int_at_p[1], int_at_m[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + pa1 + ma2 + ma3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_p[1], int_at_m[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 68);
+    add(int_at_p[0], int_at_p[1], int_at_m[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma1 + pa2 + pa3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_m[1], int_at_p[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 69);
+    add(int_at_p[0], int_at_m[1], int_at_p[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma1 + pa2 + ma3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_m[1], int_at_p[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 70);
+    add(int_at_p[0], int_at_m[1], int_at_p[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma1 + ma2 + pa3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_m[1], int_at_m[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 71);
+    add(int_at_p[0], int_at_m[1], int_at_m[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (pa0 + ma1 + ma2 + ma3 < *f_max)
-    AddSamples_4D(int_at_p[0], int_at_m[1], int_at_m[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 72);
+    add(int_at_p[0], int_at_m[1], int_at_m[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa1 + pa2 + pa3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_p[1], int_at_p[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 73);
+    add(int_at_m[0], int_at_p[1], int_at_p[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa1 + pa2 + ma3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_p[1], int_at_p[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 74);
+    add(int_at_m[0], int_at_p[1], int_at_p[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa1 + ma2 + pa3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_p[1], int_at_m[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 75);
+    add(int_at_m[0], int_at_p[1], int_at_m[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + pa1 + ma2 + ma3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_p[1], int_at_m[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 76);
+    add(int_at_m[0], int_at_p[1], int_at_m[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma1 + pa2 + pa3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_m[1], int_at_p[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 77);
+    add(int_at_m[0], int_at_m[1], int_at_p[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma1 + pa2 + ma3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_m[1], int_at_p[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 78);
+    add(int_at_m[0], int_at_m[1], int_at_p[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma1 + ma2 + pa3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_m[1], int_at_m[2], int_at_p[3], max_order, new_at, f, delta, id, order, cache + 79);
+    add(int_at_m[0], int_at_m[1], int_at_m[2], int_at_p[3], new_at, f, delta, id, features, shuffle_table);
   if (ma0 + ma1 + ma2 + ma3 < *f_max)
-    AddSamples_4D(int_at_m[0], int_at_m[1], int_at_m[2], int_at_m[3], max_order, new_at, f, delta, id, order, cache + 80);
-
-  for (i = 0; i < max_order; i++)
-  {
-    f[i] = sqrt(f[i]) * (1.0 / DENSITY_ADJUSTMENT);
-    j = order[i];
-    p_delta[i][0] = delta[j][0] * (1.0 / DENSITY_ADJUSTMENT);
-    p_delta[i][1] = delta[j][1] * (1.0 / DENSITY_ADJUSTMENT);
-    p_delta[i][2] = delta[j][2] * (1.0 / DENSITY_ADJUSTMENT);
-    p_delta[i][3] = delta[j][3] * (1.0 / DENSITY_ADJUSTMENT);
-    p_id[i] = id[j];
-  }
-
-  return;
+    add(int_at_m[0], int_at_m[1], int_at_m[2], int_at_m[3], new_at, f, delta, id, features, shuffle_table);
 }
 
-static void
-AddSamples_4D(gint32 xi, gint32 yi, gint32 zi, gint32 si, gint32 max_order, double at[4], double* F, double (*delta)[4], guint32* ID, int order[], CellBasisCache4D* cache)
-{
-
-  double dx = NAN, dy = NAN, dz = NAN, ds = NAN, fx = NAN, fy = NAN, fz = NAN, fs = NAN, d2 = NAN;
-  gint32 count = 0, i = 0, j = 0, index = 0;
-  int slot = 0;
-  guint32 seed = 0, this_id = 0;
-
-  seed = Hash4(xi, yi, zi, si);
-  count = Poisson_count[seed & 255];
-
-  if ((seed != cache->last_seed) || (seed == 0))
-  {
-    cache->last_seed = seed;
-
-    seed = RANDOM(seed);
-    for (j = 0; j < count; j++)
-    {
-      cache->id[j] = this_id = seed;
-
-      seed = RANDOM(seed);
-      fx = (seed + 0.5) * (1.0 / 4294967296.0);
-
-      seed = RANDOM(seed);
-      fy = (seed + 0.5) * (1.0 / 4294967296.0);
-
-      seed = RANDOM(seed);
-      fz = (seed + 0.5) * (1.0 / 4294967296.0);
 
-      seed = RANDOM(seed);
-      fs = (seed + 0.5) * (1.0 / 4294967296.0);
-
-      seed = RANDOM(seed);
-
-      dx = (cache->p[0][j] = fx) + xi - at[0];
-      dy = (cache->p[1][j] = fy) + yi - at[1];
-      dz = (cache->p[2][j] = fz) + zi - at[2];
-      ds = (cache->p[3][j] = fs) + si - at[3];
-
-      d2 = dx * dx + dy * dy + dz * dz + ds * ds;
-
-      i = max_order - 1;
-
-      if (d2 < F[i])
-      {
-
-        index = max_order;
-        while (index > 0 && d2 < F[index - 1])
-          index--;
-
-        slot = order[i];
-
-        while ((i--) > index)
-        {
-          F[i + 1] = F[i];
-          order[i + 1] = order[i];
-        }
-
-        F[index] = d2;
-        order[index] = slot;
+double
+Cells4D_F1(double a0, double a1, double a2, double a3, const CellFeatures4D* features, guint16* shuffle_table)
+{
+  double f = NAN;
 
-        ID[slot] = this_id;
-        delta[slot][0] = dx;
-        delta[slot][1] = dy;
-        delta[slot][2] = dz;
-        delta[slot][3] = ds;
-      }
-    }
-  }
-  else
-  {
-    for (j = 0; j < count; j++)
-    {
-      dx = cache->p[0][j] + xi - at[0];
-      dy = cache->p[1][j] + yi - at[1];
-      dz = cache->p[2][j] + zi - at[2];
-      ds = cache->p[3][j] + si - at[3];
+  Cells4DBody(a0, a1, a2, a3, 1, AddF1_4D, &f, NULL, NULL, features, shuffle_table);
+  return sqrt(f) * (1.0 / DENSITY_ADJUSTMENT);
+}
 
-      d2 = dx * dx + dy * dy + dz * dz + ds * ds;
+void
+Cells4D_F2(double a0, double a1, double a2, double a3, double* f, const CellFeatures4D* features, guint16* shuffle_table)
+{
+  Cells4DBody(a0, a1, a2, a3, 2, AddF2_4D, f, NULL, NULL, features, shuffle_table);
+  f[0] = sqrt(f[0]) * (1.0 / DENSITY_ADJUSTMENT);
+  f[1] = sqrt(f[1]) * (1.0 / DENSITY_ADJUSTMENT);
+}
 
-      i = max_order - 1;
+guint32
+Cells4D_Id(double a0, double a1, double a2, double a3, const CellFeatures4D* features, guint16* shuffle_table)
+{
+  double f = NAN;
+  guint32 id = 0;
 
-      if (d2 < F[i])
-      {
-        index = max_order;
-        while (index > 0 && d2 < F[index - 1])
-          index--;
-
-        slot = order[i];
-
-        while ((i--) > index)
-        {
-          F[i + 1] = F[i];
-          order[i + 1] = order[i];
-        }
-
-        F[index] = d2;
-        order[index] = slot;
-
-        ID[slot] = cache->id[j];
-        delta[slot][0] = dx;
-        delta[slot][1] = dy;
-        delta[slot][2] = dz;
-        delta[slot][3] = ds;
-      }
-    }
-  }
+  Cells4DBody(a0, a1, a2, a3, 1, AddId_4D, &f, NULL, &id, features, shuffle_table);
+  return id;
+}
 
-  return;
+guint32
+Cells4D_Delta(double a0, double a1, double a2, double a3, double* p_delta, const CellFeatures4D* features, guint16* shuffle_table)
+{
+  double f = NAN;
+  double delta[4] = {NAN};
+  guint32 id = 0;
+
+  Cells4DBody(a0, a1, a2, a3, 1, AddDelta_4D, &f, delta, &id, features, shuffle_table);
+  p_delta[0] = delta[0] * (1.0 / DENSITY_ADJUSTMENT);
+  p_delta[1] = delta[1] * (1.0 / DENSITY_ADJUSTMENT);
+  p_delta[2] = delta[2] * (1.0 / DENSITY_ADJUSTMENT);
+  p_delta[3] = delta[3] * (1.0 / DENSITY_ADJUSTMENT);
+  return id;
 }
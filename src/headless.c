@@ -0,0 +1,383 @@
+/*  Felimage Noise Plugin for the GIMP
+ *  Copyright (C) 2005 Guillermo Romero Franco <drirr_gato@users.sourceforge.net>
+ *
+ *  This file is part of the Felimage Noise Plugin for the GIMP
+ *
+ *  Felimage Noise Plugin for the Gimp is free software;
+ *  you can redistribute it and/or modify it under the terms of
+ *  the GNU General Public License as published by the Free Software
+ *  Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Felimage Noise Plugin for the Gimp is distributed in the hope
+ *  that it will be useful, but WITHOUT ANY WARRANTY; without even
+ *  the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ *  PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with fimg-noise; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* felimage-render: renders a preset without the GIMP, for batch jobs.
+ *
+ *   felimage-render [options] preset.fnp output.{png,pfm,raw}
+ *
+ * The image is rendered in the same tiles the plug-in uses, so the noise is
+ * the same the plug-in renders on an image of that size. The GIMP's colors
+ * aren't there, so the foreground and background colors are options (black
+ * and white by default) and gradient presets use them too. Warp presets need
+ * an image to warp, and aren't supported */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib.h>
+
+#include "basis.h"
+#include "loadsaveconf.h"
+#include "main.h"
+#include "render.h"
+
+#define TILE_SIZE 64 /* the default tile size of the GIMP */
+
+enum
+{
+  FORMAT_PNG,
+  FORMAT_PFM,
+  FORMAT_RAW
+};
+
+static gint width = 512;
+static gint height = 512;
+static gint seed = -1;
+static gboolean gray = FALSE;
+static gchar* format_name = NULL;
+static gchar* fg_name = NULL;
+static gchar* bg_name = NULL;
+
+static GOptionEntry entries[] = {
+  {"width", 'W', 0, G_OPTION_ARG_INT, &width, "Width of the image (512)", "PIXELS"},
+  {"height", 'H', 0, G_OPTION_ARG_INT, &height, "Height of the image (512)", "PIXELS"},
+  {"seed", 's', 0, G_OPTION_ARG_INT, &seed, "Seed, instead of the one of the preset", "SEED"},
+  {"gray", 'g', 0, G_OPTION_ARG_NONE, &gray, "Render a grayscale image", NULL},
+  {"format", 'f', 0, G_OPTION_ARG_STRING, &format_name, "png, pfm or raw (from the file name by default)", "FORMAT"},
+  {"foreground", 0, 0, G_OPTION_ARG_STRING, &fg_name, "Foreground color (#000000)", "#RRGGBB"},
+  {"background", 0, 0, G_OPTION_ARG_STRING, &bg_name, "Background color (#ffffff)", "#RRGGBB"},
+  {NULL}};
+
+static int
+ParseColor(const gchar* name, double* rgba)
+{
+  guint r = 0, g = 0, b = 0;
+
+  if (!name)
+  {
+    return 0;
+  }
+  if (sscanf(name, "#%02x%02x%02x", &r, &g, &b) != 3)
+  {
+    return -1;
+  }
+
+  rgba[0] = r / 255.0;
+  rgba[1] = g / 255.0;
+  rgba[2] = b / 255.0;
+  rgba[3] = 1.0;
+  return 0;
+}
+
+static int
+GetFormat(const gchar* name, const gchar* filename)
+{
+  const char* names[] = {"png", "pfm", "raw", NULL};
+  const char* ext = NULL;
+  int i = 0;
+
+  if (!name)
+  {
+    ext = strrchr(filename, '.');
+    name = ext ? ext + 1 : "";
+  }
+
+  for (i = 0; names[i]; i++)
+  {
+    if (!g_ascii_strcasecmp(name, names[i]))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* Renders the whole image, 'channels' floats per pixel */
+static float*
+RenderPreset(PluginState* state, const double* fg, const double* bg, int* channels)
+{
+  RenderData rdat = {0};
+  float* image = NULL;
+  const float* src = NULL;
+  float* dst = NULL;
+  int x = 0, y = 0, tile_w = 0, tile_h = 0;
+  int i = 0, j = 0;
+  int stride = 0;
+
+  InitRenderData(&rdat);
+  AssociateRenderToState(&rdat, state);
+  SetRenderColors(&rdat, fg, bg);
+
+  if (state->color_src == COL_CHANNELS)
+  {
+    SetRenderBuffer(&rdat, width, height, 0, 0, MODE_RAW, gray ? 2 : 4);
+  }
+  else
+  {
+    SetRenderBuffer(&rdat, width, height, 0, 0, gray ? MODE_GRAYSCALE : MODE_COLOR, 0);
+  }
+  InitBasis(&rdat);
+  stride = rdat.pixel_stride;
+
+  image = g_new(float, (gsize)width * height * stride);
+
+  for (y = 0; y < height; y += TILE_SIZE)
+  {
+    for (x = 0; x < width; x += TILE_SIZE)
+    {
+      tile_w = MIN(TILE_SIZE, width - x);
+      tile_h = MIN(TILE_SIZE, height - y);
+
+      SetRenderRegion(&rdat, tile_w, tile_h, x, y);
+      if (state->color_src == COL_CHANNELS)
+      {
+        RenderChannels(&rdat);
+      }
+      else
+      {
+        RenderLow(&rdat, 0);
+      }
+
+      src = rdat.buffer;
+      for (j = 0; j < tile_h; j++)
+      {
+        dst = image + ((gsize)(y + j) * width + x) * stride;
+        for (i = 0; i < tile_w * stride; i++)
+        {
+          dst[i] = *src++;
+        }
+      }
+    }
+  }
+
+  DeinitRenderData(&rdat);
+  DeinitBasis(&rdat);
+
+  *channels = stride;
+  return image;
+}
+
+static guchar
+ToByte(float value)
+{
+  return (guchar)CLAMP(value * 255.0f + 0.5f, 0.0f, 255.0f);
+}
+
+static int
+WritePNG(const gchar* filename, const float* image, int channels)
+{
+  GdkPixbuf* pixbuf = NULL;
+  GError* error = NULL;
+  guchar* row = NULL;
+  const float* p = NULL;
+  int x = 0, y = 0;
+  int res = 0;
+
+  pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+
+  for (y = 0; y < height; y++)
+  {
+    row = gdk_pixbuf_get_pixels(pixbuf) + y * gdk_pixbuf_get_rowstride(pixbuf);
+    p = image + (gsize)y * width * channels;
+    for (x = 0; x < width; x++, p += channels, row += 4)
+    {
+      if (channels == 4)
+      {
+        row[0] = ToByte(p[0]);
+        row[1] = ToByte(p[1]);
+        row[2] = ToByte(p[2]);
+        row[3] = ToByte(p[3]);
+      }
+      else /* gray and alpha */
+      {
+        row[0] = row[1] = row[2] = ToByte(p[0]);
+        row[3] = ToByte(p[1]);
+      }
+    }
+  }
+
+  if (!gdk_pixbuf_save(pixbuf, filename, "png", &error, NULL))
+  {
+    g_printerr("Can't write %s: %s\n", filename, error->message);
+    g_error_free(error);
+    res = -1;
+  }
+
+  g_object_unref(pixbuf);
+  return res;
+}
+
+/* Portable float map, without the alpha. The rows go from the bottom up */
+static int
+WritePFM(const gchar* filename, const float* image, int channels)
+{
+  FILE* file = NULL;
+  const float* p = NULL;
+  int colors = 0;
+  int x = 0, y = 0;
+  guint32 one = 1;
+
+  file = fopen(filename, "wb");
+  if (!file)
+  {
+    g_printerr("Can't write %s\n", filename);
+    return -1;
+  }
+
+  colors = (channels == 4) ? 3 : 1;
+  /* a negative scale means little endian */
+  fprintf(file, "%s\n%d %d\n%s\n", (colors == 3) ? "PF" : "Pf", width, height, (*(guchar*)&one) ? "-1.0" : "1.0");
+
+  for (y = height - 1; y >= 0; y--)
+  {
+    p = image + (gsize)y * width * channels;
+    for (x = 0; x < width; x++, p += channels)
+    {
+      fwrite(p, sizeof(float), colors, file);
+    }
+  }
+
+  fclose(file);
+  return 0;
+}
+
+/* the buffer as it is rendered: native floats, RGBA or gray and alpha */
+static int
+WriteRaw(const gchar* filename, const float* image, int channels)
+{
+  FILE* file = NULL;
+  gsize size = 0;
+
+  file = fopen(filename, "wb");
+  if (!file)
+  {
+    g_printerr("Can't write %s\n", filename);
+    return -1;
+  }
+
+  size = (gsize)width * height * channels;
+  if (fwrite(image, sizeof(float), size, file) != size)
+  {
+    g_printerr("Can't write %s\n", filename);
+    fclose(file);
+    return -1;
+  }
+
+  fclose(file);
+  return 0;
+}
+
+int
+main(int argc, char* argv[])
+{
+  GOptionContext* context = NULL;
+  GError* error = NULL;
+  PluginState state = {0};
+  double fg[4] = {0.0, 0.0, 0.0, 1.0};
+  double bg[4] = {1.0, 1.0, 1.0, 1.0};
+  float* image = NULL;
+  int channels = 0;
+  int format = 0;
+  int res = 0;
+
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+  g_type_init();
+#endif
+
+  context = g_option_context_new("PRESET OUTPUT - render a Felimage Noise preset");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  if (argc != 3)
+  {
+    g_printerr("Usage: %s [options] PRESET OUTPUT, see --help\n", argv[0]);
+    return 1;
+  }
+
+  if (width <= 0 || height <= 0)
+  {
+    g_printerr("Bad image size %dx%d\n", width, height);
+    return 1;
+  }
+
+  if (ParseColor(fg_name, fg) < 0 || ParseColor(bg_name, bg) < 0)
+  {
+    g_printerr("Colors must be like #RRGGBB\n");
+    return 1;
+  }
+
+  format = GetFormat(format_name, argv[2]);
+  if (format < 0)
+  {
+    g_printerr("Unknown output format, use png, pfm or raw\n");
+    return 1;
+  }
+
+  if (LoadConfig(argv[1], &state) < 0)
+  {
+    g_printerr("Can't read %s\n", argv[1]);
+    return 1;
+  }
+
+  if (state.color_src == COL_WARP)
+  {
+    g_printerr("%s warps the image, there's no image to warp here\n", argv[1]);
+    return 1;
+  }
+
+  if (seed >= 0)
+  {
+    state.seed = seed;
+  }
+  else if (state.random_seed)
+  {
+    state.seed = g_random_int();
+  }
+
+  image = RenderPreset(&state, fg, bg, &channels);
+
+  switch (format)
+  {
+    case FORMAT_PNG:
+      res = WritePNG(argv[2], image, channels);
+      break;
+    case FORMAT_PFM:
+      res = WritePFM(argv[2], image, channels);
+      break;
+    case FORMAT_RAW:
+      res = WriteRaw(argv[2], image, channels);
+      break;
+  }
+
+  g_free(image);
+
+  return res ? 1 : 0;
+}
@@ -68,12 +68,14 @@
 #include "main.h"
 #include "poisson.h"
 #include "render.h"
+#include "render_gimp.h"
 #include "snoise.h"
 
 /*  Constants  */
 
 #define SPIN_BUTTON_WIDTH 100
 #define RANDOM_SEED_WIDTH 100
+#define PREVIEW_FIRST_STEP 8 /* the first preview pass samples one pixel in 8x8 */
 
 /* created with:
  *
@@ -83,6 +85,8 @@
 
 #include "link_icon.h"
 
+typedef struct PreviewWorkerStr PreviewWorker;
+
 typedef struct
 {
   PluginState* state;
@@ -90,6 +94,8 @@ typedef struct
   RenderData* rdat;
   int has_alpha;
   int bpp;
+  PreviewWorker* worker;     /* renders the preview, see PreviewUpdate() */
+  volatile gint preview_gen; /* of the latest preview request */
 } CallbackData;
 
 typedef struct
@@ -194,6 +200,8 @@ static void OnPresetChange(GtkComboBox* widget, gpointer user_data);
 static void OnSavePreset(GtkButton* button, gpointer user_data);
 /*static void OnLoadPreset(GtkButton *button, gpointer user_data);*/
 
+static void StartPreviewWorker(CallbackData* data);
+static void StopPreviewWorker(CallbackData* data);
 static void PreviewUpdate(GimpPreview* preview, gpointer user_data);
 
 static void
@@ -549,9 +557,10 @@ dialog(gint32 image_ID,
   RenderData rdat = {0};
   PluginState tmp_state = *state;
 
+  /* collects the dirty flags of the callbacks and makes the colors, the
+   * preview worker has the RenderData it renders with */
   InitRenderData(&rdat);
   AssociateRenderToState(&rdat, &tmp_state);
-  InitBasis(&rdat);
 
   preview = gimp_drawable_preview_new(drawable, &tmp_state.show_preview);
   gtk_widget_show_all(preview);
@@ -562,6 +571,7 @@ dialog(gint32 image_ID,
   cb_data.bpp = drawable->bpp;
   cb_data.has_alpha = gimp_drawable_has_alpha(drawable->drawable_id);
 
+  StartPreviewWorker(&cb_data);
   g_signal_connect(preview, "invalidated", G_CALLBACK(PreviewUpdate), &cb_data);
 
   gimp_ui_init(PLUGIN_NAME, TRUE);
@@ -664,7 +674,7 @@ dialog(gint32 image_ID,
 
   /* Basis function */
 
-  basis = gimp_int_combo_box_new(_("Lattice Noise"), BASIS_LNOISE, _("Lattice Turbulence"), BASIS_LTURB_1, _("Sparse Noise"), BASIS_SNOISE, _("Sparse Turbulence"), BASIS_STURB_1, _("Skin"), BASIS_CELLS_1, _("Puffy"), BASIS_CELLS_2, _("Fractured"), BASIS_CELLS_3, _("Crystals"), BASIS_CELLS_4, _("Galvalized"), BASIS_CELLS_5, NULL);
+  basis = gimp_int_combo_box_new(_("Lattice Noise"), BASIS_LNOISE, _("Lattice Turbulence"), BASIS_LTURB_1, _("Sparse Noise"), BASIS_SNOISE, _("Sparse Turbulence"), BASIS_STURB_1, _("Skin"), BASIS_CELLS_1, _("Puffy"), BASIS_CELLS_2, _("Fractured"), BASIS_CELLS_3, _("Crystals"), BASIS_CELLS_4, _("Galvalized"), BASIS_CELLS_5, _("Simplex Noise"), BASIS_SIMPLEX, _("Simplex Turbulence"), BASIS_SIMPLEX_TURB_1, NULL);
   gtk_box_pack_start(GTK_BOX(page_basis), basis, FALSE, FALSE, 0);
   g_signal_connect(basis, "changed", G_CALLBACK(OnBasisChange), &cb_data);
 
@@ -704,7 +714,7 @@ dialog(gint32 image_ID,
   gtk_table_set_col_spacings(GTK_TABLE(table), 15);
 
   /* Mapping */
-  mapping = gimp_int_combo_box_new(_("Planar"), MAP_PLANAR, _("Tileable planar"), MAP_TILED, _("Spherical"), MAP_SPHERICAL, NULL);
+  mapping = gimp_int_combo_box_new(_("Planar"), MAP_PLANAR, _("Tileable planar"), MAP_TILED, _("Spherical"), MAP_SPHERICAL, _("Tileable periodic"), MAP_PERIODIC, NULL);
 
   gimp_table_attach_aligned(GTK_TABLE(table), 0, 0, _("Mapping"), 0.0, 0.5, mapping, 1, FALSE);
   g_signal_connect(mapping, "changed", G_CALLBACK(OnMappingChange), &cb_data);
@@ -932,8 +942,10 @@ dialog(gint32 image_ID,
 
   run = (gimp_dialog_run(GIMP_DIALOG(dlg)) == GTK_RESPONSE_OK);
 
+  StopPreviewWorker(&cb_data);
+
   DeinitRenderData(&rdat);
-  DeinitBasis();
+  DeinitBasis(&rdat);
 
   if (run)
   {
@@ -1479,67 +1491,339 @@ OnSavePreset(GtkButton* button, gpointer user_data)
 
 /*****************************************************************************/
 
+/* The preview is rendered by a worker thread, so the dialog keeps responding
+ * while it works. Every invalidation bumps the generation and replaces the
+ * pending request, so a burst of them makes a single render, and the render
+ * in flight gives up at its next row (see SetRenderCancel()).
+ *
+ * The render is progressive: a coarse pass first, then finer ones until it is
+ * at full resolution. The raw values kept by the worker's RenderData let each
+ * pass sample only the pixels the earlier ones didn't, and skip the passes
+ * that are already cached.
+ *
+ * Everything that talks to the GIMP stays in the GTK thread: it reads the
+ * drawable and gets the colors with each request (see SetRenderGimpColors()),
+ * and blends or warps and draws each pass the worker hands back */
+
+typedef struct
+{
+  gint generation;
+  PluginState state;
+  guint dirty;          /* set by the callbacks since the last request */
+  double fg[4], bg[4];  /* the colors, see SetRenderColors() */
+  double* grad_samples; /* and the gradient, see SetRenderGradient() */
+  int grad_count;
+  guchar* pixels;       /* the drawable under the preview */
+  int bpp;
+  int rgn_x, rgn_y, rgn_w, rgn_h;
+  int buf_x, buf_y, buf_w, buf_h; /* the mask bounds */
+} PreviewRequest;
+
+struct PreviewWorkerStr
+{
+  GThread* thread;
+  GMutex lock;
+  GCond wake;
+  PreviewRequest* request; /* the latest one not taken yet */
+  GSList* results;         /* the passes not drawn yet */
+  int quit;
+
+  /* only used by the worker thread */
+  RenderData rdat;
+  PluginState state;
+};
+
+typedef struct
+{
+  CallbackData* data;
+  gint generation;
+  PluginState state;
+  RenderData rdat; /* the pass, see CloneRenderData() */
+  guchar* pixels;  /* the drawable under the preview, gets the pass blended in */
+  int bpp;
+  int width, height;
+  guint source; /* the idle source drawing it */
+} PreviewResult;
+
 static void
-PreviewUpdate(GimpPreview* preview, gpointer user_data)
+FreePreviewRequest(PreviewRequest* request)
 {
-  GimpDrawable* drawable = NULL;
-  gint bpp = 0;
-  gint rgn_x = 0, rgn_y = 0;
-  guchar* buffer = NULL;
-  gint rgn_w = 0;
-  gint rgn_h = 0;
+  g_free(request->grad_samples);
+  g_free(request->pixels);
+  g_free(request);
+}
 
-  GimpPixelRgn srcPR = {0};
+static void
+FreePreviewResult(PreviewResult* result)
+{
+  DeinitRenderData(&result->rdat);
+  g_free(result->pixels);
+  g_free(result);
+}
+
+static void
+SetPreviewRegion(RenderData* rdat, const PreviewRequest* request)
+{
+  SetRenderBuffer(rdat, request->buf_w, request->buf_h, request->buf_x, request->buf_y, (request->bpp <= 2) ? MODE_GRAYSCALE : MODE_COLOR, 0);
+
+  switch (request->state.color_src)
+  {
+    case COL_CHANNELS:
+      SetRenderBufferMode(rdat, MODE_RAW, (request->bpp <= 2) ? 2 : 4);
+      break;
+    case COL_WARP:
+      SetRenderBufferMode(rdat, MODE_RAW, 1);
+      break;
+  }
+
+  SetRenderRegion(rdat, request->rgn_w, request->rgn_h, request->rgn_x, request->rgn_y);
+}
+
+static gboolean
+PreviewDraw(gpointer user_data)
+{
+  PreviewResult* result = (PreviewResult*)user_data;
+  CallbackData* data = result->data;
+  PreviewWorker* worker = data->worker;
+  GimpDrawable* drawable = NULL;
   GimpPixelFetcher* fetcher = NULL;
   gint stride = 0;
-  RenderData* rdat = ((CallbackData*)user_data)->rdat;
-  PluginState* state = ((CallbackData*)user_data)->state;
 
-  InitBasis(rdat);
+  g_mutex_lock(&worker->lock);
+  worker->results = g_slist_remove(worker->results, result);
+  g_mutex_unlock(&worker->lock);
 
-  /* Get drawable info */
-  drawable = gimp_drawable_preview_get_drawable(GIMP_DRAWABLE_PREVIEW(preview));
-  bpp = drawable->bpp;
+  /* drop the passes of outdated requests */
+  if (result->generation == g_atomic_int_get(&data->preview_gen) && gimp_preview_get_update(data->preview))
+  {
+    stride = result->width * result->bpp;
 
-  gimp_preview_get_position(preview, &rgn_x, &rgn_y);
-  gimp_preview_get_size(preview, &rgn_w, &rgn_h);
+    switch (result->state.color_src)
+    {
+      case COL_WARP:
+        drawable = gimp_drawable_preview_get_drawable(GIMP_DRAWABLE_PREVIEW(data->preview));
+        fetcher = GetPixelFetcher(&result->state, drawable);
+        Warp(&result->rdat, FetchGimpPixel, fetcher, result->pixels, stride, result->bpp, 2);
+        gimp_pixel_fetcher_destroy(fetcher);
+        break;
+      default:
+        Blend(&result->rdat, result->pixels, result->pixels, stride, result->bpp);
+        break;
+    }
 
-  gimp_pixel_rgn_init(&srcPR, drawable, rgn_x, rgn_y, rgn_w, rgn_h, FALSE, FALSE);
+    gimp_preview_draw_buffer(data->preview, result->pixels, stride);
+  }
 
-  stride = rgn_w * bpp;
+  FreePreviewResult(result);
 
-  buffer = g_new(guchar, stride * rgn_h);
+  return FALSE;
+}
 
-  gimp_pixel_rgn_get_rect(&srcPR, buffer, rgn_x, rgn_y, rgn_w, rgn_h);
+/* Renders the passes of 'request' until it is done or a newer one comes */
+static void
+PreviewRender(CallbackData* data, PreviewRequest* request)
+{
+  PreviewWorker* worker = data->worker;
+  RenderData* rdat = &worker->rdat;
+  PreviewResult* result = NULL;
+  int step = PREVIEW_FIRST_STEP;
+  int res = 0;
+
+  worker->state = request->state;
+  SetRenderStateDirty(rdat, request->dirty);
+  SetRenderCancel(rdat, &data->preview_gen, request->generation);
+  InitBasis(rdat);
 
-  SetRenderBufferForDrawable(rdat, drawable);
+  SetRenderColors(rdat, request->fg, request->bg);
+  SetRenderGradient(rdat, request->grad_samples, request->grad_count);
+  SetPreviewRegion(rdat, request);
 
-  switch (state->color_src)
+  while (step >= 1)
   {
-    case COL_CHANNELS:
-      SetRenderBufferMode(rdat, MODE_RAW, (drawable->bpp <= 2) ? 2 : 4);
-      SetRenderRegion(rdat, rgn_w, rgn_h, rgn_x, rgn_y);
-      RenderChannels(rdat);
-      Blend(rdat, buffer, buffer, stride, bpp);
-      break;
-    case COL_WARP:
-      SetRenderBufferMode(rdat, MODE_RAW, 1);
-      SetRenderRegion(rdat, rgn_w, rgn_h, rgn_x, rgn_y);
-      RenderWarp(rdat, 2);
+    SetRenderStep(rdat, step);
 
-      fetcher = GetPixelFetcher(state, drawable);
-      Warp(rdat, fetcher, buffer, stride, bpp, 2);
-      gimp_pixel_fetcher_destroy(fetcher);
+    switch (worker->state.color_src)
+    {
+      case COL_CHANNELS:
+        res = RenderChannels(rdat);
+        break;
+      case COL_WARP:
+        res = RenderWarp(rdat, 2);
+        break;
+      default:
+        res = RenderLow(rdat, 0);
+        break;
+    }
 
+    if (res < 0)
+    {
+      break; /* cancelled */
+    }
+
+    result = g_new0(PreviewResult, 1);
+    result->data = data;
+    result->generation = request->generation;
+    result->state = worker->state;
+    CloneRenderData(&result->rdat, rdat);
+    result->rdat.p_state = &result->state;
+    result->rdat.basis_ctx = NULL; /* may be gone by the time it is drawn */
+    result->rdat.buffer = RenderMemDup(rdat->buffer, rdat->buf_alloc);
+    result->rdat.buf_alloc = rdat->buf_alloc;
+    result->pixels = RenderMemDup(request->pixels, (gsize)request->rgn_w * request->rgn_h * request->bpp);
+    result->bpp = request->bpp;
+    result->width = request->rgn_w;
+    result->height = request->rgn_h;
+
+    /* listed before it can be drawn, so StopPreviewWorker() finds every pass */
+    g_mutex_lock(&worker->lock);
+    worker->results = g_slist_prepend(worker->results, result);
+    result->source = g_idle_add(PreviewDraw, result);
+    g_mutex_unlock(&worker->lock);
+
+    if (rdat->step_shown <= 1)
+    {
       break;
-    default:
-      SetRenderRegion(rdat, rgn_w, rgn_h, rgn_x, rgn_y);
-      RenderLow(rdat, 0);
-      Blend(rdat, buffer, buffer, stride, bpp);
-      break;
+    }
+    step = rdat->step_shown / 2;
   }
+}
 
-  gimp_preview_draw_buffer(preview, buffer, stride);
+static gpointer
+PreviewWorkerMain(gpointer user_data)
+{
+  CallbackData* data = (CallbackData*)user_data;
+  PreviewWorker* worker = data->worker;
+  PreviewRequest* request = NULL;
 
-  g_free(buffer);
+  g_mutex_lock(&worker->lock);
+  while (!worker->quit)
+  {
+    if (!worker->request)
+    {
+      g_cond_wait(&worker->wake, &worker->lock);
+      continue;
+    }
+    request = worker->request;
+    worker->request = NULL;
+    g_mutex_unlock(&worker->lock);
+
+    PreviewRender(data, request);
+    FreePreviewRequest(request);
+
+    g_mutex_lock(&worker->lock);
+  }
+  g_mutex_unlock(&worker->lock);
+
+  return NULL;
+}
+
+static void
+StartPreviewWorker(CallbackData* data)
+{
+  PreviewWorker* worker = NULL;
+
+  worker = g_new0(PreviewWorker, 1);
+  g_mutex_init(&worker->lock);
+  g_cond_init(&worker->wake);
+
+  InitRenderData(&worker->rdat);
+  AssociateRenderToState(&worker->rdat, &worker->state);
+  SetRenderKeepRaw(&worker->rdat, 1); /* most edits only change the shading */
+
+  data->worker = worker;
+  worker->thread = g_thread_new("preview", PreviewWorkerMain, data);
+}
+
+static void
+StopPreviewWorker(CallbackData* data)
+{
+  PreviewWorker* worker = data->worker;
+  PreviewResult* result = NULL;
+  GSList* iter = NULL;
+
+  g_signal_handlers_disconnect_by_func(data->preview, PreviewUpdate, data);
+
+  g_mutex_lock(&worker->lock);
+  worker->quit = 1;
+  if (worker->request)
+  {
+    FreePreviewRequest(worker->request);
+    worker->request = NULL;
+  }
+  g_atomic_int_inc(&data->preview_gen); /* cancels the render, and the passes not drawn yet */
+  g_cond_signal(&worker->wake);
+  g_mutex_unlock(&worker->lock);
+
+  g_thread_join(worker->thread);
+
+  /* the passes still waiting to be drawn would outlive the dialog */
+  for (iter = worker->results; iter; iter = iter->next)
+  {
+    result = (PreviewResult*)iter->data;
+    g_source_remove(result->source);
+    FreePreviewResult(result);
+  }
+  g_slist_free(worker->results);
+
+  DeinitRenderData(&worker->rdat);
+  DeinitBasis(&worker->rdat);
+  g_mutex_clear(&worker->lock);
+  g_cond_clear(&worker->wake);
+  g_free(worker);
+  data->worker = NULL;
+}
+
+static void
+PreviewUpdate(GimpPreview* preview, gpointer user_data)
+{
+  CallbackData* data = (CallbackData*)user_data;
+  PreviewWorker* worker = data->worker;
+  PreviewRequest* request = NULL;
+  GimpDrawable* drawable = NULL;
+  GimpPixelRgn srcPR = {0};
+  gint x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+
+  request = g_new0(PreviewRequest, 1);
+  request->state = *data->state;
+
+  /* the worker gets the dirty flags with the request */
+  request->dirty = data->rdat->dirty;
+
+  drawable = gimp_drawable_preview_get_drawable(GIMP_DRAWABLE_PREVIEW(preview));
+  request->bpp = drawable->bpp;
+
+  gimp_drawable_mask_bounds(drawable->drawable_id, &x1, &y1, &x2, &y2);
+  request->buf_x = x1;
+  request->buf_y = y1;
+  request->buf_w = x2 - x1;
+  request->buf_h = y2 - y1;
+
+  gimp_preview_get_position(preview, &request->rgn_x, &request->rgn_y);
+  gimp_preview_get_size(preview, &request->rgn_w, &request->rgn_h);
+
+  gimp_pixel_rgn_init(&srcPR, drawable, request->rgn_x, request->rgn_y, request->rgn_w, request->rgn_h, FALSE, FALSE);
+  request->pixels = g_new(guchar, request->rgn_w * request->rgn_h * request->bpp);
+  gimp_pixel_rgn_get_rect(&srcPR, request->pixels, request->rgn_x, request->rgn_y, request->rgn_w, request->rgn_h);
+
+  /* and the colors, which need the GIMP */
+  SetRenderGimpColors(data->rdat);
+  memcpy(request->fg, data->rdat->fg, sizeof(request->fg));
+  memcpy(request->bg, data->rdat->bg, sizeof(request->bg));
+  if (data->rdat->grad_samples)
+  {
+    request->grad_samples = RenderMemDup(data->rdat->grad_samples, data->rdat->grad_count * 4 * sizeof(double));
+    request->grad_count = data->rdat->grad_count;
+  }
+  data->rdat->dirty = 0; /* the dialog's RenderData only gathers them */
+
+  g_mutex_lock(&worker->lock);
+  if (worker->request)
+  {
+    request->dirty |= worker->request->dirty;
+    FreePreviewRequest(worker->request);
+  }
+  request->generation = g_atomic_int_add(&data->preview_gen, 1) + 1;
+  worker->request = request;
+  g_cond_signal(&worker->wake);
+  g_mutex_unlock(&worker->lock);
 }
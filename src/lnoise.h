@@ -24,3 +24,27 @@
 double LNoise3D(double x, double y, double z, guint16* shuffle_table);
 double LNoise4D(double x, double y, double z, double t, guint16* shuffle_table);
 double LNoise5D(double x, double y, double z, double s, double t, guint16* shuffle_table);
+
+/* Repeats every 'period_x' along x and 'period_y' along y (see MAP_PERIODIC) */
+double LNoise3DPeriodic(double x, double y, double z, int period_x, int period_y, guint16* shuffle_table);
+
+/* Span versions: evaluate n samples given as one array per axis */
+typedef void lnoise_3d_span_fn(int n, const double* x, const double* y, const double* z, double* value, guint16* shuffle_table);
+typedef void lnoise_4d_span_fn(int n, const double* x, const double* y, const double* z, const double* t, double* value, guint16* shuffle_table);
+typedef void lnoise_5d_span_fn(int n, const double* x, const double* y, const double* z, const double* s, const double* t, double* value, guint16* shuffle_table);
+
+void LNoise3DSpan(int n, const double* x, const double* y, const double* z, double* value, guint16* shuffle_table);
+void LNoise4DSpan(int n, const double* x, const double* y, const double* z, const double* t, double* value, guint16* shuffle_table);
+void LNoise5DSpan(int n, const double* x, const double* y, const double* z, const double* s, const double* t, double* value, guint16* shuffle_table);
+
+/* A set of span kernels for one instruction set. The scalar set is the
+ * reference, the vector sets give the same results */
+typedef struct
+{
+  const char* name;
+  lnoise_3d_span_fn* span_3d;
+  lnoise_4d_span_fn* span_4d;
+  lnoise_5d_span_fn* span_5d;
+} LNoiseKernels;
+
+const LNoiseKernels* GetLNoiseKernels(void);
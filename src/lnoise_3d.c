@@ -20,20 +20,17 @@
  *
  */
 
-#ifdef CALIBRATE
 #include <glib.h>
 #include <math.h>
 #include <string.h>
-#else
-#include <libgimp/gimp.h>
-#include <math.h>
-#endif
 
+#include "lnoise.h"
 #include "lnoise_int.h"
 #include "random.h"
 
-double
-LNoise3D(double x, double y, double z, guint16* shuffle_table)
+/* A period of 0 doesn't wrap, and is folded away in LNoise3D() */
+static inline double
+LNoise3DBody(double x, double y, double z, int period_x, int period_y, guint16* shuffle_table)
 {
   double xif = NAN, yif = NAN, zif = NAN;
   int xi = 0, yi = 0, zi = 0;
@@ -44,6 +41,7 @@ LNoise3D(double x, double y, double z, guint16* shuffle_table)
   double vx = NAN, vy = NAN, vz = NAN;
   int i = 0;
   int x_idx = 0, y_idx = 0, z_idx = 0;
+  int xh = 0, yh = 0;
   double tmp = NAN;
 
   /* Get the integer and fractional part of the coordinates */
@@ -70,8 +68,11 @@ LNoise3D(double x, double y, double z, guint16* shuffle_table)
     vy = yf - y_idx;
     vz = zf - z_idx;
 
+    xh = period_x ? WrapIndex(xi + x_idx, period_x) : xi + x_idx;
+    yh = period_y ? WrapIndex(yi + y_idx, period_y) : yi + y_idx;
+
     /* Calculate the "dot product" */
-    switch (Hash3(xi + x_idx, yi + y_idx, zi + z_idx) & 15)
+    switch (Hash3(xh, yh, zi + z_idx) & 15)
     {
 
       case 0:
@@ -145,3 +146,26 @@ LNoise3D(double x, double y, double z, guint16* shuffle_table)
 
   return Lerp(czf, v1, v3);
 }
+
+double
+LNoise3D(double x, double y, double z, guint16* shuffle_table)
+{
+  return LNoise3DBody(x, y, z, 0, 0, shuffle_table);
+}
+
+double
+LNoise3DPeriodic(double x, double y, double z, int period_x, int period_y, guint16* shuffle_table)
+{
+  return LNoise3DBody(x, y, z, period_x, period_y, shuffle_table);
+}
+
+void
+LNoise3DSpan(int n, const double* x, const double* y, const double* z, double* value, guint16* shuffle_table)
+{
+  int j = 0;
+
+  for (j = 0; j < n; j++)
+  {
+    value[j] = LNoise3D(x[j], y[j], z[j], shuffle_table);
+  }
+}
@@ -20,15 +20,11 @@
  *
  */
 
-#ifdef CALIBRATE
 #include <glib.h>
 #include <math.h>
 #include <string.h>
-#else
-#include <libgimp/gimp.h>
-#include <math.h>
-#endif
 
+#include "lnoise.h"
 #include "lnoise_int.h"
 #include "random.h"
 
@@ -213,3 +209,14 @@ LNoise4D(double x, double y, double z, double t, guint16* shuffle_table)
 
   return Lerp(ctf, v1, v5);
 }
+
+void
+LNoise4DSpan(int n, const double* x, const double* y, const double* z, const double* t, double* value, guint16* shuffle_table)
+{
+  int j = 0;
+
+  for (j = 0; j < n; j++)
+  {
+    value[j] = LNoise4D(x[j], y[j], z[j], t[j], shuffle_table);
+  }
+}
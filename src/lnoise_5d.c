@@ -20,15 +20,11 @@
  *
  */
 
-#ifdef CALIBRATE
 #include <glib.h>
 #include <math.h>
 #include <string.h>
-#else
-#include <libgimp/gimp.h>
-#include <math.h>
-#endif
 
+#include "lnoise.h"
 #include "lnoise_int.h"
 #include "random.h"
 
@@ -138,3 +134,14 @@ LNoise5D(double x, double y, double z, double s, double t, guint16* shuffle_tabl
 
   return Lerp(ctf, dp[0], dp[16]);
 }
+
+void
+LNoise5DSpan(int n, const double* x, const double* y, const double* z, const double* s, const double* t, double* value, guint16* shuffle_table)
+{
+  int j = 0;
+
+  for (j = 0; j < n; j++)
+  {
+    value[j] = LNoise5D(x[j], y[j], z[j], s[j], t[j], shuffle_table);
+  }
+}
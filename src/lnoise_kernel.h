@@ -0,0 +1,450 @@
+/*  Felimage Noise Plugin for the GIMP
+ *  Copyright (C) 2005 Guillermo Romero Franco <drirr_gato@users.sourceforge.net>
+ *
+ *  This file is part of the Felimage Noise Plugin for the GIMP
+ *
+ *  Felimage Noise Plugin for the Gimp is free software;
+ *  you can redistribute it and/or modify it under the terms of
+ *  the GNU General Public License as published by the Free Software
+ *  Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Felimage Noise Plugin for the Gimp is distributed in the hope
+ *  that it will be useful, but WITHOUT ANY WARRANTY; without even
+ *  the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ *  PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with fimg-noise; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Vector lattice noise, included by lnoise_simd.c once per instruction set
+ * with these defined:
+ *
+ *   KN(NAME)             name of NAME for this instruction set
+ *   KERNEL_NAME          name of the instruction set
+ *   KERNEL_ATTR          the target attribute
+ *   LANES                samples per vector
+ *   VD, VI, VU, VL       vectors of double, gint32, guint32 and gint64
+ *   FLOOR_PD(A)          floor() of each lane
+ *   GATHER_EPI16(T, I)   T[I] for each lane, T being a padded guint16 table (optional)
+ *   GATHER_PD(T, I)      T[I] for each lane, T being a double table (optional)
+ *
+ * Every step does the same operations as the scalar LNoise*D(), in the same
+ * order, so both give the same results. The gradient switches become
+ * lookups in the grad3/grad4 tables, and the hashes of the corners share
+ * their inner levels instead of being recomputed */
+
+#ifndef GATHER_EPI16
+static inline KERNEL_ATTR VI
+KN(GatherEpi16)(const guint16* table, VI idx)
+{
+  VI r = {0};
+  int l = 0;
+
+  for (l = 0; l < LANES; l++)
+  {
+    r[l] = table[idx[l]];
+  }
+  return r;
+}
+#define GATHER_EPI16(T, I) KN(GatherEpi16)(T, I)
+#endif
+
+#ifndef GATHER_PD
+static inline KERNEL_ATTR VD
+KN(GatherPd)(const double* table, VI idx)
+{
+  VD r = {0};
+  int l = 0;
+
+  for (l = 0; l < LANES; l++)
+  {
+    r[l] = table[idx[l]];
+  }
+  return r;
+}
+#define GATHER_PD(T, I) KN(GatherPd)(T, I)
+#endif
+
+/* Hash1(A + B), B being the hash of the inner coordinates */
+#ifndef HASH_MIX
+#define KHASH(A, B) GATHER_EPI16(shuffle_table, ((A) + (B)) & (TABLE_SIZE - 1))
+#else
+static inline KERNEL_ATTR VI
+KN(MixHash)(VI a, guint32 seed)
+{
+  VU u = (VU)a ^ seed;
+
+  u *= 0x9e3779b1u;
+  u ^= u >> 15;
+  u *= 0x85ebca6bu;
+  return (VI)(u >> (32 - TABLE_SIZE_LOG));
+}
+#define KHASH(A, B) KN(MixHash)((A) + (B), HashSeed(shuffle_table))
+#endif
+
+static inline KERNEL_ATTR VD
+KN(Curve)(VD a)
+{
+  VD tmp = a * a;
+
+  return ((((-20.0 * a) + 70.0) * a - 84.0) * a + 35.0) * tmp * tmp;
+}
+
+static inline KERNEL_ATTR VD
+KN(Lerp)(VD t, VD a, VD b)
+{
+  return (b - a) * t + a;
+}
+
+/* returns the integer part of p, and the fractional one in *f */
+static inline KERNEL_ATTR VI
+KN(Split)(VD p, VD* f)
+{
+  VD pif = FLOOR_PD(p);
+
+  *f = p - pif;
+  return __builtin_convertvector(pif, VI);
+}
+
+/* a if the mask is set, b otherwise */
+static inline KERNEL_ATTR VD
+KN(Select)(VL mask, VD a, VD b)
+{
+  return (VD)(((VL)a & mask) | ((VL)b & ~mask));
+}
+
+/* v if the bit of h is set, -v otherwise */
+static inline KERNEL_ATTR VD
+KN(Sign)(VL h, int bit, VD v)
+{
+  return (VD)((VL)v ^ ((((h >> bit) & 1) == 0) & G_MININT64));
+}
+
+static KERNEL_ATTR VD
+KN(LNoise3D)(VD x, VD y, VD z, const guint16* shuffle_table)
+{
+  VI xi = {0}, yi = {0}, zi = {0};
+  VD xf = {0}, yf = {0}, zf = {0};
+  VI hz[2] = {{0}}, hyz[4] = {{0}};
+  VI h = {0};
+  VD dp[8] = {{0}};
+  VD vx = {0}, vy = {0}, vz = {0};
+  VD v1 = {0}, v2 = {0}, v3 = {0}, v4 = {0};
+  VD cxf = {0}, cyf = {0}, czf = {0};
+  int i = 0;
+
+  xi = KN(Split)(x, &xf);
+  yi = KN(Split)(y, &yf);
+  zi = KN(Split)(z, &zf);
+
+  for (i = 0; i < 2; i++)
+  {
+    hz[i] = KHASH(zi, i);
+  }
+  for (i = 0; i < 4; i++)
+  {
+    hyz[i] = KHASH(yi + (i & 1), hz[i >> 1]);
+  }
+
+  for (i = 0; i < 8; i++)
+  {
+    h = KHASH(xi + (i & 1), hyz[i >> 1]) & 15;
+
+    vx = xf - (double)(i & 1);
+    vy = yf - (double)((i & 2) >> 1);
+    vz = zf - (double)((i & 4) >> 2);
+
+    dp[i] = GATHER_PD(grad3[0], h) * vx + GATHER_PD(grad3[1], h) * vy + GATHER_PD(grad3[2], h) * vz;
+  }
+
+  cxf = KN(Curve)(xf);
+  cyf = KN(Curve)(yf);
+  czf = KN(Curve)(zf);
+
+  v1 = KN(Lerp)(cxf, dp[0], dp[1]);
+  v2 = KN(Lerp)(cxf, dp[2], dp[3]);
+  v3 = KN(Lerp)(cxf, dp[4], dp[5]);
+  v4 = KN(Lerp)(cxf, dp[6], dp[7]);
+
+  v1 = KN(Lerp)(cyf, v1, v2);
+  v3 = KN(Lerp)(cyf, v3, v4);
+
+  return KN(Lerp)(czf, v1, v3);
+}
+
+static KERNEL_ATTR VD
+KN(LNoise4D)(VD x, VD y, VD z, VD t, const guint16* shuffle_table)
+{
+  VI xi = {0}, yi = {0}, zi = {0}, ti = {0};
+  VD xf = {0}, yf = {0}, zf = {0}, tf = {0};
+  VI ht[2] = {{0}}, hzt[4] = {{0}}, hyzt[8] = {{0}};
+  VI h = {0};
+  VD dp[16] = {{0}};
+  VD vx = {0}, vy = {0}, vz = {0}, vt = {0};
+  VD v1 = {0}, v2 = {0}, v3 = {0}, v4 = {0}, v5 = {0}, v6 = {0}, v7 = {0}, v8 = {0};
+  VD cxf = {0}, cyf = {0}, czf = {0}, ctf = {0};
+  int i = 0;
+
+  xi = KN(Split)(x, &xf);
+  yi = KN(Split)(y, &yf);
+  zi = KN(Split)(z, &zf);
+  ti = KN(Split)(t, &tf);
+
+  for (i = 0; i < 2; i++)
+  {
+    ht[i] = KHASH(ti, i);
+  }
+  for (i = 0; i < 4; i++)
+  {
+    hzt[i] = KHASH(zi + (i & 1), ht[i >> 1]);
+  }
+  for (i = 0; i < 8; i++)
+  {
+    hyzt[i] = KHASH(yi + (i & 1), hzt[i >> 1]);
+  }
+
+  for (i = 0; i < 16; i++)
+  {
+    h = KHASH(xi + (i & 1), hyzt[i >> 1]) & 31;
+
+    vx = xf - (double)(i & 1);
+    vy = yf - (double)((i & 2) >> 1);
+    vz = zf - (double)((i & 4) >> 2);
+    vt = tf - (double)((i & 8) >> 3);
+
+    dp[i] = GATHER_PD(grad4[0], h) * vx + GATHER_PD(grad4[1], h) * vy + GATHER_PD(grad4[2], h) * vz + GATHER_PD(grad4[3], h) * vt;
+  }
+
+  cxf = KN(Curve)(xf);
+  cyf = KN(Curve)(yf);
+  czf = KN(Curve)(zf);
+  ctf = KN(Curve)(tf);
+
+  v1 = KN(Lerp)(cxf, dp[0], dp[1]);
+  v2 = KN(Lerp)(cxf, dp[2], dp[3]);
+  v3 = KN(Lerp)(cxf, dp[4], dp[5]);
+  v4 = KN(Lerp)(cxf, dp[6], dp[7]);
+
+  v5 = KN(Lerp)(cxf, dp[8], dp[9]);
+  v6 = KN(Lerp)(cxf, dp[10], dp[11]);
+  v7 = KN(Lerp)(cxf, dp[12], dp[13]);
+  v8 = KN(Lerp)(cxf, dp[14], dp[15]);
+
+  v1 = KN(Lerp)(cyf, v1, v2);
+  v3 = KN(Lerp)(cyf, v3, v4);
+  v5 = KN(Lerp)(cyf, v5, v6);
+  v7 = KN(Lerp)(cyf, v7, v8);
+
+  v1 = KN(Lerp)(czf, v1, v3);
+  v5 = KN(Lerp)(czf, v5, v7);
+
+  return KN(Lerp)(ctf, v1, v5);
+}
+
+static KERNEL_ATTR VD
+KN(LNoise5D)(VD x, VD y, VD z, VD s, VD t, const guint16* shuffle_table)
+{
+  VI xi = {0}, yi = {0}, zi = {0}, si = {0}, ti = {0};
+  VD xf = {0}, yf = {0}, zf = {0}, sf = {0}, tf = {0};
+  VI ht[2] = {{0}}, hst[4] = {{0}}, hzst[8] = {{0}}, hyzst[16] = {{0}};
+  VL h = {0}, sel = {0};
+  VD dp[32] = {{0}};
+  VD vx = {0}, vy = {0}, vz = {0}, vs = {0}, vt = {0};
+  VD cxf = {0}, cyf = {0}, czf = {0}, csf = {0}, ctf = {0};
+  int i = 0;
+
+  xi = KN(Split)(x, &xf);
+  yi = KN(Split)(y, &yf);
+  zi = KN(Split)(z, &zf);
+  si = KN(Split)(s, &sf);
+  ti = KN(Split)(t, &tf);
+
+  for (i = 0; i < 2; i++)
+  {
+    ht[i] = KHASH(ti, i);
+  }
+  for (i = 0; i < 4; i++)
+  {
+    hst[i] = KHASH(si + (i & 1), ht[i >> 1]);
+  }
+  for (i = 0; i < 8; i++)
+  {
+    hzst[i] = KHASH(zi + (i & 1), hst[i >> 1]);
+  }
+  for (i = 0; i < 16; i++)
+  {
+    hyzst[i] = KHASH(yi + (i & 1), hzst[i >> 1]);
+  }
+
+  for (i = 0; i < 32; i++)
+  {
+    h = __builtin_convertvector(KHASH(xi + (i & 1), hyzst[i >> 1]), VL);
+
+    vx = xf - (double)(i & 1);
+    vy = yf - (double)((i & 2) >> 1);
+    vz = zf - (double)((i & 4) >> 2);
+    vs = sf - (double)((i & 8) >> 3);
+    vt = tf - (double)((i & 16) >> 4);
+
+    /* case n of the scalar switch puts s in place of the other axes */
+    sel = (h >> 4) % 5;
+    dp[i] = KN(Sign)(h, 0, KN(Select)(sel == 3, vs, vx)) + KN(Sign)(h, 1, KN(Select)(sel == 2, vs, vy)) + KN(Sign)(h, 2, KN(Select)(sel == 1, vs, vz)) + KN(Sign)(h, 3, KN(Select)(sel == 4, vs, vt));
+  }
+
+  cxf = KN(Curve)(xf);
+  cyf = KN(Curve)(yf);
+  czf = KN(Curve)(zf);
+  csf = KN(Curve)(sf);
+  ctf = KN(Curve)(tf);
+
+  for (i = 0; i < 32; i += 2)
+  {
+    dp[i] = KN(Lerp)(cxf, dp[i], dp[i + 1]);
+  }
+
+  for (i = 0; i < 32; i += 4)
+  {
+    dp[i] = KN(Lerp)(cyf, dp[i], dp[i + 2]);
+  }
+
+  for (i = 0; i < 32; i += 8)
+  {
+    dp[i] = KN(Lerp)(czf, dp[i], dp[i + 4]);
+  }
+  dp[0] = KN(Lerp)(csf, dp[0], dp[8]);
+  dp[16] = KN(Lerp)(csf, dp[16], dp[24]);
+
+  return KN(Lerp)(ctf, dp[0], dp[16]);
+}
+
+#undef KHASH
+
+/* The spans work on whole vectors, the last one padded with zeros */
+
+static KERNEL_ATTR void
+KN(LNoise3DSpan)(int n, const double* x, const double* y, const double* z, double* value, guint16* shuffle_table)
+{
+  VD px = {0}, py = {0}, pz = {0}, r = {0};
+  const VD zero = {0};
+  int j = 0, k = 0;
+
+  for (j = 0; j + LANES <= n; j += LANES)
+  {
+    memcpy(&px, x + j, sizeof(VD));
+    memcpy(&py, y + j, sizeof(VD));
+    memcpy(&pz, z + j, sizeof(VD));
+    r = KN(LNoise3D)(px, py, pz, shuffle_table);
+    memcpy(value + j, &r, sizeof(VD));
+  }
+
+  if (j < n)
+  {
+    px = zero;
+    py = zero;
+    pz = zero;
+    for (k = 0; j + k < n; k++)
+    {
+      px[k] = x[j + k];
+      py[k] = y[j + k];
+      pz[k] = z[j + k];
+    }
+    r = KN(LNoise3D)(px, py, pz, shuffle_table);
+    for (k = 0; j + k < n; k++)
+    {
+      value[j + k] = r[k];
+    }
+  }
+}
+
+static KERNEL_ATTR void
+KN(LNoise4DSpan)(int n, const double* x, const double* y, const double* z, const double* t, double* value, guint16* shuffle_table)
+{
+  VD px = {0}, py = {0}, pz = {0}, pt = {0}, r = {0};
+  const VD zero = {0};
+  int j = 0, k = 0;
+
+  for (j = 0; j + LANES <= n; j += LANES)
+  {
+    memcpy(&px, x + j, sizeof(VD));
+    memcpy(&py, y + j, sizeof(VD));
+    memcpy(&pz, z + j, sizeof(VD));
+    memcpy(&pt, t + j, sizeof(VD));
+    r = KN(LNoise4D)(px, py, pz, pt, shuffle_table);
+    memcpy(value + j, &r, sizeof(VD));
+  }
+
+  if (j < n)
+  {
+    px = zero;
+    py = zero;
+    pz = zero;
+    pt = zero;
+    for (k = 0; j + k < n; k++)
+    {
+      px[k] = x[j + k];
+      py[k] = y[j + k];
+      pz[k] = z[j + k];
+      pt[k] = t[j + k];
+    }
+    r = KN(LNoise4D)(px, py, pz, pt, shuffle_table);
+    for (k = 0; j + k < n; k++)
+    {
+      value[j + k] = r[k];
+    }
+  }
+}
+
+static KERNEL_ATTR void
+KN(LNoise5DSpan)(int n, const double* x, const double* y, const double* z, const double* s, const double* t, double* value, guint16* shuffle_table)
+{
+  VD px = {0}, py = {0}, pz = {0}, ps = {0}, pt = {0}, r = {0};
+  const VD zero = {0};
+  int j = 0, k = 0;
+
+  for (j = 0; j + LANES <= n; j += LANES)
+  {
+    memcpy(&px, x + j, sizeof(VD));
+    memcpy(&py, y + j, sizeof(VD));
+    memcpy(&pz, z + j, sizeof(VD));
+    memcpy(&ps, s + j, sizeof(VD));
+    memcpy(&pt, t + j, sizeof(VD));
+    r = KN(LNoise5D)(px, py, pz, ps, pt, shuffle_table);
+    memcpy(value + j, &r, sizeof(VD));
+  }
+
+  if (j < n)
+  {
+    px = zero;
+    py = zero;
+    pz = zero;
+    ps = zero;
+    pt = zero;
+    for (k = 0; j + k < n; k++)
+    {
+      px[k] = x[j + k];
+      py[k] = y[j + k];
+      pz[k] = z[j + k];
+      ps[k] = s[j + k];
+      pt[k] = t[j + k];
+    }
+    r = KN(LNoise5D)(px, py, pz, ps, pt, shuffle_table);
+    for (k = 0; j + k < n; k++)
+    {
+      value[j + k] = r[k];
+    }
+  }
+}
+
+static const LNoiseKernels KN(kernels) = {
+    KERNEL_NAME,
+    KN(LNoise3DSpan),
+    KN(LNoise4DSpan),
+    KN(LNoise5DSpan),
+};
+
+#undef GATHER_EPI16
+#undef GATHER_PD
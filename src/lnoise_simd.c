@@ -0,0 +1,172 @@
+/*  Felimage Noise Plugin for the GIMP
+ *  Copyright (C) 2005 Guillermo Romero Franco <drirr_gato@users.sourceforge.net>
+ *
+ *  This file is part of the Felimage Noise Plugin for the GIMP
+ *
+ *  Felimage Noise Plugin for the Gimp is free software;
+ *  you can redistribute it and/or modify it under the terms of
+ *  the GNU General Public License as published by the Free Software
+ *  Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Felimage Noise Plugin for the Gimp is distributed in the hope
+ *  that it will be useful, but WITHOUT ANY WARRANTY; without even
+ *  the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ *  PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with fimg-noise; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Picks the lattice noise kernels for the CPU we are running on. The vector
+ * kernels are only built with compilers that have vector extensions and
+ * target attributes (gcc >= 9, clang) on x86 */
+
+#include <glib.h>
+#include <math.h>
+#include <string.h>
+
+#include "lnoise.h"
+#include "random.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 9))
+#define LNOISE_SIMD
+#endif
+
+static const LNoiseKernels kernels_scalar = {
+    "scalar",
+    LNoise3DSpan,
+    LNoise4DSpan,
+    LNoise5DSpan,
+};
+
+#ifdef LNOISE_SIMD
+
+/* the kernels must round like the scalar code: no fused multiply-adds */
+#ifdef __clang__
+#pragma clang fp contract(off)
+#else
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#include <immintrin.h>
+
+typedef double v2df __attribute__((vector_size(16)));
+typedef gint32 v2si __attribute__((vector_size(8)));
+typedef guint32 v2su __attribute__((vector_size(8)));
+typedef gint64 v2di __attribute__((vector_size(16)));
+typedef double v4df __attribute__((vector_size(32)));
+typedef gint32 v4si __attribute__((vector_size(16)));
+typedef guint32 v4su __attribute__((vector_size(16)));
+typedef gint64 v4di __attribute__((vector_size(32)));
+typedef double v8df __attribute__((vector_size(64)));
+typedef gint32 v8si __attribute__((vector_size(32)));
+typedef guint32 v8su __attribute__((vector_size(32)));
+typedef gint64 v8di __attribute__((vector_size(64)));
+
+/* gradient coefficients of the cases of the LNoise3D() and LNoise4D() switches */
+static const double grad3[3][16] = {
+    {1, 1, -1, -1, 1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 0, 0},
+    {1, -1, 1, -1, 0, 0, 0, 0, 1, 1, -1, -1, 1, 1, -1, -1},
+    {0, 0, 0, 0, 1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 1, -1},
+};
+
+static const double grad4[4][32] = {
+    {1, 1, -1, -1, 1, 1, -1, -1, 1, 1, -1, -1, 1, 1, -1, -1, 1, 1, -1, -1, 1, 1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, -1, -1, 1, 1, -1, -1},
+    {1, 1, 1, 1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1},
+    {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, -1, -1, -1, -1, 1, 1, 1, 1, -1, -1, -1, -1, 1, 1, 1, 1, -1, -1, -1, -1},
+};
+
+/* SSE4.1: two lanes, gathers done lane by lane */
+#define KN(NAME) NAME##_sse41
+#define KERNEL_NAME "sse4.1"
+#define KERNEL_ATTR __attribute__((target("sse4.1")))
+#define LANES 2
+#define VD v2df
+#define VI v2si
+#define VU v2su
+#define VL v2di
+#define FLOOR_PD(A) ((VD)_mm_floor_pd((__m128d)(A)))
+#include "lnoise_kernel.h"
+#undef KN
+#undef KERNEL_NAME
+#undef KERNEL_ATTR
+#undef LANES
+#undef VD
+#undef VI
+#undef VU
+#undef VL
+#undef FLOOR_PD
+
+/* AVX2: four lanes, with hardware gathers. The shuffle table has a spare
+ * entry, so reading 32 bits at the last index stays inside it */
+#define KN(NAME) NAME##_avx2
+#define KERNEL_NAME "avx2"
+#define KERNEL_ATTR __attribute__((target("avx2")))
+#define LANES 4
+#define VD v4df
+#define VI v4si
+#define VU v4su
+#define VL v4di
+#define FLOOR_PD(A) ((VD)_mm256_floor_pd((__m256d)(A)))
+#define GATHER_EPI16(T, I) ((VI)_mm_i32gather_epi32((const int*)(T), (__m128i)(I), 2) & 0xffff)
+#define GATHER_PD(T, I) ((VD)_mm256_i32gather_pd((T), (__m128i)(I), 8))
+#include "lnoise_kernel.h"
+#undef KN
+#undef KERNEL_NAME
+#undef KERNEL_ATTR
+#undef LANES
+#undef VD
+#undef VI
+#undef VU
+#undef VL
+#undef FLOOR_PD
+
+/* AVX-512: eight lanes */
+#define KN(NAME) NAME##_avx512
+#define KERNEL_NAME "avx512"
+#define KERNEL_ATTR __attribute__((target("avx512f")))
+#define LANES 8
+#define VD v8df
+#define VI v8si
+#define VU v8su
+#define VL v8di
+#define FLOOR_PD(A) ((VD)_mm512_roundscale_pd((__m512d)(A), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC))
+#define GATHER_EPI16(T, I) ((VI)_mm256_i32gather_epi32((const int*)(T), (__m256i)(I), 2) & 0xffff)
+#define GATHER_PD(T, I) ((VD)_mm512_i32gather_pd((__m256i)(I), (T), 8))
+#include "lnoise_kernel.h"
+#undef KN
+#undef KERNEL_NAME
+#undef KERNEL_ATTR
+#undef LANES
+#undef VD
+#undef VI
+#undef VU
+#undef VL
+#undef FLOOR_PD
+
+#endif /* LNOISE_SIMD */
+
+const LNoiseKernels*
+GetLNoiseKernels(void)
+{
+#ifdef LNOISE_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+  {
+    return &kernels_avx512;
+  }
+  if (__builtin_cpu_supports("avx2"))
+  {
+    return &kernels_avx2;
+  }
+  if (__builtin_cpu_supports("sse4.1"))
+  {
+    return &kernels_sse41;
+  }
+#endif
+  return &kernels_scalar;
+}
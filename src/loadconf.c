@@ -27,8 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <libgimp/gimp.h>
-#include <libgimp/gimpui.h>
+#include <glib.h>
 
 #include "main.h"
 
@@ -86,12 +85,15 @@ const char* keywords[] = {
   "pinch",
   "bias",
   "gain",
+  "threads",
+  "exact_shading",
   NULL};
 
 static void
 SetValue(const char* key, const char* value, PluginState* state)
 {
   float tmp_f = NAN;
+  int tmp_i = 0;
   int v = 0;
 
   v = GetByName(key, -1, keywords);
@@ -194,6 +196,12 @@ SetValue(const char* key, const char* value, PluginState* state)
     case 27:
       state->gain = GET_FLOAT(value, -1, 1);
       break;
+    case 28:
+      state->threads = GET_INT(value, 0, MAX_RENDER_THREADS);
+      break;
+    case 29:
+      state->exact_shading = GET_BOOL(value);
+      break;
   }
 }
 
@@ -56,16 +56,29 @@
 
 #include <string.h>
 
+#include <glib.h>
+#ifndef NO_GIMP
 #include <libgimp/gimp.h>
 #include <libgimp/gimpui.h>
+#endif
 
 #include "loadsaveconf.h"
 #include "main.h"
 #include "render.h"
+#ifndef NO_GIMP
+#include "render_gimp.h"
+#endif
+
+/* felimage-render and felimage-bench build without the GIMP, and never warp */
+#ifdef NO_GIMP
+#define DEFAULT_EDGE_ACTION 1 /* GIMP_PIXEL_FETCHER_EDGE_WRAP */
+#else
+#define DEFAULT_EDGE_ACTION GIMP_PIXEL_FETCHER_EDGE_WRAP
+#endif
 
 /* these are names used for configuration, (won't change when localized!!)*/
-const char* mapping_names[] = {"planar", "tileable", "spherical", NULL};
-const char* basis_names[] = {"lattice_noise", "lattice_turbulence", "sparse_noise", "sparse_turbulence", "skin", "puffy", "fractured", "crystals", "galvalized", NULL};
+const char* mapping_names[] = {"planar", "tileable", "spherical", "periodic", NULL};
+const char* basis_names[] = {"lattice_noise", "lattice_turbulence", "sparse_noise", "sparse_turbulence", "skin", "puffy", "fractured", "crystals", "galvalized", "simplex_noise", "simplex_turbulence", NULL};
 const char* color_src_names[] = {"fg_bg", "gradient", "channels", "warp", NULL};
 const char* function_names[] = {"ramp", "triangle", "sine", "half_sine", NULL};
 const char* multifractal_names[] = {"fbm", "multifractal", "inv_multifractal", NULL};
@@ -100,9 +113,9 @@ const PluginState default_state = {
   10, /* warp x size */
   10, /* warp y size */
 
-  0,                            /* warp caustics percentage */
-  0,                            /* warp rendering quality */
-  GIMP_PIXEL_FETCHER_EDGE_WRAP, /* edge action */
+  0,                   /* warp caustics percentage */
+  0,                   /* warp rendering quality */
+  DEFAULT_EDGE_ACTION, /* edge action */
 
   {0}, /* gradient */
 
@@ -112,11 +125,16 @@ const PluginState default_state = {
   0.0, /* bias */
   0.0, /* gain */
 
+  0, /* threads */
+
+  0, /* exact shading */
+
   1, /* linked sizes*/
   1, /* linked warp sizes */
   1  /* show preview */
 };
 
+#ifndef NO_GIMP
 static GimpParamDef args[] =
   {
     /* Required by GIMP */
@@ -174,6 +192,7 @@ query(void)
 
   gimp_plugin_menu_register(PROCEDURE_NAME, "<Image>/Filters/Render/Felimage/");
 }
+#endif
 
 gchar*
 GetMD5Text(guchar* md5)
@@ -197,6 +216,19 @@ SetStateToDefaults(PluginState* state)
   *state = default_state;
 }
 
+/* The MD5 of 'text' (the same gimp_md5_get_digest() gave) */
+static void
+GetMD5Digest(const gchar* text, guchar* md5)
+{
+  GChecksum* checksum = NULL;
+  gsize length = 16;
+
+  checksum = g_checksum_new(G_CHECKSUM_MD5);
+  g_checksum_update(checksum, (const guchar*)text, strlen(text));
+  g_checksum_get_digest(checksum, md5, &length);
+  g_checksum_free(checksum);
+}
+
 /* Because we can't pass pointers to dynamically allocated data between calls, we store
  * the name of the gradient as a 16 byte data (which is only the MD5 of the
  * actual gradient name
@@ -210,7 +242,7 @@ StoreGradientName(PluginState* state, const gchar* name)
   {
     grad_name = g_utf8_strup(name, -1);
     g_assert(grad_name);
-    gimp_md5_get_digest(grad_name, strlen(grad_name), state->gradient);
+    GetMD5Digest(grad_name, (guchar*)state->gradient);
     g_free(grad_name);
   }
   else
@@ -219,6 +251,7 @@ StoreGradientName(PluginState* state, const gchar* name)
   }
 }
 
+#ifndef NO_GIMP
 gchar*
 GetGradientName(const guchar* gradient_hash)
 {
@@ -246,7 +279,7 @@ GetGradientName(const guchar* gradient_hash)
     grad_name = g_utf8_strup(gradient[i], -1);
     g_assert(grad_name);
 
-    gimp_md5_get_digest(grad_name, strlen(grad_name), md5);
+    GetMD5Digest(grad_name, md5);
 
     g_free(grad_name);
 
@@ -385,9 +418,11 @@ GimpPlugInInfo PLUG_IN_INFO =
     query, /* query_proc */
     run,   /* run_proc   */
 };
+#endif
+
 #ifndef NOT_PLUGIN
 MAIN()
-#else
+#elif !defined(HEADLESS) /* felimage-render and felimage-bench have their own */
 int
 main(int argc, char* argv[])
 {
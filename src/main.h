@@ -59,6 +59,8 @@
 #define PRESET_HEADER "# Felimage Noise Plugin"
 #define PRESET_EXTENSION ".fnp"
 
+#define MAX_RENDER_THREADS 64
+
 #ifndef AS_TEST
 
 #define _(String) (String)
@@ -81,7 +83,9 @@ enum
   BASIS_CELLS_2,
   BASIS_CELLS_3,
   BASIS_CELLS_4,
-  BASIS_CELLS_5
+  BASIS_CELLS_5,
+  BASIS_SIMPLEX,
+  BASIS_SIMPLEX_TURB_1
 };
 enum
 {
@@ -95,6 +99,7 @@ enum
   MAP_PLANAR,
   MAP_TILED,
   MAP_SPHERICAL,
+  MAP_PERIODIC, /* tileable, with a periodic 3D basis */
   MAP_RADIAL
 };
 enum
@@ -165,6 +170,10 @@ typedef struct
   gfloat bias;
   gfloat gain;
 
+  gint8 threads; /* default = 0 (one per processor) */
+
+  gint8 exact_shading; /* default = 0 (shade through a lookup table) */
+
   /* UI state */
 
   gint8 linked_sizes;
@@ -179,8 +188,9 @@ void StoreGradientName(PluginState* state, const gchar* name);
 
 gchar* GetGradientName(const guchar* gradient_hash);
 
-/* we hide this, are we're not including the GIMP headers for calibration */
-#ifndef CALIBRATE
+/* we hide this, are we're not including the GIMP headers for calibration
+ * and the noise core */
+#if !defined(CALIBRATE) && !defined(NO_GIMP)
 gboolean dialog(gint32 image_ID,
                 GimpDrawable* drawable,
                 PluginState* state);
@@ -45,4 +45,12 @@
 
 #define MAX_FEATURES 5
 
+/* distance between the features of consecutive seeds in the feature point
+ * tables, so that those of each seed start on a 64 byte boundary */
+#define FEATURE_STRIDE 8
+
 extern int Poisson_count[256];
+
+/* memory for the feature point tables, aligned to 64 bytes. They are built
+ * once and never freed */
+gpointer AllocFeatureTable(gsize size);
@@ -0,0 +1,312 @@
+/*  Felimage Noise Plugin for the GIMP
+ *  Copyright (C) 2005 Guillermo Romero Franco <drirr_gato@users.sourceforge.net>
+ *
+ *  This file is part of the Felimage Noise Plugin for the GIMP
+ *
+ *  Felimage Noise Plugin for the Gimp is free software;
+ *  you can redistribute it and/or modify it under the terms of
+ *  the GNU General Public License as published by the Free Software
+ *  Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Felimage Noise Plugin for the Gimp is distributed in the hope
+ *  that it will be useful, but WITHOUT ANY WARRANTY; without even
+ *  the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ *  PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with fimg-noise; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+
+static const char* stage_names[] = {"read", "basis", "shade", "blend", "warp", "fetch", "write", "tile"};
+
+static GPrivate trace_thread;
+static gint trace_threads = 0;
+static gboolean trace_started = FALSE;
+
+/* where to write to, "" for stderr, NULL for nowhere */
+static const char*
+GetOutput(const char* name)
+{
+  const char* env = NULL;
+
+  env = g_getenv(name);
+  if (!env || !env[0] || !strcmp(env, "0"))
+  {
+    return NULL;
+  }
+  return (!strcmp(env, "1") || !strcmp(env, "stderr")) ? "" : g_strdup(env);
+}
+
+static const char*
+GetProfileOutput(void)
+{
+  static gsize once = 0;
+  static const char* output = NULL;
+
+  if (g_once_init_enter(&once))
+  {
+    output = GetOutput(PROFILE_ENV);
+    g_once_init_leave(&once, 1);
+  }
+  return output;
+}
+
+static const char*
+GetTraceOutput(void)
+{
+  static gsize once = 0;
+  static const char* output = NULL;
+
+  if (g_once_init_enter(&once))
+  {
+    output = GetOutput(TRACE_ENV);
+    g_once_init_leave(&once, 1);
+  }
+  return output;
+}
+
+gboolean
+ProfileEnabled(void)
+{
+  return GetProfileOutput() != NULL || GetTraceOutput() != NULL;
+}
+
+gboolean
+TraceEnabled(void)
+{
+  return GetTraceOutput() != NULL;
+}
+
+gint64
+ProfileNow(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (gint64)now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+  return g_get_monotonic_time() * 1000;
+#endif
+}
+
+static int
+GetTraceThread(void)
+{
+  int thread = 0;
+
+  thread = GPOINTER_TO_INT(g_private_get(&trace_thread));
+  if (!thread)
+  {
+    thread = g_atomic_int_add(&trace_threads, 1) + 1;
+    g_private_set(&trace_thread, GINT_TO_POINTER(thread));
+  }
+  return thread;
+}
+
+void
+TraceSpan(ProfileStats* stats, const char* name, gint64 start, gint64 end, int x, int y, int plane)
+{
+  TraceEvent event = {0};
+
+  if (!stats->trace)
+  {
+    return;
+  }
+
+  event.name = name;
+  event.start = start;
+  event.end = end;
+  event.thread = GetTraceThread();
+  event.x = x;
+  event.y = y;
+  event.plane = plane;
+  g_array_append_val(stats->trace, event);
+}
+
+void
+InitRenderProfile(RenderProfile* profile, int width, int height)
+{
+  memset(profile, 0, sizeof(*profile));
+  profile->width = width;
+  profile->height = height;
+  profile->threads = 1;
+  profile->tile_min = G_MAXINT64;
+  if (TraceEnabled())
+  {
+    profile->stats.trace = g_array_new(FALSE, FALSE, sizeof(TraceEvent));
+  }
+  profile->start = ProfileNow();
+}
+
+void
+ResetProfileStats(ProfileStats* stats)
+{
+  GArray* trace = stats->trace;
+
+  memset(stats, 0, sizeof(*stats));
+  if (trace)
+  {
+    g_array_set_size(trace, 0);
+  }
+  else if (TraceEnabled())
+  {
+    trace = g_array_new(FALSE, FALSE, sizeof(TraceEvent));
+  }
+  stats->trace = trace;
+}
+
+void
+ClearProfileStats(ProfileStats* stats)
+{
+  if (stats->trace)
+  {
+    g_array_free(stats->trace, TRUE);
+  }
+  memset(stats, 0, sizeof(*stats));
+}
+
+void
+AddTileProfile(RenderProfile* profile, const ProfileStats* tile, int x, int y)
+{
+  int i = 0;
+
+  for (i = 0; i < PROFILE_STAGES; i++)
+  {
+    profile->stats.time[i] += tile->time[i];
+    profile->stats.calls[i] += tile->calls[i];
+  }
+
+  if (tile->trace)
+  {
+    g_array_append_vals(profile->stats.trace, tile->trace->data, tile->trace->len);
+  }
+
+  profile->tiles++;
+  profile->tile_min = MIN(profile->tile_min, tile->time[PROFILE_TILE]);
+  if (tile->time[PROFILE_TILE] > profile->tile_max)
+  {
+    profile->tile_max = tile->time[PROFILE_TILE];
+    profile->slowest_x = x;
+    profile->slowest_y = y;
+  }
+}
+
+/* The trace is a JSON array of events, which may lack the closing bracket,
+ * so the events of every render are appended as it ends */
+static void
+WriteRenderTrace(RenderProfile* profile)
+{
+  const TraceEvent* event = NULL;
+  const char* output = NULL;
+  FILE* file = NULL;
+  guint i = 0;
+
+  output = GetTraceOutput();
+  file = output[0] ? fopen(output, trace_started ? "a" : "w") : stderr;
+  if (!file)
+  {
+    return;
+  }
+
+  fprintf(file, "%s{\"name\": \"RenderImage\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, "
+                "\"args\": {\"width\": %d, \"height\": %d, \"threads\": %d, \"tiles\": %d}}",
+          trace_started ? ",\n" : "[\n", GetTraceThread(), profile->start / 1e3, (profile->end - profile->start) / 1e3,
+          profile->width, profile->height, profile->threads, profile->tiles);
+  trace_started = TRUE;
+
+  for (i = 0; i < profile->stats.trace->len; i++)
+  {
+    event = &g_array_index(profile->stats.trace, TraceEvent, i);
+    fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"x\": %d, \"y\": %d",
+            event->name, event->thread, event->start / 1e3, (event->end - event->start) / 1e3, event->x, event->y);
+    if (event->plane >= 0)
+    {
+      fprintf(file, ", \"plane\": %d", event->plane);
+    }
+    fprintf(file, "}}");
+  }
+  fprintf(file, "\n");
+
+  if (file != stderr)
+  {
+    fclose(file);
+  }
+}
+
+static void
+PrintRenderProfile(RenderProfile* profile)
+{
+  const ProfileStats* stats = &profile->stats;
+  const char* output = NULL;
+  FILE* file = NULL;
+  double wall = NAN;
+  int i = 0;
+
+  output = GetProfileOutput();
+  file = output[0] ? fopen(output, "a") : stderr;
+  if (!file)
+  {
+    return;
+  }
+
+  wall = (profile->end - profile->start) / 1e6;
+
+  fprintf(file, "felimage profile: %dx%d, %d threads, %d tiles, %.3f ms, %.2f Mpixels/s\n",
+          profile->width, profile->height, profile->threads, profile->tiles, wall,
+          (double)profile->width * profile->height / wall / 1e3);
+  fprintf(file, "  %-6s %10s %12s %12s %7s\n", "stage", "calls", "total ms", "mean us", "share");
+  for (i = 0; i < PROFILE_STAGES; i++)
+  {
+    if (!stats->calls[i])
+    {
+      continue;
+    }
+    /* the share of the wall time of all the threads; the tile stages overlap
+     * the tiles, and the fetches the warps */
+    fprintf(file, "  %-6s %10" G_GINT64_FORMAT " %12.3f %12.3f %6.1f%%\n",
+            stage_names[i], stats->calls[i], stats->time[i] / 1e6,
+            stats->time[i] / 1e3 / stats->calls[i], 100.0 * stats->time[i] / 1e6 / wall / profile->threads);
+  }
+  if (profile->tiles)
+  {
+    fprintf(file, "  tiles: mean %.3f ms, min %.3f ms, max %.3f ms (the one at %d,%d)\n",
+            stats->time[PROFILE_TILE] / 1e6 / profile->tiles, profile->tile_min / 1e6,
+            profile->tile_max / 1e6, profile->slowest_x, profile->slowest_y);
+  }
+
+  if (file != stderr)
+  {
+    fclose(file);
+  }
+}
+
+void
+ReportRenderProfile(RenderProfile* profile)
+{
+  profile->end = ProfileNow();
+
+  if (GetProfileOutput())
+  {
+    PrintRenderProfile(profile);
+  }
+
+  if (profile->stats.trace)
+  {
+    WriteRenderTrace(profile);
+  }
+  ClearProfileStats(&profile->stats);
+}
@@ -0,0 +1,101 @@
+/*  Felimage Noise Plugin for the GIMP
+ *  Copyright (C) 2005 Guillermo Romero Franco <drirr_gato@users.sourceforge.net>
+ *
+ *  This file is part of the Felimage Noise Plugin for the GIMP
+ *
+ *  Felimage Noise Plugin for the Gimp is free software;
+ *  you can redistribute it and/or modify it under the terms of
+ *  the GNU General Public License as published by the Free Software
+ *  Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Felimage Noise Plugin for the Gimp is distributed in the hope
+ *  that it will be useful, but WITHOUT ANY WARRANTY; without even
+ *  the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ *  PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with fimg-noise; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#pragma once
+
+/* Opt-in timing of the stages of the renders, for finding where a slow render
+ * spends its time. Set FELIMAGE_PROFILE to 1 (or stderr) to print a summary
+ * of every RenderImage() to stderr, or to the name of a file to append them
+ * there. Set FELIMAGE_TRACE to the name of a file to write a timeline of the
+ * renders there, one span per stage of each tile, in the trace event format
+ * of chrome://tracing and Perfetto. Unset, the stages only test a NULL
+ * pointer */
+
+#define PROFILE_ENV "FELIMAGE_PROFILE"
+#define TRACE_ENV "FELIMAGE_TRACE"
+
+enum
+{
+  PROFILE_READ,  /* getting a band of the image, see RenderIO */
+  PROFILE_BASIS, /* the basis functions, a span per row */
+  PROFILE_SHADE, /* gain, output function and colors, a row at a time */
+  PROFILE_BLEND,
+  PROFILE_WARP,
+  PROFILE_FETCH, /* the pixels a warp takes, part of PROFILE_WARP */
+  PROFILE_WRITE, /* giving the band back */
+  PROFILE_TILE,  /* whole tiles: the basis, shading and blend, not the warp */
+  PROFILE_STAGES
+};
+
+/* a span of the trace, in one thread */
+typedef struct
+{
+  const char* name;
+  gint64 start, end;
+  int thread; /* see TraceSpan() */
+  int x, y;   /* where the tile starts */
+  int plane;  /* of RenderLow(), -1 if none */
+} TraceEvent;
+
+/* what one thread spent in each stage, in nanoseconds */
+typedef struct ProfileStatsStr
+{
+  gint64 time[PROFILE_STAGES];
+  gint64 calls[PROFILE_STAGES];
+  GArray* trace; /* of TraceEvent, NULL if not tracing */
+} ProfileStats;
+
+/* one render, summed over its tiles */
+typedef struct
+{
+  ProfileStats stats;
+  int width, height;
+  int threads;
+  int tiles;
+  gint64 start, end;
+  gint64 tile_min, tile_max;
+  int slowest_x, slowest_y; /* where the slowest tile starts */
+} RenderProfile;
+
+/* TRUE when PROFILE_ENV or TRACE_ENV ask for it, looked up once */
+gboolean ProfileEnabled(void);
+gboolean TraceEnabled(void);
+
+/* A monotonic clock, in nanoseconds */
+gint64 ProfileNow(void);
+
+#define ProfileAdd(STATS, STAGE, START, END) \
+  ((STATS)->time[STAGE] += (END) - (START), (STATS)->calls[STAGE]++)
+
+/* Adds a span to the trace of 'stats', if it has one. The spans are tagged
+ * with the calling thread, numbered from 1 as they first trace */
+void TraceSpan(ProfileStats* stats, const char* name, gint64 start, gint64 end, int x, int y, int plane);
+
+/* Starts timing a render */
+void InitRenderProfile(RenderProfile* profile, int width, int height);
+/* Empties 'stats' for another tile, with a trace if tracing */
+void ResetProfileStats(ProfileStats* stats);
+void ClearProfileStats(ProfileStats* stats);
+/* Adds the stats of a tile, rendered from x, y, to the render */
+void AddTileProfile(RenderProfile* profile, const ProfileStats* tile, int x, int y);
+/* Writes the summary where PROFILE_ENV says, and the trace where TRACE_ENV
+ * says, and frees the trace */
+void ReportRenderProfile(RenderProfile* profile);
@@ -5,74 +5,63 @@
  * period = (RANDOM_FACTOR*2^31)-1
  */
 
-#ifdef CALIBRATE
 #include <glib.h>
-#else
-#include <libgimp/gimp.h>
-#endif
 
 #include "random.h"
 
 #define RANDOM_FACTOR 1791398085
 
-static guint32 rand_x = 0, rand_c = 0, rand_ah = 0, rand_al = 0;
-
-guint16* global_shuffle_table = NULL;
-
 guint32
-Random()
+Random(RandomState* rnd)
 {
-  guint32 xh = rand_x >> 16, xl = rand_x & 65535;
+  guint32 xh = rnd->x >> 16, xl = rnd->x & 65535;
 
-  rand_x = rand_x * RANDOM_FACTOR + rand_c;
-  rand_c = xh * rand_ah + ((xh * rand_al) >> 16) + ((xl * rand_ah) >> 16);
-  if (xl * rand_al >= ~rand_c + 1)
-    rand_c++;
-  return rand_x;
+  rnd->x = rnd->x * RANDOM_FACTOR + rnd->c;
+  rnd->c = xh * rnd->ah + ((xh * rnd->al) >> 16) + ((xl * rnd->ah) >> 16);
+  if (xl * rnd->al >= ~rnd->c + 1)
+    rnd->c++;
+  return rnd->x;
 }
 
 void
-SetRandomSeed(guint32 seed)
+SetRandomSeed(RandomState* rnd, guint32 seed)
 {
-  rand_x = 30903;
-  rand_c = seed;
-  rand_ah = RANDOM_FACTOR >> 16;
-  rand_al = RANDOM_FACTOR & 65535;
+  rnd->x = 30903;
+  rnd->c = seed;
+  rnd->ah = RANDOM_FACTOR >> 16;
+  rnd->al = RANDOM_FACTOR & 65535;
 }
 
-void
-InitShuffleTable(guint32 seed)
+guint16*
+InitShuffleTable(RandomState* rnd)
 {
   guint32 i = 0, j = 0, t = 0;
   int fi = 0, bj = 0, fj = 0;
   guint16* back_shuffle_table = NULL;
-
-  SetRandomSeed(seed);
+  guint16* shuffle_table = NULL;
 
   back_shuffle_table = g_malloc(TABLE_SIZE * sizeof(guint16));
-
-  if (!global_shuffle_table)
-  {
-    global_shuffle_table = g_malloc(TABLE_SIZE * sizeof(guint16));
-  }
+  /* one spare entry, so vector code can read 32 bits at any index, then
+   * the two halves of the seed of the integer hash */
+  shuffle_table = g_malloc0((TABLE_SIZE + 3) * sizeof(guint16));
 
   for (i = 0; i < TABLE_SIZE; i++)
   {
     back_shuffle_table[i] = (i + TABLE_SIZE - 1) & (TABLE_SIZE - 1);
-    global_shuffle_table[i] = (i + 1) & (TABLE_SIZE - 1);
+    shuffle_table[i] = (i + 1) & (TABLE_SIZE - 1);
   }
 
   for (i = 0; i < TABLE_SIZE; i++)
   {
-    j = Random() >> (32 - TABLE_SIZE_LOG);
+    j = Random(rnd) >> (32 - TABLE_SIZE_LOG);
     bj = back_shuffle_table[j];
-    fi = global_shuffle_table[i];
-    fj = global_shuffle_table[j];
+    fi = shuffle_table[i];
+    fj = shuffle_table[j];
 
-    t = global_shuffle_table[i];
-    global_shuffle_table[i] = global_shuffle_table[bj];
-    global_shuffle_table[bj] = global_shuffle_table[j];
-    global_shuffle_table[j] = t;
+    t = shuffle_table[i];
+    shuffle_table[i] = shuffle_table[bj];
+    shuffle_table[bj] = shuffle_table[j];
+    shuffle_table[j] = t;
 
     t = back_shuffle_table[fi];
     back_shuffle_table[fi] = back_shuffle_table[fj];
@@ -81,14 +70,26 @@ InitShuffleTable(guint32 seed)
   }
 
   g_free(back_shuffle_table);
+
+  /* taken from the shuffle, so 'rnd' advances the same with either hash */
+  shuffle_table[TABLE_SIZE + 1] = shuffle_table[0] | (shuffle_table[1] << TABLE_SIZE_LOG);
+  shuffle_table[TABLE_SIZE + 2] = shuffle_table[2] | (shuffle_table[3] << TABLE_SIZE_LOG);
+
+  return shuffle_table;
 }
 
 void
-FinishShuffleTable()
+FinishShuffleTable(guint16* shuffle_table)
 {
-  if (global_shuffle_table)
-  {
-    g_free(global_shuffle_table);
-  }
-  global_shuffle_table = NULL;
+  g_free(shuffle_table);
+}
+
+const char*
+GetHashName(void)
+{
+#ifdef HASH_MIX
+  return "mix";
+#else
+  return "table";
+#endif
 }
@@ -21,10 +21,16 @@
  */
 #pragma once
 
-unsigned Random();
-void SetRandomSeed(guint32 seed);
+/* multiply-with-carry generator state, see random.c */
+typedef struct
+{
+  guint32 x, c, ah, al;
+} RandomState;
 
-#define RandomDbl() ((double)Random() / 4294967296.0)
+guint32 Random(RandomState* rnd);
+void SetRandomSeed(RandomState* rnd, guint32 seed);
+
+#define RandomDbl(RAND) ((double)Random(RAND) / 4294967296.0)
 
 /* Must be <= 16 */
 /* If this is changed, make sure to adjust the 5D lattice noise so that any assymetry
@@ -34,13 +40,44 @@ void SetRandomSeed(guint32 seed);
 
 #define TABLE_SIZE (1 << TABLE_SIZE_LOG)
 
-#define Hash1(A) global_shuffle_table[(A) & (TABLE_SIZE - 1)]
-#define Hash2(A, B) global_shuffle_table[((A) + Hash1(B)) & (TABLE_SIZE - 1)]
-#define Hash3(A, B, C) global_shuffle_table[((A) + Hash2(B, C)) & (TABLE_SIZE - 1)]
-#define Hash4(A, B, C, D) global_shuffle_table[((A) + Hash3(B, C, D)) & (TABLE_SIZE - 1)]
-#define Hash5(A, B, C, D, E) global_shuffle_table[((A) + Hash4(B, C, D, E)) & (TABLE_SIZE - 1)]
+/* These expect the table to hash with to be in scope as 'shuffle_table' */
+#ifndef HASH_MIX
+#define Hash1(A) shuffle_table[(A) & (TABLE_SIZE - 1)]
+#else
+/* The integer hash (configure --enable-mix-hash): each level mixes its index
+ * with the seed kept past the end of the table instead of loading from it,
+ * and keeps TABLE_SIZE_LOG bits like the table would */
+#define HashSeed(T) (((guint32)(T)[TABLE_SIZE + 1] << 16) | (T)[TABLE_SIZE + 2])
+#define Hash1(A) MixHash((A), HashSeed(shuffle_table))
+
+static inline guint32
+MixHash(guint32 a, guint32 seed)
+{
+  a = (a ^ seed) * 0x9e3779b1u;
+  a ^= a >> 15;
+  a *= 0x85ebca6bu;
+  return a >> (32 - TABLE_SIZE_LOG);
+}
+#endif
+
+#define Hash2(A, B) Hash1((A) + Hash1(B))
+#define Hash3(A, B, C) Hash1((A) + Hash2(B, C))
+#define Hash4(A, B, C, D) Hash1((A) + Hash3(B, C, D))
+#define Hash5(A, B, C, D, E) Hash1((A) + Hash4(B, C, D, E))
+
+/* 'a' modulo 'p', also for negative 'a'. Lattice indices wrapped with it
+ * repeat every 'p' cells, which makes the noise periodic */
+static inline int
+WrapIndex(int a, int p)
+{
+  a %= p;
+  return a < 0 ? a + p : a;
+}
 
-extern guint16* global_shuffle_table;
+/* "table" or "mix", the hash the noise core was built with */
+const char* GetHashName(void);
 
-void InitShuffleTable(guint32 seed);
-void FinishShuffleTable();
+/* returns a newly allocated table, shuffled using (and advancing) 'rnd'. The
+ * seed of the integer hash follows it, see Hash1() */
+guint16* InitShuffleTable(RandomState* rnd);
+void FinishShuffleTable(guint16* shuffle_table);
@@ -22,14 +22,14 @@
 
 #include "config.h"
 
-#include <gtk/gtk.h>
-
-#include <libgimp/gimp.h>
+#include <glib.h>
 #include <math.h>
+#include <string.h>
 
 #include "main.h"
 
 #include "basis.h"
+#include "profile.h"
 
 #include "render.h"
 
@@ -47,40 +47,279 @@
 
 #define FN_MODE(FUNCTION, REVERSE) ((FUNCTION << 1) + REVERSE)
 
-GimpPixelFetcher*
-GetPixelFetcher(PluginState* state, GimpDrawable* drawable)
+/* resolution of the output function table */
+#define SHADE_LUT_SAMPLES 8192
+#define SHADE_LUT_STRIDE (SHADE_LUT_SAMPLES + 2)
+
+static int FillRegionPlane(RenderData* rdat, float value);
+
+/* The output function: clamping, bias, pinch, the function itself, reverse
+ * and shift. 'value' is the basis value with the gain already applied */
+static inline double
+ShadeValue(const RenderData* rdat, double value, int function_mode)
 {
-  GimpPixelFetcher* fetcher = NULL;
-  GimpRGB bg_color = {0};
+  const double* bias_coef = rdat->bias_coef;
+  const double* pinch_coef = rdat->pinch_coef;
+  double frequency = rdat->frequency;
+
+  if (value > (1.0 - EPSILON))
+    value = (1.0 - EPSILON);
+  else if (value < EPSILON)
+    value = EPSILON;
+  else
+  {
+    value = (value) / (bias_coef[0] + bias_coef[1] * value);
 
-  fetcher = gimp_pixel_fetcher_new(drawable, FALSE);
+    if (value < 0.5)
+    {
+      value = (value) / (pinch_coef[0] + pinch_coef[1] * value);
+    }
+    else
+    {
+      value = (pinch_coef[2] + value) / (pinch_coef[3] + pinch_coef[4] * value);
+    }
+  }
 
-  if (state->edge_action == GIMP_PIXEL_FETCHER_EDGE_BACKGROUND)
+  switch (function_mode)
   {
-    gimp_context_get_background(&bg_color);
-    gimp_pixel_fetcher_set_bg_color(fetcher, &bg_color);
+    case FN_MODE(FUNC_RAMP, REVERSE_NO):
+      value = fmod(value * frequency, 1.0);
+      break;
+    case FN_MODE(FUNC_TRIANGLE, REVERSE_NO):
+      value = fmod(value * frequency, 1.0) * 2;
+      if (value > 1)
+        value = 2.0 - value;
+      break;
+    case FN_MODE(FUNC_SINE, REVERSE_NO):
+      value = (1 - cos(value * frequency)) * 0.5;
+      break;
+    case FN_MODE(FUNC_HALF_SINE, REVERSE_NO):
+      value = cos(value * frequency);
+      if (value < 0.0)
+        value = -value;
+      break;
+
+    case FN_MODE(FUNC_RAMP, REVERSE_YES):
+      value = 1 - fmod(value * frequency, 1.0);
+      break;
+    case FN_MODE(FUNC_TRIANGLE, REVERSE_YES):
+      value = fmod(value * frequency, 1.0) * 2;
+      if (value > 1)
+        value = 2.0 - value;
+      value = 1 - value;
+      break;
+    case FN_MODE(FUNC_SINE, REVERSE_YES):
+      value = (1 + cos(value * frequency)) * 0.5;
+      break;
+    case FN_MODE(FUNC_HALF_SINE, REVERSE_YES):
+      value = cos(value * frequency);
+      if (value < 0.0)
+        value = -value;
+      value = 1 - value;
+      break;
   }
 
-  gimp_pixel_fetcher_set_edge_mode(fetcher, state->edge_action);
+  value += rdat->shift;
+  if (value > 1.0)
+    value -= 1.0;
 
-  return fetcher;
+  return value;
 }
 
-static int FillRegionPlane(RenderData* rdat, float value);
+/* Samples ShadeValue() over the range left by the clamping, for both reverse
+ * modes. Each table has SHADE_LUT_SAMPLES entries, followed by the values for
+ * inputs clamped low and high, which skip bias and pinch */
+static void
+BuildShadeLut(RenderData* rdat)
+{
+  float* lut = NULL;
+  int function_mode = 0;
+  int i = 0, rev = 0;
+
+  if (!rdat->shade_lut)
+  {
+    rdat->shade_lut = g_new(float, 2 * SHADE_LUT_STRIDE);
+  }
+
+  for (rev = 0; rev < 2; rev++)
+  {
+    lut = rdat->shade_lut + rev * SHADE_LUT_STRIDE;
+    function_mode = FN_MODE(rdat->p_state->function, rev);
+    for (i = 0; i < SHADE_LUT_SAMPLES; i++)
+    {
+      lut[i] = ShadeValue(rdat, EPSILON + i * ((1.0 - 2.0 * EPSILON) / (SHADE_LUT_SAMPLES - 1)), function_mode);
+    }
+    lut[SHADE_LUT_SAMPLES] = ShadeValue(rdat, 0.0, function_mode);
+    lut[SHADE_LUT_SAMPLES + 1] = ShadeValue(rdat, 1.0, function_mode);
+  }
+}
+
+/* ShadeValue() out of line, to keep the row loops below small */
+static double
+ShadeValueCall(const RenderData* rdat, double value)
+{
+  return ShadeValue(rdat, value, rdat->function_mode);
+}
+
+/* The shading of one row, written as 'write_mode' (a constant in each of
+ * the ShadeRow functions below, so the switch goes away). Each pixel takes
+ * the sample at the corner of its step x step block. The shading goes
+ * through the table unless 'exact', or ShadeValue() is more accurate */
+static inline float*
+ShadeRowBody(const RenderData* rdat, const double* src, int step, float* p, int write_mode, int exact)
+{
+  const double* gradient = rdat->gradient;
+  const float* shade_lut = rdat->shade_lut + (rdat->function_mode & 1) * SHADE_LUT_STRIDE;
+  double lut_scale = (SHADE_LUT_SAMPLES - 1) / (1.0 - 2.0 * EPSILON);
+  double lut_pos = NAN, lut_a = NAN, lut_b = NAN;
+  int lut_idx = 0;
+  double gain = rdat->gain;
+  int pixel_stride = rdat->pixel_stride;
+  int width = rdat->region_width;
+  double value = NAN;
+  int x = 0;
+  int vp = 0;
+
+  for (x = 0; x < width; x++)
+  {
+    value = (src[(step > 1) ? x - x % step : x] * gain) + 0.5;
+
+    if (exact || isnan(value)) /* multifractals can give NaNs */
+    {
+      value = ShadeValueCall(rdat, value);
+    }
+    else if (value > (1.0 - EPSILON))
+    {
+      value = shade_lut[SHADE_LUT_SAMPLES + 1];
+    }
+    else if (value < EPSILON)
+    {
+      value = shade_lut[SHADE_LUT_SAMPLES];
+    }
+    else
+    {
+      lut_pos = (value - EPSILON) * lut_scale;
+      lut_idx = (int)lut_pos;
+      if (lut_idx > SHADE_LUT_SAMPLES - 2)
+      {
+        lut_idx = SHADE_LUT_SAMPLES - 2;
+      }
+      lut_pos -= lut_idx;
+      lut_a = shade_lut[lut_idx];
+      lut_b = shade_lut[lut_idx + 1];
+      /* don't blend across the jump of a ramp or of the shift */
+      if (fabs(lut_b - lut_a) > 0.5)
+      {
+        value = ShadeValueCall(rdat, value);
+      }
+      else
+      {
+        value = lut_a + (lut_b - lut_a) * lut_pos;
+      }
+    }
+
+    switch (write_mode)
+    {
+      case MODE_RAW: /* write the value as-is */
+        p[0] = value;
+        p += pixel_stride;
+        break;
+      case MODE_COLOR: /* write the value as RGBA */
+        vp = 4 * CAST_TO_INT((GRADIENT_SAMPLES - 1) * value);
+        p[0] = gradient[vp];
+        p[1] = gradient[vp + 1];
+        p[2] = gradient[vp + 2];
+        p[3] = gradient[vp + 3];
+        p += 4; /* pixel_stride */
+        break;
+      case MODE_GRAYSCALE: /* write the value as GRAY-A*/
+        vp = 2 * CAST_TO_INT((GRADIENT_SAMPLES - 1) * value);
+        p[0] = gradient[vp];
+        p[1] = gradient[vp + 1];
+        p += 2; /* pixel_stride */
+        break;
+    }
+  }
+  return p;
+}
+
+#define SHADE_ROW(NAME, WRITE_MODE)                                                  \
+  static float* NAME(const RenderData* rdat, const double* src, int step, float* p) \
+  {                                                                                  \
+    return ShadeRowBody(rdat, src, step, p, WRITE_MODE, 0);                          \
+  }
+
+SHADE_ROW(ShadeRowRaw, MODE_RAW)
+SHADE_ROW(ShadeRowColor, MODE_COLOR)
+SHADE_ROW(ShadeRowGrayscale, MODE_GRAYSCALE)
+
+/* the exact shading is slow anyway, one function does all the write modes */
+static float*
+ShadeRowExact(const RenderData* rdat, const double* src, int step, float* p)
+{
+  return ShadeRowBody(rdat, src, step, p, rdat->write_mode, 1);
+}
+
+static ShadeRowFn* const shade_rows[3] = {ShadeRowRaw, ShadeRowColor, ShadeRowGrayscale};
+
+static void
+UnrefAngleTable(AngleTable* angles)
+{
+  if (angles && g_atomic_int_dec_and_test(&angles->refs))
+  {
+    g_free(angles);
+  }
+}
+
+/* Gets the angle table of 'width' columns and 'rows' rows, reusing 'angles'
+ * when it is the same size, or freeing it when it's the last reference */
+static AngleTable*
+GetAngleTable(AngleTable* angles, int width, int rows)
+{
+  int i = 0;
+
+  if (angles && angles->width == width && angles->rows == rows)
+  {
+    return angles;
+  }
+  UnrefAngleTable(angles);
+
+  /* all in one block, with the arrays after the header */
+  angles = g_malloc(sizeof(AngleTable) + 2 * (width + rows) * sizeof(double));
+  angles->refs = 1;
+  angles->width = width;
+  angles->rows = rows;
+  angles->col_cos = (double*)(angles + 1);
+  angles->col_sin = angles->col_cos + width;
+  angles->row_cos = angles->col_sin + width;
+  angles->row_sin = angles->row_cos + rows;
+
+  for (i = 0; i < width; i++)
+  {
+    angles->col_cos[i] = cos((i * M_PI * 2.0) / width);
+    angles->col_sin[i] = sin((i * M_PI * 2.0) / width);
+  }
+  for (i = 0; i < rows; i++)
+  {
+    angles->row_cos[i] = cos((i * M_PI * 2.0) / rows);
+    angles->row_sin[i] = sin((i * M_PI * 2.0) / rows);
+  }
+  return angles;
+}
 
 static void
 PrecalcRenderStuff(RenderData* rdat)
 {
   PluginState* state = NULL;
   guint dirty = 0;
-  int failed = 0;
   double gain = NAN, pinch = NAN, bias = NAN;
-  GimpRGB col_fg_bg = {0}, col_bg = {0};
-  char* grad_name = NULL;
+  double fg[4] = {0}, bg[4] = {0};
+  const double* c1 = NULL;
+  const double* c2 = NULL;
   double tmp = NAN, tmp2 = NAN;
   int tot_samples = 0;
-  int i = 0, j = 0;
-  gdouble* fp_gradient = NULL;
+  int i = 0, j = 0, k = 0;
+  int period_x = 0, period_y = 0; /* only InitBasis() needs these */
   double s = NAN;
 
   dirty = rdat->dirty;
@@ -89,12 +328,11 @@ PrecalcRenderStuff(RenderData* rdat)
 
   state = rdat->p_state;
 
-  if (dirty & DIRTY_FEATURE_SIZE)
+  if (dirty & (DIRTY_FEATURE_SIZE | DIRTY_MAPPING | DIRTY_BUFFER_TYPE))
   {
-    rdat->dx = 0.5 / state->size_x;
-    rdat->dy = 0.5 / state->size_y;
+    GetBasisPixelSize(rdat, &rdat->dx, &rdat->dy, &period_x, &period_y);
   }
-  if (dirty & (DIRTY_FEATURE_SIZE | DIRTY_REGION_PARAMS | DIRTY_BUFFER_TYPE))
+  if (dirty & (DIRTY_FEATURE_SIZE | DIRTY_MAPPING | DIRTY_REGION_PARAMS | DIRTY_BUFFER_TYPE))
   {
     rdat->px = rdat->dx * (rdat->region_x - rdat->x_offs);
     rdat->py = rdat->dy * (rdat->region_y - rdat->y_offs);
@@ -111,9 +349,20 @@ PrecalcRenderStuff(RenderData* rdat)
       rdat->buffer = g_malloc(tot_samples);
       rdat->buf_alloc = tot_samples;
     }
+
+    /* up to 5 coordinates per sample, plus its value */
+    if (rdat->row_alloc < rdat->region_width)
+    {
+      if (rdat->row)
+      {
+        g_free(rdat->row);
+      }
+      rdat->row = g_new(double, 6 * rdat->region_width);
+      rdat->row_alloc = rdat->region_width;
+    }
   }
 
-  if (dirty & (DIRTY_MAPPING | DIRTY_BUFFER_TYPE | DIRTY_REGION_PARAMS))
+  if (dirty & (DIRTY_FEATURE_SIZE | DIRTY_MAPPING | DIRTY_BUFFER_TYPE | DIRTY_REGION_PARAMS))
   {
     rdat->polar = 0;
     if (state->mapping == MAP_TILED || state->mapping == MAP_SPHERICAL)
@@ -134,6 +383,10 @@ PrecalcRenderStuff(RenderData* rdat)
       }
       rdat->dang2 = (M_PI * 2.0) / rdat->buffer_width;
 
+      /* half a turn down the sphere makes the whole turn twice its height */
+      rdat->angles = GetAngleTable(rdat->angles, rdat->buffer_width,
+                                   (state->mapping == MAP_SPHERICAL) ? 2 * rdat->buffer_height : rdat->buffer_height);
+
       rdat->polar = 1;
     }
   }
@@ -222,6 +475,20 @@ PrecalcRenderStuff(RenderData* rdat)
     rdat->average = tmp;
   }
 
+  if (dirty & (DIRTY_OUTPUT_FUNCTION | DIRTY_GAIN_PINCH_BIAS))
+  {
+    BuildShadeLut(rdat);
+  }
+
+  if (dirty & (DIRTY_OUTPUT_FUNCTION | DIRTY_BUFFER_TYPE))
+  {
+    rdat->shade_row = NULL;
+    if (rdat->write_mode >= MODE_RAW && rdat->write_mode <= MODE_GRAYSCALE)
+    {
+      rdat->shade_row = state->exact_shading ? ShadeRowExact : shade_rows[rdat->write_mode];
+    }
+  }
+
   if (dirty & (DIRTY_BASIS | DIRTY_FEATURE_SIZE | DIRTY_WARP))
   {
 
@@ -263,43 +530,44 @@ PrecalcRenderStuff(RenderData* rdat)
       rdat->gradient = NULL;
     }
 
-    failed = 0;
-    if (state->color_src == COL_GRADIENT)
+    if (state->color_src == COL_GRADIENT && rdat->grad_samples)
     {
-      grad_name = GetGradientName(state->gradient);
-      if (grad_name && gimp_gradient_get_uniform_samples(
-                         grad_name,
-                         GRADIENT_SAMPLES,
-                         0,
-                         &tot_samples,
-                         &fp_gradient))
+      rdat->gradient = g_malloc(GRADIENT_SAMPLES * sizeof(double) * 4);
+      for (i = 0; i < GRADIENT_SAMPLES; i++)
       {
-        rdat->gradient = fp_gradient;
-        if (rdat->write_mode != MODE_COLOR)
+        /* resampled, if the caller gave another number of samples */
+        s = (double)i * (rdat->grad_count - 1) / (GRADIENT_SAMPLES - 1);
+        j = MIN((int)s, rdat->grad_count - 1);
+        s -= j;
+        c1 = rdat->grad_samples + 4 * j;
+        c2 = rdat->grad_samples + 4 * MIN(j + 1, rdat->grad_count - 1);
+
+        for (k = 0; k < 4; k++)
+        {
+          fg[k] = c1[k] * (1.0 - s) + c2[k] * s;
+        }
+
+        if (rdat->write_mode == MODE_COLOR)
         {
-          for (i = j = 0; j < tot_samples; i += 2, j += 4)
+          for (k = 0; k < 4; k++)
           {
-            fp_gradient[i + 0] = fp_gradient[j + 0] * 0.30 + fp_gradient[j + 1] * 0.59 + fp_gradient[j + 2] * 0.11;
-            fp_gradient[i + 1] = fp_gradient[j + 3];
+            rdat->gradient[i * 4 + k] = fg[k];
           }
         }
+        else
+        {
+          rdat->gradient[i * 2 + 0] = fg[0] * 0.30 + fg[1] * 0.59 + fg[2] * 0.11;
+          rdat->gradient[i * 2 + 1] = fg[3];
+        }
       }
-      else
-      {
-        failed = 1;
-      }
-      g_free(grad_name);
     }
-
-    if (failed || state->color_src == COL_FG_BG)
+    else /* without a gradient, gradient presets use the colors too */
     {
-      gimp_context_get_foreground(&col_fg_bg);
-      gimp_context_get_background(&col_bg);
-
-      col_fg_bg.r -= col_bg.r;
-      col_fg_bg.g -= col_bg.b;
-      col_fg_bg.b -= col_bg.g;
-      col_fg_bg.a -= col_bg.a;
+      for (k = 0; k < 4; k++)
+      {
+        fg[k] = rdat->fg[k] - rdat->bg[k];
+        bg[k] = rdat->bg[k];
+      }
 
       if (rdat->write_mode == MODE_COLOR)
       {
@@ -307,21 +575,21 @@ PrecalcRenderStuff(RenderData* rdat)
         for (i = 0; i < GRADIENT_SAMPLES * 4; i += 4)
         {
           s = (double)i / (double)(GRADIENT_SAMPLES * 4 - 4);
-          rdat->gradient[i + 0] = SCALE_TO_BUFFER(col_fg_bg.r * s + col_bg.r);
-          rdat->gradient[i + 1] = SCALE_TO_BUFFER(col_fg_bg.g * s + col_bg.g);
-          rdat->gradient[i + 2] = SCALE_TO_BUFFER(col_fg_bg.b * s + col_bg.b);
+          rdat->gradient[i + 0] = SCALE_TO_BUFFER(fg[0] * s + bg[0]);
+          rdat->gradient[i + 1] = SCALE_TO_BUFFER(fg[1] * s + bg[1]);
+          rdat->gradient[i + 2] = SCALE_TO_BUFFER(fg[2] * s + bg[2]);
           rdat->gradient[i + 3] = VALUE_MAX;
         }
       }
       else
       {
         rdat->gradient = g_malloc(GRADIENT_SAMPLES * sizeof(double) * 2);
-        col_fg_bg.r = 0.30 * col_fg_bg.r + 0.59 * col_fg_bg.g + 0.11 * col_fg_bg.b;
-        col_bg.r = 0.30 * col_bg.r + 0.59 * col_bg.g + 0.11 * col_bg.b;
+        fg[0] = 0.30 * fg[0] + 0.59 * fg[1] + 0.11 * fg[2];
+        bg[0] = 0.30 * bg[0] + 0.59 * bg[1] + 0.11 * bg[2];
         for (i = 0; i < GRADIENT_SAMPLES * 2; i += 2)
         {
           s = (double)i / (double)(GRADIENT_SAMPLES * 2 - 2);
-          rdat->gradient[i + 0] = SCALE_TO_BUFFER(col_fg_bg.r * s + col_bg.r);
+          rdat->gradient[i + 0] = SCALE_TO_BUFFER(fg[0] * s + bg[0]);
           rdat->gradient[i + 1] = VALUE_MAX;
         }
       }
@@ -336,9 +604,30 @@ void
 InitRenderData(RenderData* rdat)
 {
   rdat->gradient = NULL;
+  rdat->grad_samples = NULL;
+  rdat->grad_count = 0;
+  /* the default colors of the GIMP */
+  rdat->fg[0] = rdat->fg[1] = rdat->fg[2] = 0.0;
+  rdat->bg[0] = rdat->bg[1] = rdat->bg[2] = 1.0;
+  rdat->fg[3] = rdat->bg[3] = 1.0;
+  rdat->shade_lut = NULL;
   rdat->buffer = NULL;
   rdat->dirty = ~0;
   rdat->buf_alloc = 0;
+  rdat->row = NULL;
+  rdat->row_alloc = 0;
+  rdat->keep_raw = 0;
+  memset(rdat->raw, 0, sizeof(rdat->raw));
+  rdat->raw_next = 0;
+  rdat->step = 1;
+  rdat->step_shown = 0;
+  rdat->cancel_gen = NULL;
+  rdat->gen = 0;
+  rdat->angles = NULL;
+  rdat->shade_row = NULL;
+  rdat->basis_ctx = NULL;
+  rdat->basis_data = NULL;
+  rdat->profile = NULL;
 }
 
 void
@@ -354,6 +643,61 @@ SetRenderStateDirty(RenderData* rdat, guint dirty)
   rdat->dirty |= dirty;
 }
 
+/* Keeps the raw basis values of the last few planes rendered, so a render
+ * which only changes the shading (gain, bias, function, colors..) skips the
+ * basis. Worth it for the preview, where that is what most edits do */
+void
+SetRenderKeepRaw(RenderData* rdat, int keep)
+{
+  int i = 0;
+
+  rdat->keep_raw = keep;
+  if (!keep)
+  {
+    for (i = 0; i < RAW_CACHE_SLOTS; i++)
+    {
+      g_free(rdat->raw[i].values);
+    }
+    memset(rdat->raw, 0, sizeof(rdat->raw));
+    rdat->raw_next = 0;
+  }
+}
+
+/* Times the stages of what is rendered with 'rdat' into 'profile', which only
+ * this thread may use (see profile.h). NULL stops timing */
+void
+SetRenderProfile(RenderData* rdat, struct ProfileStatsStr* profile)
+{
+  rdat->profile = profile;
+}
+
+/* With the raw values kept, renders sample the basis only every 'step' pixels
+ * (a power of two) and repeat those samples over the pixels in between. A
+ * later render with a finer step only samples the pixels still missing, so
+ * the preview can be refined pass by pass. 'step_shown' tells the coarsest
+ * step actually rendered, which is finer when the cache already had more */
+void
+SetRenderStep(RenderData* rdat, int step)
+{
+  rdat->step = MAX(step, 1);
+  rdat->step_shown = 0;
+}
+
+/* Makes the renders give up, returning -1, at the next row once '*generation'
+ * is no longer 'current'. A NULL 'generation' never cancels */
+void
+SetRenderCancel(RenderData* rdat, volatile gint* generation, gint current)
+{
+  rdat->cancel_gen = generation;
+  rdat->gen = current;
+}
+
+static inline int
+RenderCancelled(const RenderData* rdat)
+{
+  return rdat->cancel_gen && g_atomic_int_get(rdat->cancel_gen) != rdat->gen;
+}
+
 void
 SetRenderBuffer(RenderData* rdat, int width, int height, int offset_x, int offset_y, int mode, int pixel_stride)
 {
@@ -385,35 +729,6 @@ SetRenderBufferMode(RenderData* rdat, int mode, int pixel_stride)
   rdat->dirty |= DIRTY_BUFFER_TYPE;
 }
 
-void
-SetRenderBufferForDrawable(RenderData* rdat, GimpDrawable* drawable)
-{
-  int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
-
-  gimp_drawable_mask_bounds(drawable->drawable_id, &x1, &y1, &x2, &y2);
-
-  rdat->buffer_width = x2 - x1;
-  rdat->buffer_height = y2 - y1;
-  rdat->x_offs = x1;
-  rdat->y_offs = y1;
-
-  switch (drawable->bpp)
-  {
-    case 1:
-    case 2:
-      rdat->write_mode = MODE_GRAYSCALE;
-      rdat->pixel_stride = 2;
-      break;
-    case 3:
-    case 4:
-      rdat->write_mode = MODE_COLOR;
-      rdat->pixel_stride = 4;
-      break;
-  }
-
-  rdat->dirty |= DIRTY_BUFFER_TYPE;
-}
-
 void
 SetRenderRegion(RenderData* rdat, int width, int height, int region_x, int region_y)
 {
@@ -432,122 +747,379 @@ DeinitRenderData(RenderData* rdat)
     g_free(rdat->gradient);
     rdat->gradient = NULL;
   }
+  SetRenderGradient(rdat, NULL, 0);
+  if (rdat->shade_lut)
+  {
+    g_free(rdat->shade_lut);
+    rdat->shade_lut = NULL;
+  }
   if (rdat->buffer)
   {
     g_free(rdat->buffer);
     rdat->buffer = NULL;
   }
   rdat->buf_alloc = 0;
+  if (rdat->row)
+  {
+    g_free(rdat->row);
+    rdat->row = NULL;
+  }
+  rdat->row_alloc = 0;
+  UnrefAngleTable(rdat->angles);
+  rdat->angles = NULL;
+  SetRenderKeepRaw(rdat, 0);
+  rdat->basis_data = NULL;
 }
 
-/*****************************************************************************/
+/* A copy of 'size' bytes of 'mem' (g_memdup() takes a guint size and is
+ * deprecated since GLib 2.68) */
+gpointer
+RenderMemDup(gconstpointer mem, gsize size)
+{
+  gpointer copy = NULL;
+
+  copy = g_malloc(size);
+  memcpy(copy, mem, size);
+  return copy;
+}
 
+/* Makes 'dst' a copy of 'src' which can be rendered from another thread. Only
+ * the plugin state, the basis context and data and the angle table are shared,
+ * and they are never modified while rendering. 'dst' must be deinitialized
+ * before 'src' */
 void
-Render(gint32 image_ID,
-       GimpDrawable* drawable,
-       PluginState* state)
+CloneRenderData(RenderData* dst, RenderData* src)
 {
+  if (src->dirty)
+  {
+    PrecalcRenderStuff(src);
+  }
 
-  GimpPixelRgn dst_rgn = {0};
-  GimpPixelRgn src_rgn = {0};
+  *dst = *src;
 
-  gint progress = 0, max_progress = 0;
-  gint has_alpha = 0, alpha = 0;
-  gint x1 = 0, y1 = 0, x2 = 0, y2 = 0;
-  gpointer pr = NULL;
-  GimpPixelFetcher* fetcher = NULL;
-  RenderData rdat = {0};
+  dst->buffer = NULL;
+  dst->buf_alloc = 0;
+  dst->row = NULL;
+  dst->row_alloc = 0;
+  dst->keep_raw = 0;
+  memset(dst->raw, 0, sizeof(dst->raw));
+  dst->raw_next = 0;
+  dst->step = 1;
+  dst->profile = NULL;
 
-  gimp_drawable_mask_bounds(drawable->drawable_id, &x1, &y1, &x2, &y2);
-  has_alpha = gimp_drawable_has_alpha(drawable->drawable_id);
+  if (src->gradient)
+  {
+    dst->gradient = RenderMemDup(src->gradient, GRADIENT_SAMPLES * sizeof(double) * ((src->write_mode == MODE_COLOR) ? 4 : 2));
+  }
+  if (src->grad_samples)
+  {
+    dst->grad_samples = RenderMemDup(src->grad_samples, src->grad_count * 4 * sizeof(double));
+  }
+  if (src->shade_lut)
+  {
+    dst->shade_lut = RenderMemDup(src->shade_lut, 2 * SHADE_LUT_STRIDE * sizeof(float));
+  }
+  if (src->angles)
+  {
+    g_atomic_int_inc(&src->angles->refs);
+  }
+}
 
-  alpha = drawable->bpp - 1;
+/* The foreground and background colors (RGBA, 0..1) of the renders. Only
+ * touches the render data when they change */
+void
+SetRenderColors(RenderData* rdat, const double* fg, const double* bg)
+{
+  if (memcmp(rdat->fg, fg, sizeof(rdat->fg)) || memcmp(rdat->bg, bg, sizeof(rdat->bg)))
+  {
+    memcpy(rdat->fg, fg, sizeof(rdat->fg));
+    memcpy(rdat->bg, bg, sizeof(rdat->bg));
+    rdat->dirty |= DIRTY_COLOR;
+  }
+}
 
-  progress = 0;
-  max_progress = (x2 - x1) * (y2 - y1);
+/* The gradient of the gradient presets: 'count' RGBA samples, evenly spaced
+ * from one end to the other. Without one (NULL), they use the colors */
+void
+SetRenderGradient(RenderData* rdat, const double* samples, int count)
+{
+  if (!samples || count <= 0)
+  {
+    samples = NULL;
+    count = 0;
+  }
+  if (count == rdat->grad_count && (!count || !memcmp(rdat->grad_samples, samples, count * 4 * sizeof(double))))
+  {
+    return;
+  }
 
-  gimp_pixel_rgn_init(&dst_rgn, drawable, x1, y1, (x2 - x1), (y2 - y1), TRUE, TRUE);
-  gimp_pixel_rgn_init(&src_rgn, drawable, x1, y1, (x2 - x1), (y2 - y1), FALSE, FALSE);
+  g_free(rdat->grad_samples);
+  rdat->grad_samples = samples ? RenderMemDup(samples, count * 4 * sizeof(double)) : NULL;
+  rdat->grad_count = count;
+  rdat->dirty |= DIRTY_COLOR;
+}
+
+/*****************************************************************************/
 
-  InitRenderData(&rdat);
-  AssociateRenderToState(&rdat, state);
-  InitBasis(&rdat);
+typedef struct
+{
+  GMutex lock;
+  GCond done;
+  int pending;
+} RenderPool;
 
-  gimp_progress_init("Rendering noise...");
-  SetRenderBufferForDrawable(&rdat, drawable);
+typedef struct
+{
+  RenderData rdat;
+  int color_src;
+  guchar* data; /* where the tile starts inside the band */
+  int row_stride;
+  int bytes_pp;
+  ProfileStats profile; /* of this band, see SetRenderProfile() */
+} RenderTile;
 
-  switch (state->color_src)
+static int
+GetRenderThreads(PluginState* state)
+{
+  int threads = 0;
+
+  threads = state->threads;
+  if (threads <= 0)
+  {
+    threads = g_get_num_processors();
+  }
+  return CLAMP(threads, 1, MAX_RENDER_THREADS);
+}
+
+static void
+RenderTileNoise(RenderTile* tile)
+{
+  gint64 start = 0, end = 0;
+
+  start = tile->rdat.profile ? ProfileNow() : 0;
+
+  switch (tile->color_src)
   {
     case COL_CHANNELS:
-      SetRenderBufferMode(&rdat, MODE_RAW, (drawable->bpp <= 2) ? 2 : 4);
-      for (pr = gimp_pixel_rgns_register(2, &dst_rgn, &src_rgn); pr != NULL;
-           pr = gimp_pixel_rgns_process(pr))
-      {
+      RenderChannels(&tile->rdat);
+      Blend(&tile->rdat, tile->data, tile->data, tile->row_stride, tile->bytes_pp);
+      break;
+    case COL_WARP:
+      /* the warp itself is done later, the pixel fetcher is not threadsafe */
+      RenderWarp(&tile->rdat, 2);
+      break;
+    default:
+      RenderLow(&tile->rdat, 0);
+      Blend(&tile->rdat, tile->data, tile->data, tile->row_stride, tile->bytes_pp);
+      break;
+  }
+
+  if (tile->rdat.profile)
+  {
+    end = ProfileNow();
+    ProfileAdd(tile->rdat.profile, PROFILE_TILE, start, end);
+    TraceSpan(tile->rdat.profile, "tile", start, end, tile->rdat.region_x, tile->rdat.region_y, -1);
+  }
+}
 
-        SetRenderRegion(&rdat, dst_rgn.w, dst_rgn.h, dst_rgn.x, dst_rgn.y);
+static void
+RenderTileWorker(gpointer data, gpointer user_data)
+{
+  RenderTile* tile = data;
+  RenderPool* pool = user_data;
 
-        RenderChannels(&rdat);
-        Blend(&rdat, src_rgn.data, dst_rgn.data, src_rgn.rowstride, src_rgn.bpp);
+  RenderTileNoise(tile);
 
-        progress += dst_rgn.w * dst_rgn.h;
-        gimp_progress_update((double)progress / max_progress);
-      }
+  g_mutex_lock(&pool->lock);
+  pool->pending--;
+  if (!pool->pending)
+  {
+    g_cond_signal(&pool->done);
+  }
+  g_mutex_unlock(&pool->lock);
+}
+
+/* The buffer is processed in bands one tile high. The tiles of each band are
+ * rendered concurrently, and the band is read, warped and written by this
+ * thread only, so 'io' needn't be thread safe (libgimp isn't). The output
+ * doesn't depend on the number of threads. 'rdat' must be associated to a
+ * state and have its colors and buffer set (see SetRenderBuffer()). The
+ * stages are timed when PROFILE_ENV asks for it, see profile.h */
+void
+RenderImage(RenderData* rdat, int bytes_pp, int tile_w, int tile_h, const RenderIO* io)
+{
+  PluginState* state = NULL;
+  gint x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+  gint x = 0, y = 0, tile_x2 = 0, band_y2 = 0;
+  gint i = 0, tiles = 0;
+  gint threads = 0;
+  gint row_stride = 0;
+  guchar* band = NULL;
+  GThreadPool* thread_pool = NULL;
+  RenderPool pool = {0};
+  RenderTile* tile = NULL;
+  RenderProfile profile = {0};
+  gboolean profiling = FALSE;
+  gint64 start = 0, end = 0;
+
+  state = rdat->p_state;
+
+  x1 = rdat->x_offs;
+  y1 = rdat->y_offs;
+  x2 = x1 + rdat->buffer_width;
+  y2 = y1 + rdat->buffer_height;
+
+  profiling = ProfileEnabled();
+  if (profiling)
+  {
+    InitRenderProfile(&profile, x2 - x1, y2 - y1);
+  }
+
+  InitBasis(rdat);
+
+  switch (state->color_src)
+  {
+    case COL_CHANNELS:
+      SetRenderBufferMode(rdat, MODE_RAW, (bytes_pp <= 2) ? 2 : 4);
       break;
     case COL_WARP:
-      SetRenderBufferMode(&rdat, MODE_RAW, 1);
-      fetcher = GetPixelFetcher(state, drawable);
-      gimp_pixel_fetcher_set_edge_mode(fetcher, state->edge_action);
-      for (pr = gimp_pixel_rgns_register(1, &dst_rgn); pr != NULL;
-           pr = gimp_pixel_rgns_process(pr))
-      {
+      SetRenderBufferMode(rdat, MODE_RAW, 1);
+      break;
+  }
+
+  /* one tile per column of the band, each with its own render data */
+  tiles = (x2 - 1) / tile_w - x1 / tile_w + 1;
+  tile = g_new0(RenderTile, tiles);
+  for (i = 0; i < tiles; i++)
+  {
+    CloneRenderData(&tile[i].rdat, rdat);
+    tile[i].color_src = state->color_src;
+    tile[i].bytes_pp = bytes_pp;
+    if (profiling)
+    {
+      SetRenderProfile(&tile[i].rdat, &tile[i].profile);
+    }
+  }
+
+  row_stride = (x2 - x1) * bytes_pp;
+  band = g_new(guchar, row_stride * tile_h);
 
-        SetRenderRegion(&rdat, dst_rgn.w, dst_rgn.h, dst_rgn.x, dst_rgn.y);
+  threads = MIN(GetRenderThreads(state), tiles);
+  profile.threads = threads;
 
-        RenderWarp(&rdat, 2);
-        Warp(&rdat, fetcher, dst_rgn.data, dst_rgn.rowstride, dst_rgn.bpp, 2);
+  if (threads > 1)
+  {
+    g_mutex_init(&pool.lock);
+    g_cond_init(&pool.done);
+    thread_pool = g_thread_pool_new(RenderTileWorker, &pool, threads, TRUE, NULL);
+  }
+
+  for (y = y1; y < y2; y = band_y2)
+  {
+    band_y2 = MIN((y / tile_h + 1) * tile_h, y2);
 
-        progress += dst_rgn.w * dst_rgn.h;
-        gimp_progress_update((double)progress / max_progress);
+    if (state->color_src != COL_WARP)
+    {
+      start = profiling ? ProfileNow() : 0;
+      io->read_band(io->data, band, y, band_y2 - y);
+      if (profiling)
+      {
+        end = ProfileNow();
+        ProfileAdd(&profile.stats, PROFILE_READ, start, end);
+        TraceSpan(&profile.stats, "read", start, end, x1, y, -1);
       }
+    }
 
-      gimp_pixel_fetcher_destroy(fetcher);
-      break;
+    pool.pending = tiles;
+    for (x = x1, i = 0; x < x2; x = tile_x2, i++)
+    {
+      tile_x2 = MIN((x / tile_w + 1) * tile_w, x2);
 
-    default:
-      for (pr = gimp_pixel_rgns_register(2, &dst_rgn, &src_rgn); pr != NULL;
-           pr = gimp_pixel_rgns_process(pr))
+      SetRenderRegion(&tile[i].rdat, tile_x2 - x, band_y2 - y, x, y);
+      tile[i].data = band + (x - x1) * bytes_pp;
+      tile[i].row_stride = row_stride;
+      ResetProfileStats(&tile[i].profile);
+
+      if (thread_pool)
+      {
+        g_thread_pool_push(thread_pool, &tile[i], NULL);
+      }
+      else
       {
+        RenderTileNoise(&tile[i]);
+      }
+    }
 
-        SetRenderRegion(&rdat, dst_rgn.w, dst_rgn.h, dst_rgn.x, dst_rgn.y);
+    if (thread_pool)
+    {
+      g_mutex_lock(&pool.lock);
+      while (pool.pending)
+      {
+        g_cond_wait(&pool.done, &pool.lock);
+      }
+      g_mutex_unlock(&pool.lock);
+    }
 
-        RenderLow(&rdat, 0);
-        Blend(&rdat, src_rgn.data, dst_rgn.data, dst_rgn.rowstride, dst_rgn.bpp);
+    if (state->color_src == COL_WARP)
+    {
+      for (i = 0; i < tiles; i++)
+      {
+        Warp(&tile[i].rdat, io->fetch, io->fetcher, tile[i].data, row_stride, bytes_pp, 2);
+      }
+    }
 
-        progress += dst_rgn.w * dst_rgn.h;
-        gimp_progress_update((double)progress / max_progress);
+    if (profiling)
+    {
+      for (i = 0; i < tiles; i++)
+      {
+        AddTileProfile(&profile, &tile[i].profile, tile[i].rdat.region_x, y);
       }
-      break;
+      start = ProfileNow();
+    }
+
+    io->write_band(io->data, band, y, band_y2 - y);
+
+    if (profiling)
+    {
+      end = ProfileNow();
+      ProfileAdd(&profile.stats, PROFILE_WRITE, start, end);
+      TraceSpan(&profile.stats, "write", start, end, x1, y, -1);
+    }
   }
 
-  DeinitRenderData(&rdat);
+  if (thread_pool)
+  {
+    g_thread_pool_free(thread_pool, FALSE, TRUE);
+    g_cond_clear(&pool.done);
+    g_mutex_clear(&pool.lock);
+  }
 
-  DeinitBasis();
+  for (i = 0; i < tiles; i++)
+  {
+    DeinitRenderData(&tile[i].rdat);
+    ClearProfileStats(&tile[i].profile);
+  }
+  g_free(tile);
+  g_free(band);
 
-  gimp_drawable_flush(drawable);
-  gimp_drawable_merge_shadow(drawable->drawable_id, TRUE);
-  gimp_drawable_update(drawable->drawable_id, x1, y1, (x2 - x1), (y2 - y1));
+  if (profiling)
+  {
+    ReportRenderProfile(&profile);
+  }
 }
 
-/* FIXME: This function is not threadsafe, it modifies (temporarily) the 'p_state' in rdat */
 int
 RenderChannels(RenderData* rdat)
 {
   int cnum = 0, rev = 0;
   int chan = 0;
   int alpha_channel = 0;
+  int result = 0;
   PluginState* state = NULL;
+  gint64 start = 0;
 
   state = rdat->p_state;
+  start = rdat->profile ? ProfileNow() : 0;
 
   rev = state->reverse ? 1 : 0;
 
@@ -556,9 +1128,9 @@ RenderChannels(RenderData* rdat)
   alpha_channel = (rdat->pixel_stride <= 2) ? 1 : 3;
   g_assert(rdat->pixel_stride <= 4);
   PrecalcRenderStuff(rdat);
-  for (cnum = 0; cnum < rdat->pixel_stride; cnum++)
+  for (cnum = 0; cnum < rdat->pixel_stride && result == 0; cnum++)
   {
-    chan = rdat->p_state->channel[cnum];
+    chan = state->channel[cnum];
     switch (chan)
     {
       case CHAN_MAX:
@@ -571,33 +1143,40 @@ RenderChannels(RenderData* rdat)
         FillRegionPlane(rdat, 0.5);
         break;
       default:
-        state->reverse = rev ^ (chan & 1);
-        rdat->dirty |= DIRTY_OUTPUT_FUNCTION;
-        PrecalcRenderStuff(rdat);
-        RenderLow(rdat, chan);
+        /* the state is shared between threads, so the reverse flag is only changed here */
+        rdat->function_mode = FN_MODE(state->function, (rev ^ (chan & 1)));
+        result = RenderLow(rdat, chan);
         break;
     }
     rdat->buffer++;
   }
-  rdat->buffer -= rdat->pixel_stride;
-  state->reverse = rev;
-  rdat->dirty |= DIRTY_OUTPUT_FUNCTION;
-  return 0;
+  rdat->buffer -= cnum;
+  rdat->function_mode = FN_MODE(state->function, rev);
+
+  if (rdat->profile)
+  {
+    TraceSpan(rdat->profile, "RenderChannels", start, ProfileNow(), rdat->region_x, rdat->region_y, -1);
+  }
+  return result;
 }
 
 int
 RenderWarp(RenderData* rdat, int overscan)
 {
   int cnum = 0;
+  int result = 0;
+  gint64 start = 0;
+
+  start = rdat->profile ? ProfileNow() : 0;
 
   rdat->region_width += overscan;
   rdat->region_height += overscan;
 
   rdat->dirty |= DIRTY_REGION_PARAMS;
 
-  for (cnum = 0; cnum < rdat->pixel_stride; cnum++)
+  for (cnum = 0; cnum < rdat->pixel_stride && result == 0; cnum++)
   {
-    RenderLow(rdat, cnum);
+    result = RenderLow(rdat, cnum);
     rdat->buffer++;
   }
 
@@ -606,8 +1185,13 @@ RenderWarp(RenderData* rdat, int overscan)
 
   rdat->dirty |= DIRTY_REGION_PARAMS;
 
-  rdat->buffer -= rdat->pixel_stride;
-  return 0;
+  rdat->buffer -= cnum;
+
+  if (rdat->profile)
+  {
+    TraceSpan(rdat->profile, "RenderWarp", start, ProfileNow(), rdat->region_x, rdat->region_y, -1);
+  }
+  return result;
 }
 
 static int
@@ -630,43 +1214,102 @@ FillRegionPlane(RenderData* rdat, float value)
   return 0;
 }
 
+/* Returns the slot for the raw values of 'key', with the ones already there
+ * (see RawCache.step). The caller fills in the rest and then updates the step.
+ * A slot holding an older version of the same plane is reused first, so
+ * RenderChannels() doesn't evict its other planes */
+static RawCache*
+GetRawCache(RenderData* rdat, const RawKey* key)
+{
+  RawCache* slot = NULL;
+  int i = 0;
+  int size = 0;
+
+  for (i = 0; i < RAW_CACHE_SLOTS; i++)
+  {
+    if (rdat->raw[i].step && memcmp(&rdat->raw[i].key, key, sizeof(RawKey)) == 0)
+    {
+      return &rdat->raw[i];
+    }
+  }
+
+  for (i = 0; i < RAW_CACHE_SLOTS && !slot; i++)
+  {
+    if (rdat->raw[i].step && rdat->raw[i].key.plane == key->plane)
+    {
+      slot = &rdat->raw[i];
+    }
+  }
+  if (!slot)
+  {
+    slot = &rdat->raw[rdat->raw_next];
+    rdat->raw_next = (rdat->raw_next + 1) % RAW_CACHE_SLOTS;
+  }
+
+  size = key->width * key->height;
+  if (slot->alloc < size)
+  {
+    slot->values = g_renew(double, slot->values, size);
+    slot->alloc = size;
+  }
+  slot->key = *key;
+  slot->step = 0;
+
+  return slot;
+}
+
+/* whether RenderLow() samples column 'x' of a row, when sampling every
+ * 'step' pixels and the row already has every 'old_step' (0 if none) */
+static inline int
+WantSample(int x, int step, int old_step)
+{
+  return x % step == 0 && (old_step == 0 || x % old_step != 0);
+}
+
 int
 RenderLow(RenderData* rdat, int plane)
 {
 
   PluginState* state = NULL;
-  basis_fn_type* basis_fn = NULL;
+  basis_span_fn_type* basis_fn = NULL;
   float* p = NULL;
   gint x = 0, y = 0;
-  double value = NAN;
-  int write_mode = 0;
+  ShadeRowFn* shade_row = NULL;
 
   double rad1 = NAN, rad2 = NAN;
   double ang1 = NAN, ang2 = NAN;
   double dang1 = NAN, dang2 = NAN;
 
-  double alpha = NAN, beta = NAN;
+  const AngleTable* angles = NULL;
+  int col0 = 0, row0 = 0, col = 0, row = 0;
 
-  double* gradient = NULL;
-  double bias_coef[3] = {NAN};
-  double pinch_coef[5] = {NAN};
   int i = 0;
   int polar = 0;
-  int vp = 0;
 
   double x_orig = NAN;
   int function_mode = 0;
   int mapping_mode = 0;
   double px = NAN, py = NAN;
   double dx = NAN, dy = NAN;
-  double frequency = NAN;
   int height = 0, width = 0;
   double c1 = NAN, s1 = NAN, c2 = NAN, s2 = NAN;
   double phase = NAN;
-  double gain = NAN;
-  int pixel_stride = 0;
-  double shift = NAN;
   double plane1 = NAN, plane2 = NAN;
+  const BasisContext* basis_ctx = NULL;
+  void* basis_data = NULL;
+  double* coord[5] = {NULL};
+  double* values = NULL;
+  RawCache* raw_cache = NULL;
+  double* raw = NULL;
+  double* src = NULL;
+  int cached = 0;
+  int step = 1, old_step = 0, row_old_step = 0;
+  int all = 1;
+  int n = 0;
+  RawKey key;
+  int ign_phase = 0;
+  ProfileStats* profile = NULL;
+  gint64 start = 0, call_start = 0;
 
   if (rdat->dirty)
   {
@@ -678,24 +1321,21 @@ RenderLow(RenderData* rdat, int plane)
   state = rdat->p_state;
 
   mapping_mode = state->mapping;
-  phase = state->ign_phase ? 0 : state->phase;
-
-  frequency = rdat->frequency;
-  shift = rdat->shift;
+  ign_phase = state->ign_phase;
+  phase = ign_phase ? 0 : state->phase;
 
-  gradient = rdat->gradient;
-  write_mode = rdat->write_mode;
+  shade_row = rdat->shade_row;
   function_mode = rdat->function_mode;
   p = rdat->buffer;
   height = rdat->region_height;
   width = rdat->region_width;
-  gain = rdat->gain;
   x_orig = rdat->px;
   py = rdat->py;
   dx = rdat->dx;
   dy = rdat->dy;
   polar = rdat->polar;
-  pixel_stride = rdat->pixel_stride;
+  profile = rdat->profile;
+  call_start = profile ? ProfileNow() : 0;
 
   plane1 = plane + 78479.20945239; /* just any large value */
   plane2 = plane + 11824.19784571; /* ditto */
@@ -708,154 +1348,234 @@ RenderLow(RenderData* rdat, int plane)
     ang2 = rdat->ang2;
     dang1 = rdat->dang1;
     dang2 = rdat->dang2;
+    angles = rdat->angles;
+    /* the region may go past the buffer, where the angles wrap around */
+    col0 = (rdat->region_x - rdat->x_offs) % angles->width;
+    col0 += (col0 < 0) ? angles->width : 0;
+    row0 = (rdat->region_y - rdat->y_offs) % angles->rows;
+    row0 += (row0 < 0) ? angles->rows : 0;
   }
 
-  for (i = 0; i < 2; i++)
+  if (function_mode < 0 || function_mode > FN_MODE(FUNC_HALF_SINE, REVERSE_YES) || !shade_row)
   {
-    bias_coef[i] = rdat->bias_coef[i];
-    pinch_coef[i] = rdat->pinch_coef[i];
+    return -1;
   }
-  for (; i < 5; i++)
+
+  basis_ctx = rdat->basis_ctx;
+  basis_fn = GetBasisSpan(basis_ctx);
+  basis_data = rdat->basis_data;
+
+  for (i = 0; i < 5; i++)
   {
-    pinch_coef[i] = rdat->pinch_coef[i];
+    coord[i] = rdat->row + i * width;
   }
+  values = rdat->row + 5 * width;
 
-  basis_fn = GetBasis();
+  if (rdat->keep_raw)
+  {
+    memset(&key, 0, sizeof(key)); /* the padding is compared too */
+    key.basis_id = GetBasisId(basis_ctx);
+    key.plane = plane;
+    key.mapping = mapping_mode;
+    key.ign_phase = ign_phase;
+    key.width = width;
+    key.height = height;
+    key.phase = phase;
+    key.px = x_orig;
+    key.py = py;
+    key.dx = dx;
+    key.dy = dy;
+    if (polar)
+    {
+      key.rad1 = rad1;
+      key.rad2 = rad2;
+      key.ang1 = ang1;
+      key.ang2 = ang2;
+      key.dang1 = dang1;
+      key.dang2 = dang2;
+    }
+    raw_cache = GetRawCache(rdat, &key);
+    raw = raw_cache->values;
+    old_step = raw_cache->step;
+    step = rdat->step;
+    /* show as much as is already there */
+    if (old_step && old_step <= step)
+    {
+      step = old_step;
+      cached = 1;
+    }
+  }
 
   for (y = 0; y < height; y++)
   {
-    px = x_orig;
-    if (polar)
+    if (RenderCancelled(rdat))
     {
-      alpha = ang1 + y * dang1;
-      beta = ang2;
-      c1 = cos(alpha) * rad1;
-      s1 = sin(alpha); /* we need this 'times rad1' only in MAP_TILED */
+      return -1;
     }
-    for (x = 0; x < width; x++)
+
+    /* with the values cached only the shading is left to do */
+    if (!cached && y % step == 0)
     {
+      start = profile ? ProfileNow() : 0;
+
+      /* the samples of this row taken by a coarser render */
+      row_old_step = (old_step && y % old_step == 0) ? old_step : 0;
+      all = (step == 1 && !row_old_step);
+
+      px = x_orig;
+      if (polar)
+      {
+        col = col0;
+        row = (row0 + y) % angles->rows;
+        c1 = angles->row_cos[row] * rad1;
+        s1 = angles->row_sin[row]; /* we need this 'times rad1' only in MAP_TILED */
+      }
+      /* the coordinates of the whole row first, then the basis for all of them.
+       * When the phase is ignored the basis has one dimension less (see
+       * InitBasis()), so the phase coordinate must not be passed. The
+       * positions are stepped through every pixel either way, so a sample
+       * doesn't depend on the step it was taken with */
+      n = 0;
       switch (mapping_mode)
       {
         case MAP_PLANAR:
-          value = ((basis_3d_fn*)basis_fn)(0.957826 * px + 0.287348 * phase + plane1,
-                                           0.957826 * py + 0.287348 * phase + plane2,
-                                           0.917431 * phase - 0.275229 * (px + py));
+          for (x = 0; x < width; x++)
+          {
+            if (all || WantSample(x, step, row_old_step))
+            {
+              coord[0][n] = 0.957826 * px + 0.287348 * phase + plane1;
+              coord[1][n] = 0.957826 * py + 0.287348 * phase + plane2;
+              coord[2][n] = 0.917431 * phase - 0.275229 * (px + py);
+              n++;
+            }
+            px += dx;
+          }
+          ((basis_3d_span_fn*)basis_fn)(basis_ctx, basis_data, n, coord[0], coord[1], coord[2], values);
           break;
 
         case MAP_TILED: /* 4D torus, moving in a 5D space */
-          c2 = cos(beta) * rad2;
-          s2 = sin(beta) * rad2;
-          beta += dang2;
-          value = ((basis_5d_fn*)basis_fn)(c1 + plane1, s1 * rad1, c2 + plane2, s2, phase);
+          for (x = 0; x < width; x++)
+          {
+            if (all || WantSample(x, step, row_old_step))
+            {
+              c2 = angles->col_cos[col] * rad2;
+              s2 = angles->col_sin[col] * rad2;
+              coord[0][n] = c1 + plane1;
+              coord[1][n] = s1 * rad1;
+              coord[2][n] = c2 + plane2;
+              coord[3][n] = s2;
+              coord[4][n] = phase;
+              n++;
+            }
+            if (++col == angles->width)
+            {
+              col = 0;
+            }
+          }
+          if (ign_phase)
+          {
+            ((basis_4d_span_fn*)basis_fn)(basis_ctx, basis_data, n, coord[0], coord[1], coord[2], coord[3], values);
+          }
+          else
+          {
+            ((basis_5d_span_fn*)basis_fn)(basis_ctx, basis_data, n, coord[0], coord[1], coord[2], coord[3], coord[4], values);
+          }
           break;
 
         case MAP_SPHERICAL: /* 3D sphere, moving in a 4D space */
-          c2 = cos(beta) * rad2;
-          s2 = sin(beta) * rad2;
-          beta += dang2;
-          value = ((basis_4d_fn*)basis_fn)(c2 * s1, s2 * s1 + plane1, c1 + plane2, phase);
+          for (x = 0; x < width; x++)
+          {
+            if (all || WantSample(x, step, row_old_step))
+            {
+              c2 = angles->col_cos[col] * rad2;
+              s2 = angles->col_sin[col] * rad2;
+              coord[0][n] = c2 * s1;
+              coord[1][n] = s2 * s1 + plane1;
+              coord[2][n] = c1 + plane2;
+              coord[3][n] = phase;
+              n++;
+            }
+            if (++col == angles->width)
+            {
+              col = 0;
+            }
+          }
+          if (ign_phase)
+          {
+            ((basis_3d_span_fn*)basis_fn)(basis_ctx, basis_data, n, coord[0], coord[1], coord[2], values);
+          }
+          else
+          {
+            ((basis_4d_span_fn*)basis_fn)(basis_ctx, basis_data, n, coord[0], coord[1], coord[2], coord[3], values);
+          }
+          break;
+
+        case MAP_PERIODIC: /* 3D, the basis wraps around in x and y */
+          for (x = 0; x < width; x++)
+          {
+            if (all || WantSample(x, step, row_old_step))
+            {
+              coord[0][n] = px + plane1;
+              coord[1][n] = py + plane2;
+              coord[2][n] = phase;
+              n++;
+            }
+            px += dx;
+          }
+          ((basis_3d_span_fn*)basis_fn)(basis_ctx, basis_data, n, coord[0], coord[1], coord[2], values);
           break;
 
         case MAP_RADIAL:
-          value = 0.5;
+          for (x = 0; x < width; x++)
+          {
+            if (all || WantSample(x, step, row_old_step))
+            {
+              values[n++] = 0.5;
+            }
+          }
           break;
       }
 
-      value = (value * gain) + 0.5;
-
-      if (value > (1.0 - EPSILON))
-        value = (1.0 - EPSILON);
-      else if (value < EPSILON)
-        value = EPSILON;
-      else
+      if (raw)
       {
-        value = (value) / (bias_coef[0] + bias_coef[1] * value);
-
-        if (value < 0.5)
+        src = raw + y * width;
+        for (x = 0, i = 0; x < width; x++)
         {
-          value = (value) / (pinch_coef[0] + pinch_coef[1] * value);
-        }
-        else
-        {
-          value = (pinch_coef[2] + value) / (pinch_coef[3] + pinch_coef[4] * value);
+          if (all || WantSample(x, step, row_old_step))
+          {
+            src[x] = values[i++];
+          }
         }
       }
 
-      switch (function_mode)
+      if (profile)
       {
-        case FN_MODE(FUNC_RAMP, REVERSE_NO):
-          value = fmod(value * frequency, 1.0);
-          break;
-        case FN_MODE(FUNC_TRIANGLE, REVERSE_NO):
-          value = fmod(value * frequency, 1.0) * 2;
-          if (value > 1)
-            value = 2.0 - value;
-          break;
-        case FN_MODE(FUNC_SINE, REVERSE_NO):
-          value = (1 - cos(value * frequency)) * 0.5;
-          break;
-        case FN_MODE(FUNC_HALF_SINE, REVERSE_NO):
-          value = cos(value * frequency);
-          if (value < 0.0)
-            value = -value;
-          break;
-
-        case FN_MODE(FUNC_RAMP, REVERSE_YES):
-          value = 1 - fmod(value * frequency, 1.0);
-          break;
-        case FN_MODE(FUNC_TRIANGLE, REVERSE_YES):
-          value = fmod(value * frequency, 1.0) * 2;
-          if (value > 1)
-            value = 2.0 - value;
-          value = 1 - value;
-          break;
-        case FN_MODE(FUNC_SINE, REVERSE_YES):
-          value = (1 + cos(value * frequency)) * 0.5;
-          break;
-        case FN_MODE(FUNC_HALF_SINE, REVERSE_YES):
-          value = cos(value * frequency);
-          if (value < 0.0)
-            value = -value;
-          value = 1 - value;
-          break;
-
-        default:
-          return -1;
+        ProfileAdd(profile, PROFILE_BASIS, start, ProfileNow());
       }
+    }
 
-      value += shift;
-      if (value > 1.0)
-        value -= 1.0;
+    start = profile ? ProfileNow() : 0;
 
-      switch (write_mode)
-      {
-        case MODE_RAW: /* write the value as-is */
-          p[0] = value;
-          p += pixel_stride;
-          break;
-        case MODE_COLOR: /* write the value as RGBA */
-          vp = 4 * CAST_TO_INT((GRADIENT_SAMPLES - 1) * value);
-          p[0] = gradient[vp];
-          p[1] = gradient[vp + 1];
-          p[2] = gradient[vp + 2];
-          p[3] = gradient[vp + 3];
-          p += 4; /* pixel_stride */
-          break;
-        case MODE_GRAYSCALE: /* write the value as GRAY-A*/
-          vp = 2 * CAST_TO_INT((GRADIENT_SAMPLES - 1) * value);
-          p[0] = gradient[vp];
-          p[1] = gradient[vp + 1];
-          p += 2; /* pixel_stride */
-          break;
+    src = raw ? raw + (y - y % step) * width : values;
+    p = shade_row(rdat, src, step, p);
 
-        default:
-          return -1;
-      } /*switch*/
-      px += dx;
-    } /* for x */
+    if (profile)
+    {
+      ProfileAdd(profile, PROFILE_SHADE, start, ProfileNow());
+    }
     py += dy;
   } /* for y */
 
+  if (raw_cache)
+  {
+    raw_cache->step = step;
+  }
+  rdat->step_shown = MAX(rdat->step_shown, step);
+
+  if (profile)
+  {
+    TraceSpan(profile, "RenderLow", call_start, ProfileNow(), rdat->region_x, rdat->region_y, plane);
+  }
   return 0;
 }
 
@@ -867,6 +1587,9 @@ Blend(RenderData* rdat, guchar* bg, guchar* dest, int row_stride, int bytes_pp)
   float* fg = NULL;
   float gamma = NAN, bg_alpha = NAN, fg_alpha = NAN;
   float fg_comp[3] = {NAN}, bg_comp[3] = {NAN};
+  gint64 start = 0, end = 0;
+
+  start = rdat->profile ? ProfileNow() : 0;
 
   fg = rdat->buffer;
   width = rdat->region_width;
@@ -979,10 +1702,36 @@ Blend(RenderData* rdat, guchar* bg, guchar* dest, int row_stride, int bytes_pp)
     dest += row_stride;
     bg += row_stride;
   }
+
+  if (rdat->profile)
+  {
+    end = ProfileNow();
+    ProfileAdd(rdat->profile, PROFILE_BLEND, start, end);
+    TraceSpan(rdat->profile, "Blend", start, end, rdat->region_x, rdat->region_y, -1);
+  }
+}
+
+/* a pixel fetcher timing another, see Warp() */
+typedef struct
+{
+  PixelFetchFn* fetch;
+  void* fetcher;
+  ProfileStats* profile;
+} TimedFetcher;
+
+static void
+FetchTimedPixel(void* fetcher, int x, int y, guchar* pixel)
+{
+  TimedFetcher* timed = fetcher;
+  gint64 start = 0;
+
+  start = ProfileNow();
+  timed->fetch(timed->fetcher, x, y, pixel);
+  ProfileAdd(timed->profile, PROFILE_FETCH, start, ProfileNow());
 }
 
 void
-Warp(RenderData* rdat, GimpPixelFetcher* fetcher, guchar* dest, int row_stride, int bytes_pp, int overscan)
+Warp(RenderData* rdat, PixelFetchFn* fetch, void* fetcher, guchar* dest, int row_stride, int bytes_pp, int overscan)
 {
   int x = 0, y = 0;
   int width = 0, height = 0;
@@ -1014,6 +1763,18 @@ Warp(RenderData* rdat, GimpPixelFetcher* fetcher, guchar* dest, int row_stride,
 
   guchar pixel[4] = {0};
   int ix = 0, iy = 0;
+  TimedFetcher timed = {0};
+  gint64 start = 0, end = 0;
+
+  if (rdat->profile)
+  {
+    start = ProfileNow();
+    timed.fetch = fetch;
+    timed.fetcher = fetcher;
+    timed.profile = rdat->profile;
+    fetch = FetchTimedPixel;
+    fetcher = &timed;
+  }
 
   width = rdat->region_width;
   height = rdat->region_height;
@@ -1092,7 +1853,7 @@ Warp(RenderData* rdat, GimpPixelFetcher* fetcher, guchar* dest, int row_stride,
 
           px = src_x - (int)((dx1 + dx2) * 0.5);
           py = src_y - (int)((dy1 + dy2) * 0.5);
-          gimp_pixel_fetcher_get_pixel(fetcher, px, py, dest);
+          fetch(fetcher, px, py, dest);
 
           if (area_inv > 1.0)
           {
@@ -1178,7 +1939,7 @@ Warp(RenderData* rdat, GimpPixelFetcher* fetcher, guchar* dest, int row_stride,
             {
               /* FIXME: we could add some jitter, and some gaussian weighting here...
                * plus correct sample averaging considering the alpha */
-              gimp_pixel_fetcher_get_pixel(fetcher, fpx, fpy, pixel);
+              fetch(fetcher, fpx, fpy, pixel);
               for (i = 0; i < bytes_pp; i++)
               {
                 sum[i] += pixel[i];
@@ -1223,4 +1984,11 @@ Warp(RenderData* rdat, GimpPixelFetcher* fetcher, guchar* dest, int row_stride,
     src_y++;
     dest += row_stride;
   }
+
+  if (rdat->profile)
+  {
+    end = ProfileNow();
+    ProfileAdd(rdat->profile, PROFILE_WARP, start, end);
+    TraceSpan(rdat->profile, "Warp", start, end, rdat->region_x, rdat->region_y, -1);
+  }
 }
@@ -43,16 +43,69 @@ typedef float buftype;
 #define MODE_COLOR 1
 #define MODE_GRAYSCALE 2
 
+#define RAW_CACHE_SLOTS 4 /* enough for the planes of RenderChannels() and RenderWarp() */
+
+/* everything the raw basis values of a region depend on */
+typedef struct
+{
+  guint basis_id;
+  int plane, mapping, ign_phase;
+  int width, height;
+  double phase;
+  double px, py, dx, dy;
+  double rad1, rad2, ang1, ang2, dang1, dang2;
+} RawKey;
+
+typedef struct
+{
+  RawKey key;
+  double* values; /* width * height basis values, before any shading */
+  int alloc;
+  int step; /* the values of every step-th column of every step-th row are there, 0 if none */
+} RawCache;
+
+/* cos and sin of the angles of the columns and rows of the polar mappings,
+ * a whole turn each. Shared by a RenderData and its clones */
+typedef struct
+{
+  gint refs;
+  int width, rows;
+  double *col_cos, *col_sin;
+  double *row_cos, *row_sin;
+} AngleTable;
+
+struct RenderDataStr;
+
+/* Shades and writes one row of basis values, see RenderLow() */
+typedef float* ShadeRowFn(const struct RenderDataStr* rdat, const double* src, int step, float* p);
+
 typedef struct RenderDataStr
 {
   PluginState* p_state;
 
-  double* gradient;
+  double* gradient;     /* the color of each value, made from these: */
+  double fg[4], bg[4];  /* see SetRenderColors() */
+  double* grad_samples; /* see SetRenderGradient() */
+  int grad_count;
+
+  float* shade_lut; /* output function for both reverse modes, see BuildShadeLut() */
 
   float* buffer;
 
   int buf_alloc;
 
+  double* row; /* coordinates and values of the samples of one row */
+  int row_alloc;
+
+  int keep_raw; /* see SetRenderKeepRaw() */
+  RawCache raw[RAW_CACHE_SLOTS];
+  int raw_next;
+  int step;       /* see SetRenderStep() */
+  int step_shown; /* the coarsest step rendered since then */
+
+  volatile gint* cancel_gen; /* see SetRenderCancel() */
+  gint gen;
+
   int x_offs, y_offs;
   int buffer_height, buffer_width;
   int region_height, region_width;
@@ -64,6 +117,7 @@ typedef struct RenderDataStr
   double rad1, rad2;
   double ang1, ang2;
   double dang1, dang2;
+  AngleTable* angles; /* see GetAngleTable() */
 
   double pinch_coef[5];
   double bias_coef[2];
@@ -81,36 +135,56 @@ typedef struct RenderDataStr
 
   int function_mode;
   int write_mode;
+  ShadeRowFn* shade_row; /* for the write mode and the shading, NULL if unknown */
+
+  struct BasisContextStr* basis_ctx; /* see InitBasis() */
+  void* basis_data;                  /* see InitBasisData() */
+
+  struct ProfileStatsStr* profile; /* see SetRenderProfile(), NULL if not timed */
 
   guint dirty;
 } RenderData;
 
-/* we hide these, are we're not including the GIMP headers for calibration */
+/* The noise core: renders into caller-owned buffers with glib alone. The
+ * parts which need the GIMP are in render_gimp.h */
 
-#ifndef CALIBRATE
+/* Gets the pixel at x, y of the image being warped, which may be outside it */
+typedef void PixelFetchFn(void* fetcher, int x, int y, guchar* pixel);
 
-GimpPixelFetcher* GetPixelFetcher(PluginState* state, GimpDrawable* drawable);
+/* How RenderImage() gets the pixels under a band of the buffer and gives it
+ * back rendered: rows y .. y + height - 1, all the buffer width */
+typedef struct
+{
+  void (*read_band)(void* data, guchar* band, int y, int height);
+  void (*write_band)(void* data, const guchar* band, int y, int height);
+  PixelFetchFn* fetch; /* the image warps take their pixels from */
+  void* fetcher;
+  void* data;
+} RenderIO;
 
-void Render(gint32 image_ID,
-            GimpDrawable* drawable,
-            PluginState* state);
+void RenderImage(RenderData* rdat, int bytes_pp, int tile_w, int tile_h, const RenderIO* io);
 
 int RenderChannels(RenderData* rdat);
 int RenderWarp(RenderData* rdat, int overscan);
 int RenderLow(RenderData* rdat, int plane);
 void Blend(RenderData* rdat, guchar* bg, guchar* dest, int row_stride, int bytes_pp);
-void Warp(RenderData* rdat, GimpPixelFetcher* fetcher, guchar* dest, int row_stride, int bytes_pp, int overscan);
+void Warp(RenderData* rdat, PixelFetchFn* fetch, void* fetcher, guchar* dest, int row_stride, int bytes_pp, int overscan);
 
 void InitRenderData(RenderData* rdat);
 void DeinitRenderData(RenderData* rdat);
+void CloneRenderData(RenderData* dst, RenderData* src);
+gpointer RenderMemDup(gconstpointer mem, gsize size);
+void SetRenderColors(RenderData* rdat, const double* fg, const double* bg);
+void SetRenderGradient(RenderData* rdat, const double* samples, int count);
 
 void AssociateRenderToState(RenderData* rdat, PluginState* state);
 void SetRenderStateDirty(RenderData* rdat, guint dirty);
+void SetRenderKeepRaw(RenderData* rdat, int keep);
+void SetRenderStep(RenderData* rdat, int step);
+void SetRenderCancel(RenderData* rdat, volatile gint* generation, gint current);
+void SetRenderProfile(RenderData* rdat, struct ProfileStatsStr* profile);
 
 void SetRenderRegion(RenderData* rdat, int width, int height, int region_x, int region_y);
 
 void SetRenderBuffer(RenderData* rdat, int width, int height, int offset_x, int offset_y, int mode, int pixel_stride);
-void SetRenderBufferForDrawable(RenderData* rdat, GimpDrawable* drawable);
 void SetRenderBufferMode(RenderData* rdat, int mode, int pixel_stride);
-
-#endif
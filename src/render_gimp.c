@@ -0,0 +1,218 @@
+/*  Felimage Noise Plugin for the GIMP
+ *  Copyright (C) 2005 Guillermo Romero Franco <drirr_gato@users.sourceforge.net>
+ *
+ *  This file is part of the Felimage Noise Plugin for the GIMP
+ *
+ *  Felimage Noise Plugin for the Gimp is free software;
+ *  you can redistribute it and/or modify it under the terms of
+ *  the GNU General Public License as published by the Free Software
+ *  Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Felimage Noise Plugin for the Gimp is distributed in the hope
+ *  that it will be useful, but WITHOUT ANY WARRANTY; without even
+ *  the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ *  PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with fimg-noise; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+
+#include <libgimp/gimp.h>
+#include <math.h>
+#include <string.h>
+
+#include "main.h"
+
+#include "basis.h"
+
+#include "render.h"
+#include "render_gimp.h"
+
+#define GRADIENT_SAMPLES 512
+
+GimpPixelFetcher*
+GetPixelFetcher(PluginState* state, GimpDrawable* drawable)
+{
+  GimpPixelFetcher* fetcher = NULL;
+  GimpRGB bg_color = {0};
+
+  fetcher = gimp_pixel_fetcher_new(drawable, FALSE);
+
+  if (state->edge_action == GIMP_PIXEL_FETCHER_EDGE_BACKGROUND)
+  {
+    gimp_context_get_background(&bg_color);
+    gimp_pixel_fetcher_set_bg_color(fetcher, &bg_color);
+  }
+
+  gimp_pixel_fetcher_set_edge_mode(fetcher, state->edge_action);
+
+  return fetcher;
+}
+
+void
+SetRenderBufferForDrawable(RenderData* rdat, GimpDrawable* drawable)
+{
+  int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+
+  gimp_drawable_mask_bounds(drawable->drawable_id, &x1, &y1, &x2, &y2);
+
+  rdat->buffer_width = x2 - x1;
+  rdat->buffer_height = y2 - y1;
+  rdat->x_offs = x1;
+  rdat->y_offs = y1;
+
+  switch (drawable->bpp)
+  {
+    case 1:
+    case 2:
+      rdat->write_mode = MODE_GRAYSCALE;
+      rdat->pixel_stride = 2;
+      break;
+    case 3:
+    case 4:
+      rdat->write_mode = MODE_COLOR;
+      rdat->pixel_stride = 4;
+      break;
+  }
+
+  rdat->dirty |= DIRTY_BUFFER_TYPE;
+}
+
+/* Gives the render the foreground, background and gradient of the GIMP. If the
+ * gradient is not there, gradient presets use the colors */
+void
+SetRenderGimpColors(RenderData* rdat)
+{
+  GimpRGB col_fg = {0}, col_bg = {0};
+  double fg[4] = {0}, bg[4] = {0};
+  gchar* grad_name = NULL;
+  gdouble* samples = NULL;
+  gint tot_samples = 0;
+
+  gimp_context_get_foreground(&col_fg);
+  gimp_context_get_background(&col_bg);
+
+  fg[0] = col_fg.r;
+  fg[1] = col_fg.g;
+  fg[2] = col_fg.b;
+  fg[3] = col_fg.a;
+  bg[0] = col_bg.r;
+  bg[1] = col_bg.g;
+  bg[2] = col_bg.b;
+  bg[3] = col_bg.a;
+  SetRenderColors(rdat, fg, bg);
+
+  if (rdat->p_state->color_src == COL_GRADIENT)
+  {
+    grad_name = GetGradientName(rdat->p_state->gradient);
+  }
+
+  if (grad_name && gimp_gradient_get_uniform_samples(grad_name, GRADIENT_SAMPLES, 0, &tot_samples, &samples))
+  {
+    SetRenderGradient(rdat, samples, tot_samples / 4);
+    g_free(samples);
+  }
+  else
+  {
+    SetRenderGradient(rdat, NULL, 0);
+  }
+  g_free(grad_name);
+}
+
+/* what RenderImage() reads and writes through */
+typedef struct
+{
+  GimpPixelRgn src_rgn, dst_rgn;
+  gint x1, width;
+  gint progress, max_progress;
+} DrawableIO;
+
+static void
+ReadDrawableBand(void* data, guchar* band, int y, int height)
+{
+  DrawableIO* io = data;
+
+  gimp_pixel_rgn_get_rect(&io->src_rgn, band, io->x1, y, io->width, height);
+}
+
+static void
+WriteDrawableBand(void* data, const guchar* band, int y, int height)
+{
+  DrawableIO* io = data;
+
+  gimp_pixel_rgn_set_rect(&io->dst_rgn, band, io->x1, y, io->width, height);
+
+  io->progress += io->width * height;
+  gimp_progress_update((double)io->progress / io->max_progress);
+}
+
+void
+FetchGimpPixel(void* fetcher, int x, int y, guchar* pixel)
+{
+  gimp_pixel_fetcher_get_pixel(fetcher, x, y, pixel);
+}
+
+/* Renders into the drawable, a tile row at a time, see RenderImage() */
+void
+Render(gint32 image_ID,
+       GimpDrawable* drawable,
+       PluginState* state)
+{
+  DrawableIO drawable_io = {0};
+  RenderIO io = {0};
+  gint x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+  gint tile_w = 0;
+  GimpPixelFetcher* fetcher = NULL;
+  RenderData rdat = {0};
+
+  gimp_drawable_mask_bounds(drawable->drawable_id, &x1, &y1, &x2, &y2);
+
+  drawable_io.x1 = x1;
+  drawable_io.width = x2 - x1;
+  drawable_io.progress = 0;
+  drawable_io.max_progress = (x2 - x1) * (y2 - y1);
+
+  gimp_pixel_rgn_init(&drawable_io.dst_rgn, drawable, x1, y1, (x2 - x1), (y2 - y1), TRUE, TRUE);
+  gimp_pixel_rgn_init(&drawable_io.src_rgn, drawable, x1, y1, (x2 - x1), (y2 - y1), FALSE, FALSE);
+
+  tile_w = gimp_tile_width();
+  gimp_tile_cache_ntiles(2 * ((x2 - 1) / tile_w - x1 / tile_w + 1));
+
+  InitRenderData(&rdat);
+  AssociateRenderToState(&rdat, state);
+  SetRenderGimpColors(&rdat);
+
+  gimp_progress_init("Rendering noise...");
+  SetRenderBufferForDrawable(&rdat, drawable);
+
+  if (state->color_src == COL_WARP)
+  {
+    fetcher = GetPixelFetcher(state, drawable);
+  }
+
+  io.read_band = ReadDrawableBand;
+  io.write_band = WriteDrawableBand;
+  io.fetch = FetchGimpPixel;
+  io.fetcher = fetcher;
+  io.data = &drawable_io;
+
+  RenderImage(&rdat, drawable->bpp, tile_w, gimp_tile_height(), &io);
+
+  if (fetcher)
+  {
+    gimp_pixel_fetcher_destroy(fetcher);
+  }
+
+  DeinitRenderData(&rdat);
+
+  DeinitBasis(&rdat);
+
+  gimp_drawable_flush(drawable);
+  gimp_drawable_merge_shadow(drawable->drawable_id, TRUE);
+  gimp_drawable_update(drawable->drawable_id, x1, y1, (x2 - x1), (y2 - y1));
+}
@@ -74,6 +74,8 @@ SaveConfig(const char* filename, PluginState* state)
   fprintf(file, "pinch:         %f\n", state->pinch);
   fprintf(file, "bias:          %f\n", state->bias);
   fprintf(file, "gain:          %f\n", state->gain);
+  fprintf(file, "threads:       %i\n", state->threads);
+  fprintf(file, "exact_shading: %s\n", state->exact_shading ? "YES" : "NO");
 
   fprintf(file, "color_src:     %s\n", color_src_names[state->color_src]);
   switch (state->color_src)
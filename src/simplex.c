@@ -0,0 +1,167 @@
+/*  Felimage Noise Plugin for the GIMP
+ *  Copyright (C) 2005 Guillermo Romero Franco <drirr_gato@users.sourceforge.net>
+ *
+ *  This file is part of the Felimage Noise Plugin for the GIMP
+ *
+ *  Felimage Noise Plugin for the Gimp is free software;
+ *  you can redistribute it and/or modify it under the terms of
+ *  the GNU General Public License as published by the Free Software
+ *  Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Felimage Noise Plugin for the Gimp is distributed in the hope
+ *  that it will be useful, but WITHOUT ANY WARRANTY; without even
+ *  the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ *  PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with fimg-noise; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <glib.h>
+#include <math.h>
+
+#include "random.h"
+#include "simplex.h"
+
+#define SIMPLEX_MAX_DIM 5
+
+/* the squared radius of a corner's influence. With 0.5 it has faded out
+ * before the simplices that don't have that corner, so there are no seams */
+#define SIMPLEX_RADIUS2 0.5
+
+/* The same for any number of dimensions 'n', which is a constant in each of
+ * the callers below so the loops can be unrolled */
+static inline double
+SimplexBody(const double* p, const int n, guint16* shuffle_table)
+{
+  const double skew = (sqrt(n + 1.0) - 1.0) / n;
+  const double unskew = (1.0 - 1.0 / sqrt(n + 1.0)) / n;
+  int cell[SIMPLEX_MAX_DIM] = {0};
+  int axis[SIMPLEX_MAX_DIM] = {0};
+  int rank[SIMPLEX_MAX_DIM] = {0};
+  double v[SIMPLEX_MAX_DIM] = {NAN};
+  double s = NAN, s2 = NAN, t = NAN, dot = NAN;
+  double value = NAN;
+  guint h = 0;
+  int j = 0, k = 0, l = 0, zero = 0;
+
+  /* the hypercube of the skewed grid the point is in */
+  s = 0;
+  for (k = 0; k < n; k++)
+  {
+    s += p[k];
+  }
+  s *= skew;
+
+  t = 0;
+  for (k = 0; k < n; k++)
+  {
+    s2 = p[k] + s;
+    cell[k] = (s2 < 0.0) ? (int)s2 - 1 : (int)s2;
+    t += cell[k];
+  }
+  t *= unskew;
+
+  /* the position from its first corner, unskewed */
+  for (k = 0; k < n; k++)
+  {
+    v[k] = p[k] - cell[k] + t;
+    rank[k] = 0;
+  }
+
+  /* The simplex has one corner more at each step, moving along the axis
+   * with the largest remaining offset first: axis[j] moves at step j + 1 */
+  for (k = 0; k < n; k++)
+  {
+    for (l = k + 1; l < n; l++)
+    {
+      if (v[k] >= v[l])
+      {
+        rank[l]++;
+      }
+      else
+      {
+        rank[k]++;
+      }
+    }
+  }
+  for (k = 0; k < n; k++)
+  {
+    axis[rank[k]] = k;
+  }
+
+  value = 0;
+  for (j = 0; j <= n; j++)
+  {
+    if (j > 0)
+    {
+      /* the next corner */
+      cell[axis[j - 1]]++;
+      v[axis[j - 1]] -= 1.0;
+      for (k = 0; k < n; k++)
+      {
+        v[k] += unskew;
+      }
+    }
+
+    t = SIMPLEX_RADIUS2;
+    for (k = 0; k < n; k++)
+    {
+      t -= v[k] * v[k];
+    }
+    if (t <= 0)
+    {
+      continue;
+    }
+
+    /* like HashN(), first axis outermost */
+    h = Hash1(cell[n - 1]);
+    for (k = n - 2; k >= 0; k--)
+    {
+      h = Hash1(cell[k] + h);
+    }
+
+    /* the gradient is +-1 along all the axes but one, where it is 0 */
+    zero = (h >> n) % n;
+    dot = 0;
+    for (k = 0; k < n; k++)
+    {
+      if (k != zero)
+      {
+        dot += (h & (1 << k)) ? v[k] : -v[k];
+      }
+    }
+
+    t *= t;
+    value += t * t * dot;
+  }
+
+  return value;
+}
+
+double
+Simplex3D(double x, double y, double z, guint16* shuffle_table)
+{
+  const double p[3] = {x, y, z};
+
+  return SimplexBody(p, 3, shuffle_table);
+}
+
+double
+Simplex4D(double x, double y, double z, double t, guint16* shuffle_table)
+{
+  const double p[4] = {x, y, z, t};
+
+  return SimplexBody(p, 4, shuffle_table);
+}
+
+double
+Simplex5D(double x, double y, double z, double s, double t, guint16* shuffle_table)
+{
+  const double p[5] = {x, y, z, s, t};
+
+  return SimplexBody(p, 5, shuffle_table);
+}
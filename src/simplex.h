@@ -0,0 +1,30 @@
+/*  Felimage Noise Plugin for the GIMP
+ *  Copyright (C) 2005 Guillermo Romero Franco <drirr_gato@users.sourceforge.net>
+ *
+ *  This file is part of the Felimage Noise Plugin for the GIMP
+ *
+ *  Felimage Noise Plugin for the Gimp is free software;
+ *  you can redistribute it and/or modify it under the terms of
+ *  the GNU General Public License as published by the Free Software
+ *  Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Felimage Noise Plugin for the Gimp is distributed in the hope
+ *  that it will be useful, but WITHOUT ANY WARRANTY; without even
+ *  the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ *  PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with fimg-noise; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#pragma once
+
+/* Simplex noise: gradient noise over a grid of simplices. Each sample only
+ * visits the n + 1 corners of the simplex it falls in, instead of the 2^n
+ * corners of a lattice noise hypercube, so it gets cheaper than LNoise4D()
+ * and LNoise5D() as the dimensions grow */
+double Simplex3D(double x, double y, double z, guint16* shuffle_table);
+double Simplex4D(double x, double y, double z, double t, guint16* shuffle_table);
+double Simplex5D(double x, double y, double z, double s, double t, guint16* shuffle_table);
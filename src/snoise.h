@@ -22,39 +22,40 @@
 #pragma once
 
 #include "poisson.h"
+#include "random.h"
 
 /* 3D */
-typedef struct SNoiseBasisCache3DStr
+/* The feature points of every cell seed (SoA), see InitSNoiseBasis3D() */
+typedef struct SNoiseFeatures3DStr
 {
-  double p[3][MAX_FEATURES];
-  guint32 last_seed;
-} SNoiseBasisCache3D;
+  double p[3][TABLE_SIZE * FEATURE_STRIDE];
+} SNoiseFeatures3D;
 
-double SNoise3D(double a0, double a1, double a2, SNoiseBasisCache3D* cache);
+double SNoise3D(double a0, double a1, double a2, const SNoiseFeatures3D* features, guint16* shuffle_table);
 
-SNoiseBasisCache3D* InitSNoiseBasis3D();
-void FinishSNoiseBasis3D(SNoiseBasisCache3D* cache);
+/* Repeats every 'period_0' along a0 and 'period_1' along a1 (see MAP_PERIODIC) */
+double SNoise3DPeriodic(double a0, double a1, double a2, int period_0, int period_1, const SNoiseFeatures3D* features, guint16* shuffle_table);
+
+const SNoiseFeatures3D* InitSNoiseBasis3D();
 
 /* 4D */
-typedef struct SNoiseBasisCache4DStr
+/* The feature points of every cell seed (SoA), see InitSNoiseBasis4D() */
+typedef struct SNoiseFeatures4DStr
 {
-  double p[4][MAX_FEATURES];
-  guint32 last_seed;
-} SNoiseBasisCache4D;
+  double p[4][TABLE_SIZE * FEATURE_STRIDE];
+} SNoiseFeatures4D;
 
-double SNoise4D(double a0, double a1, double a2, double a3, SNoiseBasisCache4D* cache);
+double SNoise4D(double a0, double a1, double a2, double a3, const SNoiseFeatures4D* features, guint16* shuffle_table);
 
-SNoiseBasisCache4D* InitSNoiseBasis4D();
-void FinishSNoiseBasis4D(SNoiseBasisCache4D* cache);
+const SNoiseFeatures4D* InitSNoiseBasis4D();
 
 /* 5D */
-typedef struct SNoiseBasisCache5DStr
+/* The feature points of every cell seed (SoA), see InitSNoiseBasis5D() */
+typedef struct SNoiseFeatures5DStr
 {
-  double p[5][MAX_FEATURES];
-  guint32 last_seed;
-} SNoiseBasisCache5D;
+  double p[5][TABLE_SIZE * FEATURE_STRIDE];
+} SNoiseFeatures5D;
 
-double SNoise5D(double a0, double a1, double a2, double a3, double a4, SNoiseBasisCache5D* cache);
+double SNoise5D(double a0, double a1, double a2, double a3, double a4, const SNoiseFeatures5D* features, guint16* shuffle_table);
 
-SNoiseBasisCache5D* InitSNoiseBasis5D();
-void FinishSNoiseBasis5D(SNoiseBasisCache5D* cache);
+const SNoiseFeatures5D* InitSNoiseBasis5D();
@@ -26,47 +26,70 @@
 #include <stdlib.h>
 #include <string.h>
 
-#ifdef CALIBRATE
 #include <glib.h>
 #include <string.h>
-#else
-#include <libgimp/gimp.h>
-#endif
 
 #include "poisson.h"
 #include "random.h"
 #include "snoise.h"
 #include "snoise_int.h"
 
-SNoiseBasisCache4D*
+static SNoiseFeatures4D* snoise_features = NULL;
+
+/* The feature points of a cell only depend on its seed, and there are just
+ * TABLE_SIZE of them (see Hash1()), so they are all generated here once and
+ * the table is shared by everyone */
+const SNoiseFeatures4D*
 InitSNoiseBasis4D()
 {
-  SNoiseBasisCache4D* cache = NULL;
+  static gsize initialized = 0;
+  SNoiseFeatures4D* table = NULL;
+  guint32 seed = 0, s = 0, j = 0, end = 0;
 
-  cache = g_malloc(sizeof(SNoiseBasisCache4D) * (3 * 3 * 3 * 3));
-  memset(cache, 0, sizeof(SNoiseBasisCache4D) * (3 * 3 * 3 * 3));
+  if (g_once_init_enter(&initialized))
+  {
+    table = AllocFeatureTable(sizeof(SNoiseFeatures4D));
 
-  return cache;
-}
+    for (s = 0; s < TABLE_SIZE; s++)
+    {
+      seed = s;
+      end = s * FEATURE_STRIDE + Poisson_count[s & 255];
+      for (j = s * FEATURE_STRIDE; j < end; j++)
+      {
+        seed = RANDOM(seed);
+        table->p[0][j] = (seed + 0.5) * (1.0 / 4294967296.0);
 
-void
-FinishSNoiseBasis4D(SNoiseBasisCache4D* cache)
-{
-  g_free(cache);
+        seed = RANDOM(seed);
+        table->p[1][j] = (seed + 0.5) * (1.0 / 4294967296.0);
+
+        seed = RANDOM(seed);
+        table->p[2][j] = (seed + 0.5) * (1.0 / 4294967296.0);
+
+        seed = RANDOM(seed);
+        table->p[3][j] = (seed + 0.5) * (1.0 / 4294967296.0);
+      }
+    }
+
+    snoise_features = table;
+    g_once_init_leave(&initialized, 1);
+  }
+
+  return snoise_features;
 }
 
 double
-SNoise4D(double a0, double a1, double a2, double a3, SNoiseBasisCache4D* cache)
+SNoise4D(double a0, double a1, double a2, double a3, const SNoiseFeatures4D* features, guint16* shuffle_table)
 {
   int a[4] = {0};
   guint32 seed[4] = {0};
   int count = 0, j = 0;
   double d[4] = {NAN};
-  double f[4] = {NAN};
   gint32 int_at[4] = {0};
   double dist = NAN;
   double r = NAN;
   double fa[4] = {NAN};
+  double md[4] = {NAN};
+  const double* p[4] = {NULL};
 
   int_at[0] = (a0 < 0.0) ? (gint32)a0 - 1 : (gint32)a0;
   int_at[1] = (a1 < 0.0) ? (gint32)a1 - 1 : (gint32)a1;
@@ -76,74 +99,51 @@ SNoise4D(double a0, double a1, double a2, double a3, SNoiseBasisCache4D* cache)
   r = 0;
   for (a[3] = -1; a[3] <= 1; a[3]++)
   {
-    seed[3] = Hash1(a[3] + int_at[3]);
     fa[3] = a[3] + int_at[3] - a3;
+    md[3] = CELL_DIST(fa[3]);
+    seed[3] = Hash1(a[3] + int_at[3]);
     for (a[2] = -1; a[2] <= 1; a[2]++)
     {
-      seed[2] = Hash1(seed[3] + a[2] + int_at[2]);
       fa[2] = a[2] + int_at[2] - a2;
+      md[2] = md[3] + CELL_DIST(fa[2]);
+      if (md[2] >= 1.0)
+        continue;
+      seed[2] = Hash1(seed[3] + a[2] + int_at[2]);
       for (a[1] = -1; a[1] <= 1; a[1]++)
       {
-        seed[1] = Hash1(seed[2] + a[1] + int_at[1]);
         fa[1] = a[1] + int_at[1] - a1;
+        md[1] = md[2] + CELL_DIST(fa[1]);
+        if (md[1] >= 1.0)
+          continue;
+        seed[1] = Hash1(seed[2] + a[1] + int_at[1]);
         for (a[0] = -1; a[0] <= 1; a[0]++)
         {
-          seed[0] = Hash1(seed[1] + a[0] + int_at[0]);
           fa[0] = a[0] + int_at[0] - a0;
+          md[0] = md[1] + CELL_DIST(fa[0]);
+          if (md[0] >= 1.0)
+            continue;
+          seed[0] = Hash1(seed[1] + a[0] + int_at[0]);
 
           count = Poisson_count[seed[0] & 255];
+          p[0] = features->p[0] + seed[0] * FEATURE_STRIDE;
+          p[1] = features->p[1] + seed[0] * FEATURE_STRIDE;
+          p[2] = features->p[2] + seed[0] * FEATURE_STRIDE;
+          p[3] = features->p[3] + seed[0] * FEATURE_STRIDE;
 
-          if (1 || (seed[0] != cache->last_seed) || (seed[0] == 0))
+          for (j = 0; j < count; j++)
           {
-            cache->last_seed = seed[0];
-
-            for (j = 0; j < count; j++)
-            {
-
-              seed[0] = RANDOM(seed[0]);
-              f[0] = (seed[0] + 0.5) * (1.0 / 4294967296.0);
-
-              seed[0] = RANDOM(seed[0]);
-              f[1] = (seed[0] + 0.5) * (1.0 / 4294967296.0);
-
-              seed[0] = RANDOM(seed[0]);
-              f[2] = (seed[0] + 0.5) * (1.0 / 4294967296.0);
+            d[0] = p[0][j] + fa[0];
+            d[1] = p[1][j] + fa[1];
+            d[2] = p[2][j] + fa[2];
+            d[3] = p[3][j] + fa[3];
 
-              seed[0] = RANDOM(seed[0]);
-              f[3] = (seed[0] + 0.5) * (1.0 / 4294967296.0);
+            dist = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + d[3] * d[3];
 
-              d[0] = (cache->p[0][j] = f[0]) + fa[0];
-              d[1] = (cache->p[1][j] = f[1]) + fa[1];
-              d[2] = (cache->p[2][j] = f[2]) + fa[2];
-              d[3] = (cache->p[3][j] = f[3]) + fa[3];
-
-              dist = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + d[3] * d[3];
-
-              if (dist < 1.00)
-              {
-                r += KERNEL(dist);
-              }
-            }
-          }
-          else
-          {
-            for (j = 0; j < count; j++)
+            if (dist < 1.00)
             {
-              d[0] = cache->p[0][j] + fa[0];
-              d[1] = cache->p[1][j] + fa[1];
-              d[2] = cache->p[2][j] + fa[2];
-              d[3] = cache->p[3][j] + fa[3];
-
-              dist = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + d[3] * d[3];
-
-              if (dist < 1.00)
-              {
-                r += KERNEL(dist);
-              }
+              r += KERNEL(dist);
             }
           }
-
-          cache++;
         }
       }
     }
@@ -26,3 +26,9 @@
 #define KERNEL(A) (1 + (((A - 4.0) * A + 6.0) * A - 4.0) * A)
 
 #define RANDOM(SEED) (1402024253 * SEED + 586950981)
+
+/* Squared distance from the sample to the nearest face of a neighbour cell
+ * along one axis, where 'FA' is the cell corner minus the sample position.
+ * The features lie inside the cell, so a cell whose summed distances reach
+ * 1 can't contribute to the KERNEL() */
+#define CELL_DIST(FA) ((FA) > 0.0 ? (FA) * (FA) : ((FA) < -1.0 ? ((FA) + 1.0) * ((FA) + 1.0) : 0.0))